@@ -0,0 +1,298 @@
+// Microbenchmarks for the protocol hot path: request parsing, field
+// splitting, response building, base64 and token validation.
+//
+// Usage: make bench            (all benchmarks, output also in bench_output.txt)
+//        bin/bench_protocol ADD  (only benchmarks whose name contains "ADD")
+#include "auth.h"
+#include "protocol.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ============= ALLOCATION COUNTING =============
+// Interpose the glibc allocator so allocations made inside libc and OpenSSL
+// are counted too.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long long alloc_count = 0;
+static unsigned long long alloc_bytes = 0;
+
+void *malloc(size_t size) {
+  alloc_count++;
+  alloc_bytes += size;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  alloc_count++;
+  alloc_bytes += count * size;
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  alloc_count++;
+  alloc_bytes += size;
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+
+// ============= HARNESS =============
+#define BENCH_MIN_NS 200000000ULL // run each benchmark for at least 200 ms
+
+typedef void (*BenchFn)(const void *arg);
+
+static unsigned long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *bench_filter = NULL;
+
+static void run_bench(const char *name, BenchFn fn, const void *arg) {
+  if (bench_filter && !strstr(name, bench_filter))
+    return;
+
+  // Warm up, then grow the batch until it runs long enough to time
+  fn(arg);
+
+  unsigned long long iterations = 1;
+  unsigned long long elapsed = 0;
+  unsigned long long allocs = 0;
+  unsigned long long bytes = 0;
+
+  while (1) {
+    unsigned long long count_before = alloc_count;
+    unsigned long long bytes_before = alloc_bytes;
+    unsigned long long start = now_ns();
+
+    for (unsigned long long i = 0; i < iterations; i++)
+      fn(arg);
+
+    elapsed = now_ns() - start;
+    allocs = alloc_count - count_before;
+    bytes = alloc_bytes - bytes_before;
+
+    if (elapsed >= BENCH_MIN_NS)
+      break;
+    iterations *= 2;
+  }
+
+  printf("%-36s %10llu %12.1f %10.2f %12.1f\n", name, iterations,
+         (double)elapsed / iterations, (double)allocs / iterations,
+         (double)bytes / iterations);
+  fflush(stdout);
+}
+
+// ============= CORPUS =============
+static char token[512];
+static char login_request[128];
+static char list_request[1024];
+static char tagged_request[1024];
+static char add_slot_request[1024];
+static char group_request[1024];
+static char minutes_request[8192];
+
+static char add_slot_data[64];
+static char register_data[64];
+static char group_data[256];
+static char minutes_data[4096];
+
+static char list_payload[4096];
+static char minutes_text[4096];
+static char *minutes_b64 = NULL;
+
+static void build_corpus(void) {
+  char *generated = generate_token(5, "teacher1", "teacher");
+  snprintf(token, sizeof(token), "%s", generated);
+  free(generated);
+
+  snprintf(login_request, sizeof(login_request),
+           "LOGIN||||student1&pass123\r\n");
+  snprintf(list_request, sizeof(list_request), "LIST_FREE_SLOTS||%s||0\r\n",
+           token);
+  snprintf(tagged_request, sizeof(tagged_request),
+           "LIST_MY_SLOTS@17||%s||VERSION=42\r\n", token);
+  snprintf(add_slot_data, sizeof(add_slot_data), "2026-01-12||09:00||10:00||2");
+  snprintf(add_slot_request, sizeof(add_slot_request), "ADD_SLOT||%s||%s\r\n",
+           token, add_slot_data);
+  snprintf(register_data, sizeof(register_data), "student1||pass123||student");
+
+  // 30-student seminar: slot_id&member|member|...
+  int len = snprintf(group_data, sizeof(group_data), "12&");
+  for (int i = 0; i < 30; i++)
+    len += snprintf(group_data + len, sizeof(group_data) - len, "%s%d",
+                    i > 0 ? "|" : "", 100 + i);
+  snprintf(group_request, sizeof(group_request), "BOOK_GROUP||%s||%s\r\n",
+           token, group_data);
+
+  // ~4 KB of minutes text
+  const char *sentence = "Discussed thesis progress and next milestones. ";
+  minutes_text[0] = '\0';
+  while (strlen(minutes_text) + strlen(sentence) < 4000)
+    strcat(minutes_text, sentence);
+  snprintf(minutes_data, sizeof(minutes_data), "7||%.*s",
+           (int)(sizeof(minutes_data) - 8), minutes_text);
+  snprintf(minutes_request, sizeof(minutes_request), "ADD_MINUTES||%s||%s\r\n",
+           token, minutes_data);
+  minutes_b64 =
+      base64_encode((const unsigned char *)minutes_text, strlen(minutes_text));
+
+  // A full free-slot list, as handle_list_free_slots builds it
+  len = snprintf(list_payload, sizeof(list_payload),
+                 "LIST_FREE_SLOTS_SUCCESS||VERSION=42");
+  for (int i = 0; len < 3900; i++)
+    len += snprintf(list_payload + len, sizeof(list_payload) - len,
+                    "||%d&5&teacher1&2026-01-12 09:00:00&2026-01-12 "
+                    "10:00:00&Individual",
+                    i + 1);
+}
+
+// ============= BENCHMARKS =============
+static void bench_parse_request(const void *arg) {
+  Request *req = parse_request(arg);
+  free_request(req);
+}
+
+// The splitters work in place, so each run splits a fresh copy
+static void bench_parse_data_fields(const void *arg) {
+  char data[4096];
+  strcpy(data, arg);
+
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  parse_data_fields(data, &fields);
+  free_field_list(&fields);
+}
+
+static void bench_parse_subfields(const void *arg) {
+  char data[4096];
+  strcpy(data, arg);
+
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  parse_subfields(data, &fields);
+  free_field_list(&fields);
+}
+
+// BOOK_GROUP: slot&members, then the member list on "|"
+static void bench_parse_group_members(const void *arg) {
+  char data[4096];
+  strcpy(data, arg);
+
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  if (parse_subfields(data, &fields) > 1) {
+    StrView member_buf[FIELD_LIST_INLINE];
+    FieldList members = FIELD_LIST_INIT(member_buf);
+    split_fields(fields.items[1].ptr, "|", 0, &members);
+    free_field_list(&members);
+  }
+  free_field_list(&fields);
+}
+
+static void bench_build_response(const void *arg) {
+  char *response = build_response(STATUS_OK, arg);
+  free_response_string(response);
+}
+
+static void bench_build_tagged_response(const void *arg) {
+  char *response = build_tagged_response(STATUS_OK, 17, arg);
+  free_response_string(response);
+}
+
+// 50 free slots (~3.5 KB) written row by row, as the list handlers stream them
+static void bench_list_payload(const void *arg) {
+  (void)arg;
+  Response res = {0};
+  char id[16];
+  char *row[6] = {id,
+                  "5",
+                  "teacher1",
+                  "2026-01-12 09:00:00",
+                  "2026-01-12 10:00:00",
+                  "Individual"};
+
+  ListPayload list;
+  list_payload_init(&list, &res, "LIST_FREE_SLOTS_SUCCESS||VERSION=42");
+  for (int i = 0; i < 50; i++) {
+    snprintf(id, sizeof(id), "%d", i + 1);
+    list_payload_add(row, 6, &list);
+  }
+  list_payload_finish(&list);
+  free(res.chunks);
+}
+
+static void bench_base64_encode(const void *arg) {
+  char *encoded = base64_encode(arg, strlen(arg));
+  free(encoded);
+}
+
+static void bench_base64_decode(const void *arg) {
+  int length = 0;
+  unsigned char *decoded = base64_decode(arg, &length);
+  free(decoded);
+}
+
+static void bench_validate_token(const void *arg) {
+  TokenData *data = validate_token(arg);
+  free_token_data(data);
+}
+
+// ============= MAIN =============
+int main(int argc, char **argv) {
+  if (argc > 1)
+    bench_filter = argv[1];
+
+  build_corpus();
+
+  printf("%-36s %10s %12s %10s %12s\n", "benchmark", "iters", "ns/op",
+         "allocs/op", "bytes/op");
+
+  run_bench("parse_request/LOGIN", bench_parse_request, login_request);
+  run_bench("parse_request/LIST_FREE_SLOTS", bench_parse_request,
+            list_request);
+  run_bench("parse_request/tagged_LIST_MY_SLOTS", bench_parse_request,
+            tagged_request);
+  run_bench("parse_request/ADD_SLOT", bench_parse_request, add_slot_request);
+  run_bench("parse_request/BOOK_GROUP_30", bench_parse_request,
+            group_request);
+  run_bench("parse_request/ADD_MINUTES_4K", bench_parse_request,
+            minutes_request);
+
+  run_bench("parse_data_fields/REGISTER", bench_parse_data_fields,
+            register_data);
+  run_bench("parse_data_fields/ADD_SLOT", bench_parse_data_fields,
+            add_slot_data);
+  run_bench("parse_data_fields/ADD_MINUTES_4K", bench_parse_data_fields,
+            minutes_data);
+  run_bench("parse_data_fields/list_payload", bench_parse_data_fields,
+            list_payload);
+
+  run_bench("parse_subfields/LOGIN", bench_parse_subfields,
+            "student1&pass123");
+  run_bench("parse_subfields/BOOK_GROUP_30", bench_parse_group_members,
+            group_data);
+
+  run_bench("build_response/short", bench_build_response, "LOGOUT_SUCCESS");
+  run_bench("build_response/list_4K", bench_build_response, list_payload);
+  run_bench("build_tagged_response/list_4K", bench_build_tagged_response,
+            list_payload);
+
+  run_bench("list_payload/free_slots_50", bench_list_payload, NULL);
+
+  run_bench("base64_encode/4K", bench_base64_encode, minutes_text);
+  run_bench("base64_decode/4K", bench_base64_decode, minutes_b64);
+
+  run_bench("validate_token/valid", bench_validate_token, token);
+  run_bench("validate_token/garbage", bench_validate_token, "not-a-token");
+
+  free(minutes_b64);
+  return 0;
+}
@@ -1,6 +1,8 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
+#include "protocol_client.h"
+
 #define SERVER_HOST "127.0.0.1"
 #define SERVER_PORT 1234
 #define BUFFER_SIZE 8192
@@ -13,4 +15,32 @@ void close_connection(int sockfd);
 int send_request(int sockfd, const char* command, const char* token, const char* data);
 char* receive_response(int sockfd);
 
+// Pipelined communication: each request is tagged COMMAND@<id> and the server
+// may answer tagged requests out of order. Responses that arrive for another
+// id are held until asked for; the holding area starts at
+// MAX_PENDING_RESPONSES lines and grows as needed.
+//
+// A list too long for one line arrives as STATUS_CHUNK_OK lines with its
+// first rows, then the usual line with the header and the rest. Both receive
+// functions return it joined into that last line, or NULL if the connection
+// drops in between (or a line can't be held for lack of memory).
+#define MAX_PENDING_RESPONSES 32
+
+unsigned int send_tagged_request(int sockfd, const char* command, const char* token, const char* data);
+char* receive_tagged_response(int sockfd, unsigned int request_id);
+
+// Conditional list requests: remembers the last payload and version tag of a
+// list and sends the tag back, so an unchanged list costs a NOT_MODIFIED reply
+typedef struct {
+    char token[512];
+    char data[256];
+    char tag[64];
+    char* payload;  // heap
+    int valid;
+} ListCache;
+
+// Like send_request + receive_response + parse_response; NOT_MODIFIED replies
+// are turned into STATUS_OK with the cached payload
+Response* fetch_list(int sockfd, const char* command, const char* token, const char* data, ListCache* cache);
+
 #endif
@@ -6,6 +6,7 @@
 // Status codes (same as server)
 #define STATUS_OK                    2000
 #define STATUS_CHUNK_OK              2001
+#define STATUS_NOT_MODIFIED          3040
 #define STATUS_BAD_REQUEST           4000
 #define STATUS_CONFLICT              4001
 #define STATUS_TOKEN_MISSING         4010
@@ -16,10 +17,11 @@
 #define STATUS_USERNAME_EXISTS       4090
 #define STATUS_INTERNAL_ERROR        5000
 
-// Response structure
+// Response structure. payload is on the heap: a list sent in chunks can be
+// longer than one line.
 typedef struct {
     int status_code;
-    char payload[4096];
+    char* payload;
 } Response;
 
 // Parse response from server
@@ -60,19 +60,28 @@ int send_request(int sockfd, const char* command, const char* token, const char*
     return 0;
 }
 
-char* receive_response(int sockfd) {
-    static char buffer[BUFFER_SIZE];
-    memset(buffer, 0, sizeof(buffer));
-    
+// Responses read while waiting for a different one
+typedef struct {
+    unsigned int request_id;
+    char* line;
+} PendingResponse;
+
+static PendingResponse* pending = NULL;
+static int pending_count = 0;
+static int pending_capacity = 0;
+static unsigned int next_request_id = 1;
+
+// Read one raw line ending with \r\n
+static int read_response_line(int sockfd, char* buffer, int max_len) {
     int total = 0;
     char c;
     
     // Read until \r\n
-    while (total < BUFFER_SIZE - 1) {
+    while (total < max_len - 1) {
         int n = read(sockfd, &c, 1);
         
         if (n <= 0) {
-            if (total == 0) return NULL;
+            if (total == 0) return -1;
             break;
         }
         
@@ -80,11 +89,230 @@ char* receive_response(int sockfd) {
         
         // Check for \r\n
         if (total >= 2 && buffer[total-2] == '\r' && buffer[total-1] == '\n') {
-            buffer[total] = '\0';
-            return buffer;
+            break;
         }
     }
     
     buffer[total] = '\0';
-    return total > 0 ? buffer : NULL;
+    return total;
+}
+
+// Request id of a response line (STATUS@<id>||...), 0 if untagged
+static unsigned int response_request_id(const char* line) {
+    const char* end = line + strcspn(line, "|\r\n");
+    const char* sep = memchr(line, '@', end - line);
+    if (!sep) return 0;
+    
+    return (unsigned int)strtoul(sep + 1, NULL, 10);
+}
+
+// Hold a line for a later receive. Returns 0, or -1 out of memory.
+static int stash_response(const char* line, unsigned int request_id) {
+    if (pending_count == pending_capacity) {
+        int capacity = pending_capacity ? pending_capacity * 2 : MAX_PENDING_RESPONSES;
+        PendingResponse* grown = realloc(pending, capacity * sizeof(PendingResponse));
+        if (!grown) return -1;
+        pending = grown;
+        pending_capacity = capacity;
+    }
+    
+    char* copy = strdup(line);
+    if (!copy) return -1;
+    
+    pending[pending_count].request_id = request_id;
+    pending[pending_count].line = copy;
+    pending_count++;
+    return 0;
+}
+
+// Next line with the wanted id (0 = untagged), stashing others. Returns a
+// heap copy, NULL on disconnect.
+static char* next_line(int sockfd, unsigned int request_id) {
+    char buffer[BUFFER_SIZE];
+    
+    // Stashed lines of one id are in arrival order
+    for (int i = 0; i < pending_count; i++) {
+        if (pending[i].request_id == request_id) {
+            char* line = pending[i].line;
+            memmove(&pending[i], &pending[i + 1], (pending_count - i - 1) * sizeof(PendingResponse));
+            pending_count--;
+            return line;
+        }
+    }
+    
+    while (1) {
+        if (read_response_line(sockfd, buffer, sizeof(buffer)) <= 0) {
+            return NULL;
+        }
+        
+        unsigned int id = response_request_id(buffer);
+        if (id == request_id) {
+            return strdup(buffer);
+        }
+        
+        if (stash_response(buffer, id) < 0) {
+            fprintf(stderr, "Cannot hold response for request %u: out of memory\n", id);
+            return NULL;
+        }
+    }
+}
+
+// What follows the status of a line, without the CRLF
+static const char* line_payload(const char* line, size_t* len) {
+    const char* payload = strstr(line, "||");
+    payload = payload ? payload + 2 : line + strlen(line);
+    *len = strcspn(payload, "\r\n");
+    return payload;
+}
+
+// Put the rows of the chunks into the last line, right after its header:
+// <COMMAND>_SUCCESS, and the VERSION= field if there is one
+static char* splice_chunks(const char* last, const char* rows, size_t rows_len) {
+    size_t len;
+    const char* payload = line_payload(last, &len);
+    const char* end = payload + len;
+    
+    const char* header_end = strstr(payload, "||");
+    if (!header_end || header_end > end) header_end = end;
+    if (header_end < end && strncmp(header_end, "||VERSION=", 10) == 0) {
+        const char* next = strstr(header_end + 2, "||");
+        header_end = next && next < end ? next : end;
+    }
+    
+    size_t head = header_end - last;
+    char* line = malloc(head + 2 + rows_len + strlen(header_end) + 1);
+    if (!line) return NULL;
+    
+    memcpy(line, last, head);
+    memcpy(line + head, "||", 2);
+    memcpy(line + head + 2, rows, rows_len);
+    strcpy(line + head + 2 + rows_len, header_end);
+    return line;
+}
+
+// Read the response with the wanted id. A list sent in chunks comes back as
+// one line, chunk rows first. The line stays valid until the next call.
+static char* receive_matching(int sockfd, unsigned int request_id) {
+    static char* response = NULL;
+    
+    free(response);
+    response = next_line(sockfd, request_id);
+    if (!response || atoi(response) != STATUS_CHUNK_OK) {
+        return response;
+    }
+    
+    char* rows = NULL;
+    size_t rows_len = 0;
+    
+    while (response && atoi(response) == STATUS_CHUNK_OK) {
+        size_t len;
+        const char* chunk = line_payload(response, &len);
+        char* grown = realloc(rows, rows_len + len + 2);
+        if (!grown) break;
+        
+        rows = grown;
+        if (rows_len > 0) {
+            memcpy(rows + rows_len, "||", 2);
+            rows_len += 2;
+        }
+        memcpy(rows + rows_len, chunk, len);
+        rows_len += len;
+        
+        free(response);
+        response = next_line(sockfd, request_id);
+    }
+    
+    // Only a complete list is returned
+    char* line = NULL;
+    if (response && atoi(response) == STATUS_OK) {
+        line = splice_chunks(response, rows ? rows : "", rows_len);
+    }
+    
+    free(rows);
+    free(response);
+    response = line;
+    return response;
+}
+
+char* receive_response(int sockfd) {
+    return receive_matching(sockfd, 0);
+}
+
+unsigned int send_tagged_request(int sockfd, const char* command, const char* token, const char* data) {
+    unsigned int request_id = next_request_id++;
+    if (next_request_id == 0) next_request_id = 1;
+    
+    char tagged_command[64];
+    snprintf(tagged_command, sizeof(tagged_command), "%s@%u", command, request_id);
+    
+    if (send_request(sockfd, tagged_command, token, data) < 0) {
+        return 0;
+    }
+    
+    return request_id;
+}
+
+char* receive_tagged_response(int sockfd, unsigned int request_id) {
+    if (request_id == 0) return NULL;
+    
+    return receive_matching(sockfd, request_id);
+}
+
+Response* fetch_list(int sockfd, const char* command, const char* token, const char* data, ListCache* cache) {
+    const char* tok = token ? token : "";
+    const char* dat = data ? data : "";
+    
+    int conditional = cache && cache->valid &&
+                      strcmp(cache->token, tok) == 0 && strcmp(cache->data, dat) == 0;
+    
+    char request_data[512];
+    if (conditional) {
+        snprintf(request_data, sizeof(request_data), "%s||VERSION=%s", dat, cache->tag);
+    } else {
+        snprintf(request_data, sizeof(request_data), "%s", dat);
+    }
+    
+    if (send_request(sockfd, command, tok, request_data) < 0) {
+        return NULL;
+    }
+    
+    char* raw = receive_response(sockfd);
+    if (!raw) return NULL;
+    
+    Response* res = parse_response(raw);
+    if (!res || !cache) return res;
+    
+    if (res->status_code == STATUS_NOT_MODIFIED && conditional) {
+        char* payload = strdup(cache->payload);
+        if (!payload) return res;
+        
+        free(res->payload);
+        res->payload = payload;
+        res->status_code = STATUS_OK;
+        return res;
+    }
+    
+    cache->valid = 0;
+    if (res->status_code != STATUS_OK) return res;
+    
+    // Payload: <COMMAND>_SUCCESS||VERSION=<tag>||...
+    const char* tag = strstr(res->payload, "||VERSION=");
+    if (!tag) return res;
+    
+    tag += strlen("||VERSION=");
+    size_t tag_len = strcspn(tag, "|");
+    if (tag_len >= sizeof(cache->tag)) return res;
+    
+    char* payload = strdup(res->payload);
+    if (!payload) return res;
+    
+    memcpy(cache->tag, tag, tag_len);
+    cache->tag[tag_len] = '\0';
+    snprintf(cache->token, sizeof(cache->token), "%s", tok);
+    snprintf(cache->data, sizeof(cache->data), "%s", dat);
+    free(cache->payload);
+    cache->payload = payload;
+    cache->valid = 1;
+    
+    return res;
 }
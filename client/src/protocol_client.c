@@ -26,9 +26,11 @@ Response *parse_response(const char *raw) {
   res->status_code = atoi(status_str);
 
   // Parse payload (after ||)
-  const char *payload_start = delim + 2;
-  strncpy(res->payload, payload_start, sizeof(res->payload) - 1);
-  res->payload[sizeof(res->payload) - 1] = '\0';
+  res->payload = strdup(delim + 2);
+  if (!res->payload) {
+    free(res);
+    return NULL;
+  }
 
   // Remove trailing \r\n
   size_t len = strlen(res->payload);
@@ -96,8 +98,10 @@ char **parse_payload_fields(const char *payload, int *count) {
 }
 
 void free_response(Response *res) {
-  if (res)
+  if (res) {
+    free(res->payload);
     free(res);
+  }
 }
 
 void free_fields(char **fields, int count) {
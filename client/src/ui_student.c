@@ -41,27 +41,34 @@ void show_student_menu(int sockfd, const char *token, const char *username) {
   }
 }
 
+// Row version of slot_id in the listed rows
+// (slot_id&teacher_id&teacher&start&end&type&version), 0 if not listed
+static int listed_slot_version(char **rows, int count, int slot_id) {
+  for (int i = 0; i < count; i++) {
+    const char *version = rows[i];
+    if (atoi(version) != slot_id)
+      continue;
+
+    for (int amps = 0; version && amps < 6; amps++) {
+      version = strchr(version, '&');
+      if (version)
+        version++;
+    }
+    return version ? atoi(version) : 0;
+  }
+  return 0;
+}
+
 static void view_free_slots(int sockfd, const char *token) {
   clear_screen();
   draw_header("FREE SLOTS");
 
   show_info("Loading free slots...");
 
-  // Send LIST_FREE_SLOTS request
-  if (send_request(sockfd, "LIST_FREE_SLOTS", token, "") < 0) {
-    show_error("Failed to send request");
-    napms(2000);
-    return;
-  }
-
-  char *raw_response = receive_response(sockfd);
-  if (!raw_response) {
-    show_error("No response from server");
-    napms(2000);
-    return;
-  }
-
-  Response *res = parse_response(raw_response);
+  // Send LIST_FREE_SLOTS request (answered from cache if nothing changed)
+  static ListCache free_slots_cache;
+  Response *res =
+      fetch_list(sockfd, "LIST_FREE_SLOTS", token, "", &free_slots_cache);
   if (!res || res->status_code != STATUS_OK) {
     show_error(res ? res->payload : "Invalid response");
     if (res)
@@ -115,9 +122,6 @@ static void view_free_slots(int sockfd, const char *token) {
     free(slot_copy);
   }
 
-  free_fields(fields, field_count);
-  free_response(res);
-
   // Prompt for SlotID
   mvprintw(y + 1, 2, "Enter SlotID to book (or 0 to cancel): ");
   refresh();
@@ -128,6 +132,11 @@ static void view_free_slots(int sockfd, const char *token) {
   getnstr(slot_input, 19);
   noecho();
 
+  // Booking sends the version listed, so a slot moved since isn't booked
+  int version = listed_slot_version(fields, field_count, atoi(slot_input));
+  free_fields(fields, field_count);
+  free_response(res);
+
   if (strlen(slot_input) == 0 || strcmp(slot_input, "0") == 0) {
     return;
   }
@@ -143,9 +152,12 @@ static void view_free_slots(int sockfd, const char *token) {
     return;
 
   if (book_type == 0) {
-    // Book individual - only slot_id
+    // Book individual - slot_id&version
+    char data[64];
+    snprintf(data, sizeof(data), "%s&%d", slot_input, version);
+
     show_info("Booking individual meeting...");
-    if (send_request(sockfd, "BOOK_INDIVIDUAL", token, slot_input) < 0) {
+    if (send_request(sockfd, "BOOK_INDIVIDUAL", token, data) < 0) {
       show_error("Failed to send request");
     } else {
       char *raw = receive_response(sockfd);
@@ -229,7 +241,8 @@ static void view_free_slots(int sockfd, const char *token) {
     }
 
     char data[512];
-    snprintf(data, sizeof(data), "%s&%s", slot_input, members_input);
+    snprintf(data, sizeof(data), "%s&%s&%d", slot_input, members_input,
+             version);
 
     show_info("Booking group meeting...");
     if (send_request(sockfd, "BOOK_GROUP", token, data) < 0) {
@@ -261,17 +274,12 @@ static void view_my_meetings(int sockfd, const char *token) {
       return;
 
     const char *filter_data[] = {"date", "week", ""};
+    static ListCache meetings_cache[3];
 
     show_info("Loading meetings...");
 
-    if (send_request(sockfd, "LIST_MEETINGS", token, filter_data[filter]) < 0) {
-      show_error("Failed to send request");
-      napms(2000);
-      continue;
-    }
-
-    char *raw_response = receive_response(sockfd);
-    Response *res = parse_response(raw_response);
+    Response *res = fetch_list(sockfd, "LIST_MEETINGS", token,
+                               filter_data[filter], &meetings_cache[filter]);
 
     if (!res || res->status_code != STATUS_OK) {
       show_error(res ? res->payload : "Failed to load meetings");
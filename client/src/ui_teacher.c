@@ -7,7 +7,31 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Local copy of the teacher's slots, kept current with SYNC_MY_SLOTS so a
+// refresh only downloads what changed
+#define MAX_LOCAL_SLOTS 1024
+
+typedef struct {
+  int slot_id;
+  char date[16];
+  char start_time[16];
+  char end_time[16];
+  char type[16];
+  int is_booked;
+  int version; // row version, sent back with updates and deletes
+} LocalSlot;
+
+typedef struct {
+  char token[512];
+  long long version;
+  LocalSlot slots[MAX_LOCAL_SLOTS];
+  int count;
+} SlotCache;
+
+static SlotCache slot_cache;
+
 static void manage_slots(int sockfd, const char *token);
+static void add_recurring_slots(int sockfd, const char *token);
 static void view_appointments(int sockfd, const char *token);
 static void view_student_history(int sockfd, const char *token);
 
@@ -43,36 +67,145 @@ void show_teacher_menu(int sockfd, const char *token, const char *username) {
   }
 }
 
-// ============= MANAGE SLOTS - Shows list of slots first =============
-static void manage_slots(int sockfd, const char *token) {
-  while (1) {
-    // First, fetch and display current slots
-    clear_screen();
-    draw_header("MY SLOTS");
+// ============= SLOT SYNC =============
+static LocalSlot *find_local_slot(int slot_id) {
+  for (int i = 0; i < slot_cache.count; i++) {
+    if (slot_cache.slots[i].slot_id == slot_id)
+      return &slot_cache.slots[i];
+  }
+  return NULL;
+}
 
-    show_info("Loading slots...");
+// Apply one change row: U&slot_id&date&start&end&type&is_booked&version or
+// D&slot_id
+static void apply_slot_change(char *row) {
+  char *parts[8];
+  int idx = 0;
+  char *tok = strtok(row, "&");
+  while (tok && idx < 8) {
+    parts[idx++] = tok;
+    tok = strtok(NULL, "&");
+  }
 
-    if (send_request(sockfd, "LIST_MY_SLOTS", token, "") < 0) {
-      show_error("Failed to send request");
-      napms(2000);
+  if (idx >= 2 && strcmp(parts[0], "D") == 0) {
+    LocalSlot *slot = find_local_slot(atoi(parts[1]));
+    if (slot)
+      *slot = slot_cache.slots[--slot_cache.count];
+    return;
+  }
+
+  if (idx < 7 || strcmp(parts[0], "U") != 0)
+    return;
+
+  LocalSlot *slot = find_local_slot(atoi(parts[1]));
+  if (!slot) {
+    if (slot_cache.count >= MAX_LOCAL_SLOTS)
       return;
-    }
+    slot = &slot_cache.slots[slot_cache.count++];
+  }
+
+  slot->slot_id = atoi(parts[1]);
+  snprintf(slot->date, sizeof(slot->date), "%s", parts[2]);
+  snprintf(slot->start_time, sizeof(slot->start_time), "%s", parts[3]);
+  snprintf(slot->end_time, sizeof(slot->end_time), "%s", parts[4]);
+  snprintf(slot->type, sizeof(slot->type), "%s", parts[5]);
+  slot->is_booked = atoi(parts[6]);
+  slot->version = idx > 7 ? atoi(parts[7]) : 0;
+}
+
+// Append "&version" of the cached slot, if known, so the server refuses to
+// touch a slot changed since this list was synced
+static void append_slot_version(const char *slot_id, char *data,
+                                size_t size) {
+  const LocalSlot *slot = find_local_slot(atoi(slot_id));
+  size_t len = strlen(data);
+  if (slot && slot->version > 0 && len < size)
+    snprintf(data + len, size - len, "&%d", slot->version);
+}
+
+static int compare_local_slots(const void *a, const void *b) {
+  const LocalSlot *x = a, *y = b;
+  int c = strcmp(x->date, y->date);
+  return c != 0 ? c : strcmp(x->start_time, y->start_time);
+}
+
+// Bring slot_cache up to date; returns NULL on success or an error message
+static const char *sync_slots(int sockfd, const char *token) {
+  static char error[4096];
+
+  if (strcmp(slot_cache.token, token) != 0) {
+    snprintf(slot_cache.token, sizeof(slot_cache.token), "%s", token);
+    slot_cache.version = 0;
+    slot_cache.count = 0;
+  }
+
+  int more = 1;
+  while (more) {
+    char data[64];
+    snprintf(data, sizeof(data), "since=%lld", slot_cache.version);
+
+    if (send_request(sockfd, "SYNC_MY_SLOTS", token, data) < 0)
+      return "Failed to send request";
 
     char *raw_response = receive_response(sockfd);
-    Response *res = parse_response(raw_response);
+    Response *res = raw_response ? parse_response(raw_response) : NULL;
 
     if (!res || res->status_code != STATUS_OK) {
-      show_error(res ? res->payload : "Failed to load slots");
+      snprintf(error, sizeof(error), "%s",
+               res ? res->payload : "Failed to load slots");
       if (res)
         free_response(res);
-      napms(2000);
-      return;
+      return error;
     }
 
-    // Parse and display slots
+    // SYNC_MY_SLOTS_SUCCESS||VERSION=<n>||FULL|DELTA[||MORE]||rows...
     int field_count;
     char **fields = parse_payload_fields(res->payload, &field_count);
 
+    if (field_count < 3 || strncmp(fields[1], "VERSION=", 8) != 0) {
+      free_fields(fields, field_count);
+      free_response(res);
+      return "Invalid sync response";
+    }
+
+    if (strcmp(fields[2], "FULL") == 0)
+      slot_cache.count = 0;
+
+    more = 0;
+    for (int i = 3; i < field_count; i++) {
+      if (strcmp(fields[i], "MORE") == 0)
+        more = 1;
+      else
+        apply_slot_change(fields[i]);
+    }
+
+    slot_cache.version = atoll(fields[1] + 8);
+
+    free_fields(fields, field_count);
+    free_response(res);
+  }
+
+  qsort(slot_cache.slots, slot_cache.count, sizeof(LocalSlot),
+        compare_local_slots);
+  return NULL;
+}
+
+// ============= MANAGE SLOTS - Shows list of slots first =============
+static void manage_slots(int sockfd, const char *token) {
+  while (1) {
+    // First, bring the local slot list up to date and display it
+    clear_screen();
+    draw_header("MY SLOTS");
+
+    show_info("Loading slots...");
+
+    const char *sync_error = sync_slots(sockfd, token);
+    if (sync_error) {
+      show_error(sync_error);
+      napms(2000);
+      return;
+    }
+
     clear_screen();
     draw_header("MY SLOTS");
 
@@ -83,35 +216,21 @@ static void manage_slots(int sockfd, const char *token) {
     attroff(COLOR_PAIR(COLOR_HEADER) | A_BOLD);
     mvhline(y++, 2, ACS_HLINE, 65);
 
-    if (field_count == 0 ||
-        (field_count == 1 && strcmp(fields[0], "EMPTY") == 0)) {
+    if (slot_cache.count == 0) {
       mvprintw(y++, 2, "(No slots created yet)");
     } else {
-      for (int i = 0; i < field_count && y < LINES - 10; i++) {
-        // Parse: slot_id&date&start_time&end_time&type&is_booked
-        char *copy = strdup(fields[i]);
-        char *parts[6];
-        int idx = 0;
-        char *tok = strtok(copy, "&");
-        while (tok && idx < 6) {
-          parts[idx++] = tok;
-          tok = strtok(NULL, "&");
-        }
-
-        if (idx >= 6) {
-          const char *booked = strcmp(parts[5], "1") == 0 ? "Yes" : "No";
-          mvprintw(y++, 2, "%-8s %-12s %-8s %-8s %-12s %-8s", parts[0],
-                   parts[1], parts[2], parts[3], parts[4], booked);
-        }
-        free(copy);
+      for (int i = 0; i < slot_cache.count && y < LINES - 10; i++) {
+        const LocalSlot *slot = &slot_cache.slots[i];
+        mvprintw(y++, 2, "%-8d %-12s %-8s %-8s %-12s %-8s", slot->slot_id,
+                 slot->date, slot->start_time, slot->end_time, slot->type,
+                 slot->is_booked ? "Yes" : "No");
       }
     }
 
-    free_fields(fields, field_count);
-    free_response(res);
-
     // Show action menu inline (don't use show_menu as it clears screen)
-    mvprintw(y + 2, 2, "Actions: [1] Add  [2] Update  [3] Delete  [0] Back");
+    mvprintw(y + 2, 2,
+             "Actions: [1] Add  [2] Update  [3] Delete  [4] Add Recurring  "
+             "[0] Back");
     mvprintw(y + 3, 2, "Enter choice: ");
     refresh();
 
@@ -222,7 +341,7 @@ static void manage_slots(int sockfd, const char *token) {
         continue;
       }
 
-      // Format: slot_id&start_datetime&end_datetime&slot_type
+      // Format: slot_id&start_datetime&end_datetime&slot_type[&version]
       char start_datetime[32], end_datetime[32];
       snprintf(start_datetime, sizeof(start_datetime), "%s %s:00", date,
                start_time);
@@ -231,6 +350,7 @@ static void manage_slots(int sockfd, const char *token) {
       char data[512];
       snprintf(data, sizeof(data), "%s&%s&%s&%d", slot_id, start_datetime,
                end_datetime, slot_type);
+      append_slot_version(slot_id, data, sizeof(data));
 
       show_info("Updating slot...");
 
@@ -269,7 +389,12 @@ static void manage_slots(int sockfd, const char *token) {
 
       show_info("Deleting slot...");
 
-      if (send_request(sockfd, "DELETE_SLOT", token, slot_id) < 0) {
+      // Format: slot_id[&version]
+      char data[64];
+      snprintf(data, sizeof(data), "%s", slot_id);
+      append_slot_version(slot_id, data, sizeof(data));
+
+      if (send_request(sockfd, "DELETE_SLOT", token, data) < 0) {
         show_error("Failed to send request");
       } else {
         char *raw = receive_response(sockfd);
@@ -285,8 +410,75 @@ static void manage_slots(int sockfd, const char *token) {
 
       free(slot_id);
       napms(2000);
+
+    } else if (action == 4) { // Add recurring slots
+      add_recurring_slots(sockfd, token);
+    }
+  }
+}
+
+// ============= ADD RECURRING SLOTS =============
+static void add_recurring_slots(int sockfd, const char *token) {
+  clear_screen();
+  draw_header("ADD RECURRING SLOTS");
+
+  const char *rule_items[] = {"Every Day", "Every Week"};
+  int rule = show_menu("Repeat", rule_items, 2);
+  if (rule == -1)
+    return;
+
+  const char *prompts[] = {"First Date (YYYY-MM-DD):",
+                           "Last Date (YYYY-MM-DD):", "Start Time (HH:MM):",
+                           "End Time (HH:MM):"};
+  char *fields[4] = {NULL};
+  for (int i = 0; i < 4; i++) {
+    fields[i] = show_input_form(prompts[i], false);
+    if (!fields[i]) {
+      for (int j = 0; j < i; j++)
+        free(fields[j]);
+      return;
     }
   }
+
+  const char *type_items[] = {"Individual Only", "Group Only", "Both"};
+  int slot_type = show_menu("Select Slot Type", type_items, 3);
+
+  if (slot_type != -1) {
+    // rule||from||to||start||end||type
+    char data[256];
+    snprintf(data, sizeof(data), "%s||%s||%s||%s||%s||%d",
+             rule == 0 ? "daily" : "weekly", fields[0], fields[1], fields[2],
+             fields[3], slot_type);
+
+    show_info("Adding slots...");
+
+    if (send_request(sockfd, "ADD_SLOTS_RECURRING", token, data) < 0) {
+      show_error("Failed to send request");
+    } else {
+      char *raw = receive_response(sockfd);
+      Response *r = parse_response(raw);
+      if (r && r->status_code == STATUS_OK) {
+        // Payload is ADD_SLOTS_RECURRING_SUCCESS||id||id||...
+        int created = 0;
+        for (const char *p = strstr(r->payload, "||"); p;
+             p = strstr(p + 2, "||"))
+          created++;
+
+        char message[64];
+        snprintf(message, sizeof(message), "%d slots added successfully!",
+                 created);
+        show_success(message);
+      } else {
+        show_error(r ? r->payload : "Failed to add slots");
+      }
+      if (r)
+        free_response(r);
+    }
+    napms(2000);
+  }
+
+  for (int i = 0; i < 4; i++)
+    free(fields[i]);
 }
 
 // ============= VIEW APPOINTMENTS - Shows appointments, allows adding minutes
@@ -303,18 +495,12 @@ static void view_appointments(int sockfd, const char *token) {
       return;
 
     const char *filter_data[] = {"date", "week", ""};
+    static ListCache appointments_cache[3];
 
     show_info("Loading appointments...");
 
-    if (send_request(sockfd, "LIST_APPOINTMENTS", token, filter_data[filter]) <
-        0) {
-      show_error("Failed to send request");
-      napms(2000);
-      continue;
-    }
-
-    char *raw_response = receive_response(sockfd);
-    Response *res = parse_response(raw_response);
+    Response *res = fetch_list(sockfd, "LIST_APPOINTMENTS", token,
+                               filter_data[filter], &appointments_cache[filter]);
 
     if (!res || res->status_code != STATUS_OK) {
       show_error(res ? res->payload : "Failed to load appointments");
@@ -1,7 +1,6 @@
 #ifndef AUTH_H
 #define AUTH_H
 
-#include <mysql/mysql.h>
 #include <time.h>
 
 // Token structure
@@ -15,7 +14,10 @@ typedef struct {
 // Hash password với SHA256 - ĐỔI TÊN ĐỂ TRÁNH XUNG ĐỘT
 char* hash_user_password(const char* password);
 
-// Generate token: base64(user_id:timestamp:random)
+// Token hết hạn sau 1 ngày
+#define TOKEN_LIFETIME_SEC 86400
+
+// Generate token: base64(user_id:timestamp:random), NULL on failure
 char* generate_token(int user_id, const char* username, const char* role);
 
 // Validate token và trả về user info
@@ -0,0 +1,44 @@
+#ifndef CHANGE_VERSION_H
+#define CHANGE_VERSION_H
+
+#include "db_pool.h"
+#include <stddef.h>
+
+// Change counters behind the version tags of list responses.
+// Each teacher/student has a counter; the free slot lists are tagged by the
+// free slot index instead.
+#define VERSION_TAG_SIZE 64
+
+// Bump the counters of the given users
+int bump_change_versions(DbConn *conn, const int *user_ids, int count);
+
+// Bump the counters of every student who booked or joined a meeting on slot_id
+int bump_slot_participant_versions(DbConn *conn, int slot_id);
+
+// Append to the slot change log read by SYNC_MY_SLOTS: one entry per slot
+// insert, update, delete or booking-state change, replacing the slot's
+// previous entry. Call it inside the transaction of the change, after
+// bumping the teacher's counter: that row lock hands out a teacher's change
+// ids in commit order, so a sync never passes an id still to commit.
+int log_slot_change(DbConn *conn, int teacher_id, int slot_id);
+
+// The same for count (1..DB_STMT_MAX_IDS) slots of one teacher, in one insert
+int log_slot_changes(DbConn *conn, int teacher_id, const int *slot_ids,
+                     int count);
+
+// Deletion entries are kept this many days
+#define SLOT_CHANGES_KEEP_DAYS 30
+
+// Drop superseded entries and deletions older than keep_days from the slot
+// change log, raising the floor of each teacher concerned: a sync from below
+// it gets the full list. Run at startup, before any client is served.
+int prune_slot_changes(DbConn *conn, int keep_days);
+
+// Current tag for a list owned by owner_id. Views whose date window follows
+// the calendar pass the window start ("YYYY-MM-DD ..."), NULL otherwise, so
+// their tag also changes when the window moves. Returns 0 on success, -1 if
+// the counter can't be read.
+int current_version_tag(DbConn *conn, int owner_id, const char *window,
+                        char *tag, size_t tag_size);
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#ifndef DB_BACKEND_SQLITE
 #include <mysql/mysql.h>
+#endif
 
 // Database connection config
 #define DB_HOST     "localhost"
@@ -10,9 +12,30 @@
 #define DB_NAME     "meeting_db"
 #define DB_PORT     3306
 
-// Initialize database connection
+// Read replicas for read-only commands: "host:port,host:port", "" for none.
+// Same user, password and database as the primary.
+#define DB_REPLICAS ""
+#define DB_MAX_REPLICAS 8
+
+// Row lock waits give up after this long, so conflicting bookings fail fast
+#define DB_LOCK_WAIT_TIMEOUT_SEC 2
+
+// Connects to a server that doesn't answer give up after this long
+#define DB_CONNECT_TIMEOUT_SEC 3
+
+// Database file of the SQLite build (make DB_BACKEND=sqlite), created with
+// its tables on first start. Lock waits use DB_LOCK_WAIT_TIMEOUT_SEC too.
+#define DB_SQLITE_PATH "meeting_db.sqlite"
+
+// The MySQL helpers below are only built with the MySQL backend
+#ifndef DB_BACKEND_SQLITE
+
+// Initialize database connection (primary)
 MYSQL* db_connect();
 
+// Connect to a given server, e.g. a read replica
+MYSQL* db_connect_to(const char* host, unsigned int port);
+
 // Close connection
 void db_close(MYSQL* conn);
 
@@ -26,3 +49,5 @@ int db_execute(MYSQL* conn, const char* query);
 char* db_escape_string(MYSQL* conn, const char* str);
 
 #endif
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef DB_BACKEND_H
+#define DB_BACKEND_H
+
+#include "db_pool.h"
+#include "db_stmt.h"
+
+// Storage engine under db_pool.c and db_stmt.c. Exactly one is linked in,
+// picked at build time: `make` uses MySQL (db_mysql.c), `make
+// DB_BACKEND=sqlite` an embedded SQLite file (db_sqlite.c) with no database
+// server to run. Handlers only see db_pool.h and db_stmt.h.
+
+// "mysql" or "sqlite", for the logs
+extern const char *const db_backend_name;
+
+// ============= SESSIONS =============
+// Once per process, before the first connect. Returns 0 on success.
+int db_backend_init(void);
+
+// Around the life of every thread that uses a session
+void db_backend_thread_init(void);
+void db_backend_thread_end(void);
+
+// Open a session; engines without a server ignore host and port.
+// NULL on failure (logged).
+DbSession *db_backend_connect(const char *host, unsigned int port);
+void db_backend_close(DbSession *session);
+
+// 0 if the session still answers
+int db_backend_ping(DbSession *session);
+
+// Last error on the session, for the logs
+const char *db_backend_error(DbSession *session);
+unsigned int db_backend_errno(DbSession *session);
+
+// Whether an error code means the session is gone and must be reopened
+int db_backend_lost(unsigned int err);
+
+// Whether an error code means a lock conflict the caller may report as busy
+int db_backend_conflict(unsigned int err);
+
+// Return 0 on success, -1 on error
+int db_backend_begin(DbSession *session);
+int db_backend_commit(DbSession *session);
+int db_backend_rollback(DbSession *session);
+
+// ============= STATEMENTS =============
+// A parameter checked against its catalog types
+typedef struct {
+  char type; // 'i', 'l' or 's', as db_stmt_query() takes them
+  union {
+    int i;
+    long long l;
+    const char *s; // must outlive the db_backend_execute() call
+  } value;
+} DbParam;
+
+typedef enum {
+  DB_RUN_EXECUTE,  // no result set: affected rows and insert id afterwards
+  DB_RUN_BUFFERED, // the whole result is read before execute returns
+  DB_RUN_STREAM,   // rows are read off the session by db_backend_fetch()
+} DbRunMode;
+
+// Prepare catalog statement id on conn's session. NULL on error, with
+// conn->stmts.last_errno set. The statement is bound to conn for its life.
+DbStmt *db_backend_prepare(DbConn *conn, StmtId id, const char *sql);
+void db_backend_free(DbStmt *stmt);
+
+// Bind and execute. Returns 0, or -1 with conn->stmts.last_errno set.
+int db_backend_execute(DbStmt *stmt, const DbParam *params, size_t count,
+                       DbRunMode mode);
+
+long long db_backend_affected_rows(DbStmt *stmt);
+unsigned long long db_backend_num_rows(DbStmt *stmt);
+unsigned int db_backend_columns(DbStmt *stmt);
+
+// Next row: 0 with it in *row, 1 at the end, -1 on error (last_errno set).
+// The row stays valid until the next fetch or db_backend_free_result().
+int db_backend_fetch(DbStmt *stmt, DbRow *row);
+
+// Release the result and any rows not read; the statement stays prepared
+void db_backend_free_result(DbStmt *stmt);
+
+// Id generated or handed back by the last DB_RUN_EXECUTE on the session
+unsigned long long db_backend_insert_id(DbConn *conn);
+
+#endif
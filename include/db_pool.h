@@ -0,0 +1,125 @@
+#ifndef DB_POOL_H
+#define DB_POOL_H
+
+#include "db_stmt.h"
+#include <time.h>
+
+// Shared pool of MySQL sessions. Client threads lease a session for one
+// request and return it right after, so many clients share a few sessions.
+#define DB_POOL_MIN 4
+#define DB_POOL_MAX 32
+
+// Leases wait at most this long for a free session before giving up
+#define DB_POOL_LEASE_TIMEOUT_MS 5000
+
+// Sessions idle longer than this are pinged before being handed out
+#define DB_POOL_VALIDATE_IDLE_SEC 30
+
+// Sessions above DB_POOL_MIN idle longer than this are closed
+#define DB_POOL_IDLE_TIMEOUT_SEC 300
+
+// Leases that waited longer than this are logged
+#define DB_POOL_SLOW_WAIT_MS 100
+
+// Log the pool counters every N leases
+#define DB_POOL_STATS_EVERY 1000
+
+// Reads of a user who wrote within this long go to the primary, so they see
+// their own writes despite replication lag
+#define DB_READ_STICKY_SEC 5
+
+// Circuit breaker: after this many failed connects in a row a pool (primary
+// or replica) refuses leases at once instead of letting every request wait
+// for its own failed connect
+#define DB_BREAKER_FAILURES 3
+
+// While the breaker is open one lease tries again after a backoff that
+// doubles from DB_BACKOFF_BASE_MS up to DB_BACKOFF_MAX_MS, with jitter so
+// servers restarted together don't retry in step
+#define DB_BACKOFF_BASE_MS 200
+#define DB_BACKOFF_MAX_MS 10000
+
+// Read-only commands whose session died under them run again this many
+// times, on a fresh session after a backoff
+#define DB_READ_RETRIES 2
+
+struct DbPool;
+
+// Engine session (db_backend.h): a MYSQL handle or an SQLite connection
+typedef struct DbSession DbSession;
+
+typedef struct DbConn {
+  DbSession *session;
+  StmtCache stmts; // prepared statements, live as long as the session
+  int in_transaction;
+  const char *caller; // command being served, for the slow-query log
+  time_t last_used;
+  struct DbPool *pool; // primary or replica pool it belongs to
+  int slot;            // index in the pool, owned by the pool
+} DbConn;
+
+typedef struct {
+  int open;    // sessions currently connected
+  int in_use;  // sessions currently leased
+  unsigned long long leases;
+  unsigned long long waited;   // leases that had to wait for a session
+  unsigned long long timeouts; // leases that gave up
+  unsigned long long reconnects;
+  unsigned long long refused; // leases failed fast by the open breaker
+  unsigned long long total_wait_us;
+  unsigned long long max_wait_us;
+} DbPoolStats;
+
+// Open min_size sessions up front; the pool grows on demand to max_size.
+// Each read replica in DB_REPLICAS (database.h) gets a pool of the same size;
+// an unreachable replica is not fatal.
+// Returns 0 on success, -1 if not even one primary session could be opened.
+int db_pool_init(int min_size, int max_size);
+
+// Close every idle session. Leased sessions must be returned first.
+void db_pool_destroy(void);
+
+// Per-thread setup and teardown for every thread that leases sessions
+void db_thread_init(void);
+void db_thread_end(void);
+
+// Lease a session, waiting up to DB_POOL_LEASE_TIMEOUT_MS. Idle sessions are
+// pinged and reconnected if the server dropped them.
+// Stores the time spent waiting in *wait_us (may be NULL).
+// Returns NULL on timeout, when no session can be opened, or at once while
+// the pool's circuit breaker is open.
+DbConn *db_pool_lease(unsigned long long *wait_us);
+
+// Lease a session for a read-only command: a replica with a session free,
+// round robin, without waiting on any. The primary, waited on as
+// db_pool_lease() does, when user_id wrote within DB_READ_STICKY_SEC or no
+// replica had one. Never use it for writes.
+DbConn *db_pool_lease_read(int user_id, unsigned long long *wait_us);
+
+// Remember that user_id just wrote, for db_pool_lease_read()
+void db_pool_note_write(int user_id);
+
+// Whether DB_REPLICAS lists any replica
+int db_pool_has_replicas(void);
+
+// Give a session back. Sessions whose last error says the server went away
+// are closed instead of being reused.
+void db_pool_return(DbConn *conn);
+
+// Whether the session's last error says the server went away (call before
+// returning it)
+int db_pool_lost(DbConn *conn);
+
+// Sleep before retry number `attempt` (from 0): jittered exponential backoff
+void db_pool_backoff(int attempt);
+
+// Snapshot of the primary pool counters
+void db_pool_stats(DbPoolStats *out);
+
+// Transactions on a leased session. Returns 0 on success, -1 on error.
+// A session returned mid-transaction is rolled back.
+int db_begin(DbConn *conn);
+int db_commit(DbConn *conn);
+void db_rollback(DbConn *conn);
+
+#endif
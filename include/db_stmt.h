@@ -0,0 +1,204 @@
+#ifndef DB_STMT_H
+#define DB_STMT_H
+
+#include <stddef.h>
+
+// Every statement the handlers run, prepared once per pooled session and
+// reused. The SQL for each id lives in the catalog in db_stmt.c.
+typedef enum {
+  // handler_auth.c
+  STMT_USER_ID_BY_NAME,
+  STMT_USER_LOGIN,
+  STMT_USER_INSERT,
+
+  // handler_slot.c
+  STMT_SLOT_RANGE,
+  STMT_SLOT_INSERT,
+  STMT_SLOT_INSERT_DAYS_8, // id-list statements: _8 to _64 in order
+  STMT_SLOT_INSERT_DAYS_16,
+  STMT_SLOT_INSERT_DAYS_32,
+  STMT_SLOT_INSERT_DAYS_64,
+  STMT_SLOT_STATE_OWNED,
+  STMT_SLOT_UPDATE,
+  STMT_SLOT_DELETE,
+  STMT_MY_SLOTS,
+  STMT_SLOT_CHANGES_LATEST,
+  STMT_SLOT_CHANGES_SINCE,
+  STMT_STUDENTS_OF_TEACHER,
+  STMT_ALL_STUDENTS,
+
+  // handler_meeting.c
+  STMT_SLOT_FOR_BOOKING,
+  STMT_SLOT_CLAIM,
+  STMT_SLOT_SET_BOOKED,
+  STMT_MEETING_INSERT,
+  STMT_ORGANIZER_ADD,
+  STMT_GROUP_MEMBERS_ADD_8,
+  STMT_GROUP_MEMBERS_ADD_16,
+  STMT_GROUP_MEMBERS_ADD_32,
+  STMT_GROUP_MEMBERS_ADD_64,
+  STMT_STUDENTS_IN_8,
+  STMT_STUDENTS_IN_16,
+  STMT_STUDENTS_IN_32,
+  STMT_STUDENTS_IN_64,
+  STMT_MEETING_FOR_CANCEL,
+  STMT_MEETING_CANCEL,
+  STMT_ROSTER_ADD,
+  STMT_ROSTER_DROP,
+  STMT_MEETINGS_ALL,
+  STMT_MEETINGS_RANGE,
+  STMT_APPOINTMENTS_ALL,
+  STMT_APPOINTMENTS_RANGE,
+  STMT_MEETING_FOR_MINUTES,
+  STMT_HISTORY,
+
+  // slot_index.c
+  STMT_SLOT_INDEX_LOAD,
+
+  // user_directory.c
+  STMT_USER_DIRECTORY_LOAD,
+
+  // free_slots.c
+  STMT_FREE_SLOTS_LOAD,
+  STMT_FREE_SLOTS_ONE,
+
+  // minutes.c
+  STMT_MINUTES_SAVE,
+  STMT_MINUTES_KNOWN,
+
+  // change_version.c
+  STMT_VERSION_GET,
+  STMT_VERSION_BUMP,
+  STMT_VERSION_BUMP_2,
+  STMT_VERSION_BUMP_3,
+  STMT_VERSION_BUMP_PARTICIPANTS,
+  STMT_SLOT_CHANGE_LOG,
+  STMT_SLOT_CHANGE_LOG_8,
+  STMT_SLOT_CHANGE_LOG_16,
+  STMT_SLOT_CHANGE_LOG_32,
+  STMT_SLOT_CHANGE_LOG_64,
+  STMT_SLOT_CHANGE_CLEAR,
+  STMT_SLOT_CHANGES_PRUNE_SUPERSEDED,
+  STMT_SLOT_CHANGES_RAISE_FLOORS,
+  STMT_SLOT_CHANGES_RELOG_BELOW_FLOOR,
+  STMT_SLOT_CHANGES_DROP_BELOW_FLOOR,
+
+  STMT_COUNT
+} StmtId;
+
+// Most parameters a catalog statement takes
+#define DB_STMT_MAX_PARAMS 8
+
+// Longest id list an id-list statement takes (its _64 variant)
+#define DB_STMT_MAX_IDS 64
+
+// Most placeholders any statement binds: parameters before an id list + ids
+#define DB_STMT_MAX_BINDS (DB_STMT_MAX_PARAMS + DB_STMT_MAX_IDS)
+
+// Initial buffer per result column; longer values grow it on fetch
+#define DB_STMT_COLUMN_SIZE 256
+
+// Statements taking at least this long go to the slow-query log with their
+// SQL, the command that ran them, rows and elapsed time; -1 turns it off
+#define DB_SLOW_QUERY_MS 100
+
+// Slow statements are also appended here ("" for the server log only)
+#define DB_SLOW_QUERY_LOG "logs/slow_query.log"
+
+// Log the per-statement latency summary every N statements
+#define DB_STMT_STATS_EVERY 10000
+
+// Latency histogram: bucket i counts statements under 2^i us (up to ~0.5 s),
+// the last bucket everything slower
+#define DB_STMT_TIMING_BUCKETS 20
+
+typedef struct {
+  unsigned long long calls;
+  unsigned long long errors;
+  unsigned long long total_us;
+  unsigned long long max_us;
+  unsigned long long buckets[DB_STMT_TIMING_BUCKETS];
+} DbStmtTiming;
+
+// One prepared statement with its result buffers
+typedef struct DbStmt DbStmt;
+
+// Per-session cache, indexed by StmtId; statements are prepared on first use
+typedef struct {
+  DbStmt *stmts[STMT_COUNT];
+  unsigned int last_errno; // errno of the last failed statement, 0 if none
+} StmtCache;
+
+// A fetched row: column values as strings, NULL for SQL NULL. Valid until the
+// next fetch on the same statement.
+typedef char **DbRow;
+
+// Pooled session (db_pool.h) the statements run on
+typedef struct DbConn DbConn;
+
+// Close every cached statement (the session is going away or reconnected)
+void db_stmt_cache_clear(StmtCache *cache);
+
+// Run a SELECT and buffer its whole result. Parameters follow `types`, one
+// character per placeholder: 'i' int, 'l' long long, 's' const char*.
+// Returns NULL on error; finish with db_stmt_done().
+DbStmt *db_stmt_query(DbConn *conn, StmtId id, const char *types, ...);
+
+// Run an INSERT/UPDATE/DELETE. Returns the affected rows, -1 on error.
+long long db_stmt_execute(DbConn *conn, StmtId id, const char *types, ...);
+
+// Row callback for db_stmt_stream(); columns is the row width. Return 0 to
+// keep going, non-zero to stop early.
+typedef int (*DbRowFn)(DbRow row, unsigned int columns, void *arg);
+
+// Run a SELECT and hand each row to on_row as it arrives from the server,
+// without buffering the result: memory stays at one row and the first row is
+// handled before the last one is sent. No other statement may run on the
+// session until it returns. Returns the rows handed over, -1 on error.
+long long db_stmt_stream(DbConn *conn, StmtId id, DbRowFn on_row, void *arg,
+                         const char *types, ...);
+
+// Id-list statements end in "IN (?, ...)". `family` is the _8 variant; the
+// smallest variant that fits `count` ids is used, padded by repeating the last
+// id. `lead` (may be NULL) is an int parameter placed before the list.
+// count must be 1..DB_STMT_MAX_IDS.
+DbStmt *db_stmt_query_ids(DbConn *conn, StmtId family, const int *lead,
+                          const int *ids, int count);
+long long db_stmt_execute_ids(DbConn *conn, StmtId family, const int *lead,
+                              const int *ids, int count);
+
+// Id-list statement whose parameters before the list are not just one int:
+// they follow `types` as in db_stmt_execute() and must match the catalog.
+// Returns the affected rows, -1 on error.
+long long db_stmt_execute_ids_after(DbConn *conn, StmtId family,
+                                    const int *ids, int count,
+                                    const char *types, ...);
+
+// Catalog SQL for a statement; *params (may be NULL) gets its parameter types.
+// For id-list statements those are the parameters before the list, NULL if
+// they are ints too. Used by bin/migrate to EXPLAIN the catalog.
+const char *db_stmt_sql(StmtId id, const char **params);
+
+// Timing counters of one statement. Every query/execute/stream call counts
+// under the statement id it ran as, from execute to its last row.
+void db_stmt_timing(StmtId id, DbStmtTiming *out);
+
+// Log calls, errors, average, p50/p95/p99 and max of every statement run
+void db_stmt_log_timings(void);
+
+// Next row of a db_stmt_query() result, NULL at the end
+DbRow db_stmt_fetch(DbStmt *stmt);
+
+unsigned long long db_stmt_num_rows(DbStmt *stmt);
+
+// AUTO_INCREMENT id generated by the last db_stmt_execute() on the session
+unsigned long long db_stmt_insert_id(DbConn *conn);
+
+// Whether the last failed statement lost a lock conflict (lock wait timeout
+// or deadlock; a busy database file under SQLite)
+int db_stmt_conflict(DbConn *conn);
+
+// Release the buffered result; the statement stays prepared in the cache
+void db_stmt_done(DbStmt *stmt);
+
+#endif
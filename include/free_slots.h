@@ -0,0 +1,55 @@
+#ifndef FREE_SLOTS_H
+#define FREE_SLOTS_H
+
+#include "db_pool.h"
+#include "protocol.h"
+#include <stddef.h>
+
+// In-memory copy of every slot, answering LIST_FREE_SLOTS without the
+// database. The unbooked slots are kept sorted by start time, once for all
+// teachers and once per teacher. Loaded from the slots table at startup and
+// updated by every slot write and booking change (the single writer rule is
+// in main(), server.c). Teacher names come from the user directory, which
+// must be loaded first.
+//
+// Each list has a generation counter, bumped whenever a slot enters, leaves or
+// changes in it; with the server's start time it makes the list's version tag.
+
+// Hash buckets for the slot ids and for the teachers
+#define FREE_SLOTS_SLOT_BUCKETS 4096
+#define FREE_SLOTS_TEACHER_BUCKETS 256
+
+// Locks ordering the read-backs and deletes of one slot, by slot id
+#define FREE_SLOTS_REFRESH_LOCKS 64
+
+// Load every slot. Returns 0 on success, -1 on error.
+int free_slots_load(DbConn *conn);
+
+// Drop the whole index
+void free_slots_free(void);
+
+// A new slot was committed: free, at version 1
+void free_slots_add(int slot_id, int teacher_id, long long start,
+                    long long end, int slot_type);
+
+// UPDATE_SLOT committed slot_id at version. Applied in place when the index
+// holds the version before it, else the slot is read back as
+// free_slots_refresh() does. Returns 0 on success, -1 if it can't be read.
+int free_slots_update(DbConn *conn, int slot_id, long long start,
+                      long long end, int slot_type, int version);
+
+// slot_id was deleted
+void free_slots_remove(int slot_id);
+
+// Read slot_id back after its booking state changed. Writes that race apply
+// in version order. Returns 0 on success, -1 if the slot can't be read.
+int free_slots_refresh(DbConn *conn, int slot_id);
+
+// Version tag of the free slots of teacher_id, all teachers for 0
+void free_slots_tag(int teacher_id, char *tag, size_t tag_size);
+
+// Add the free slots of teacher_id (all teachers for 0) in start order, as
+// slot_id&teacher_id&teacher&start_time&end_time&type&version rows
+void free_slots_list(int teacher_id, ListPayload *list);
+
+#endif
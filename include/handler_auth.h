@@ -2,15 +2,15 @@
 #define HANDLER_AUTH_H
 
 #include "protocol.h"
-#include <mysql/mysql.h>
+#include "db_pool.h"
 
 // REGISTER: username||password
-Response* handle_register(Request* req, MYSQL* db_conn);
+Response* handle_register(Request* req, DbConn* db_conn);
 
 // LOGIN: username&password
-Response* handle_login(Request* req, MYSQL* db_conn);
+Response* handle_login(Request* req, DbConn* db_conn);
 
 // LOGOUT (cần token)
-Response* handle_logout(Request* req, MYSQL* db_conn);
+Response* handle_logout(Request* req, DbConn* db_conn);
 
 #endif
@@ -2,30 +2,33 @@
 #define HANDLER_MEETING_H
 
 #include "protocol.h"
-#include <mysql/mysql.h>
+#include "db_pool.h"
+
+// Most members (besides the leader) a BOOK_GROUP request may name
+#define MAX_GROUP_MEMBERS 64
 
 // BOOK_INDIVIDUAL: teacher_id&slot_id
-Response* handle_book_individual(Request* req, MYSQL* db_conn);
+Response* handle_book_individual(Request* req, DbConn* db_conn);
 
 // BOOK_GROUP: teacher_id&slot_id&member_id|member_id|...
-Response* handle_book_group(Request* req, MYSQL* db_conn);
+Response* handle_book_group(Request* req, DbConn* db_conn);
 
 // CANCEL_MEETING: meeting_id
-Response* handle_cancel_meeting(Request* req, MYSQL* db_conn);
+Response* handle_cancel_meeting(Request* req, DbConn* db_conn);
 
-// LIST_MEETINGS: date|week
-Response* handle_list_meetings(Request* req, MYSQL* db_conn);
+// LIST_MEETINGS: date[&+HH:MM] | week[&+HH:MM] | range&YYYY-MM-DD&YYYY-MM-DD
+Response* handle_list_meetings(Request* req, DbConn* db_conn);
 
-// LIST_APPOINTMENTS: date|week (teacher only)
-Response* handle_list_appointments(Request* req, MYSQL* db_conn);
+// LIST_APPOINTMENTS: same filters as LIST_MEETINGS (teacher only)
+Response* handle_list_appointments(Request* req, DbConn* db_conn);
 
 // ADD_MINUTES: meeting_id||<base64_content>
-Response* handle_add_minutes(Request* req, MYSQL* db_conn);
+Response* handle_add_minutes(Request* req, DbConn* db_conn);
 
 // GET_MINUTES: meeting_id
-Response* handle_get_minutes(Request* req, MYSQL* db_conn);
+Response* handle_get_minutes(Request* req, DbConn* db_conn);
 
 // VIEW_HISTORY: student_id (teacher only)
-Response* handle_view_history(Request* req, MYSQL* db_conn);
+Response* handle_view_history(Request* req, DbConn* db_conn);
 
 #endif
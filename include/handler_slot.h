@@ -1,15 +1,23 @@
 #ifndef HANDLER_SLOT_H
 #define HANDLER_SLOT_H
 
+#include "db_pool.h"
 #include "protocol.h"
-#include <mysql/mysql.h>
-
-Response *handle_add_slot(Request *req, MYSQL *db_conn);
-Response *handle_update_slot(Request *req, MYSQL *db_conn);
-Response *handle_delete_slot(Request *req, MYSQL *db_conn);
-Response *handle_list_free_slots(Request *req, MYSQL *db_conn);
-Response *handle_list_my_slots(Request *req, MYSQL *db_conn);
-Response *handle_list_students(Request *req, MYSQL *db_conn);
-Response *handle_list_all_students(Request *req, MYSQL *db_conn);
+
+// Slot changes returned per SYNC_MY_SLOTS call
+#define SYNC_BATCH_SIZE 64
+
+// Most slots one ADD_SLOTS_RECURRING may create
+#define RECURRING_MAX_SLOTS 128
+
+Response *handle_add_slot(Request *req, DbConn *db_conn);
+Response *handle_add_slots_recurring(Request *req, DbConn *db_conn);
+Response *handle_update_slot(Request *req, DbConn *db_conn);
+Response *handle_delete_slot(Request *req, DbConn *db_conn);
+Response *handle_list_free_slots(Request *req, DbConn *db_conn);
+Response *handle_list_my_slots(Request *req, DbConn *db_conn);
+Response *handle_sync_my_slots(Request *req, DbConn *db_conn);
+Response *handle_list_students(Request *req, DbConn *db_conn);
+Response *handle_list_all_students(Request *req, DbConn *db_conn);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef MINUTES_H
+#define MINUTES_H
+
+#include "db_pool.h"
+#include <stddef.h>
+
+// Meeting minutes live in MINUTES_DIR/meeting_<id>.txt; the meeting_minutes
+// table keeps their size, SHA-256 and last write time so VIEW_HISTORY reads
+// them with its query instead of opening a file per row.
+#define MINUTES_DIR "minutes"
+
+// Longest file path minutes_path() writes
+#define MINUTES_PATH_SIZE 64
+
+void minutes_path(int meeting_id, char *out, size_t size);
+
+// Write the minutes of meeting_id and record their metadata.
+// Returns 0 on success, -1 if the file can't be written, -2 if the metadata
+// can't be recorded.
+int minutes_save(DbConn *conn, int meeting_id, const char *content);
+
+// Record metadata for minutes files written before the table existed, by
+// hand, or by a minutes_save() whose metadata failed. A file whose row has
+// its size and mtime is skipped, so this reads only new or changed files.
+// Returns the number of files recorded, -1 on error.
+int minutes_backfill(DbConn *conn);
+
+#endif
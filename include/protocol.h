@@ -2,10 +2,12 @@
 #define PROTOCOL_H
 
 #include <stddef.h>
+#include "utils.h"
 
 // Status codes
 #define STATUS_OK                    2000
 #define STATUS_CHUNK_OK              2001
+#define STATUS_NOT_MODIFIED          3040
 #define STATUS_BAD_REQUEST           4000
 #define STATUS_CONFLICT              4001
 #define STATUS_TOKEN_MISSING         4010
@@ -16,29 +18,78 @@
 #define STATUS_USERNAME_EXISTS       4090
 #define STATUS_INTERNAL_ERROR        5000
 
+// Optional request id: COMMAND@<id>||TOKEN||DATA, echoed as STATUS@<id>||...
+// The id is 1..UINT_MAX; any other is answered 4000||INVALID_REQUEST_ID.
+// Tagged requests may be answered out of order; untagged ones stay in order.
+#define REQUEST_ID_SEP '@'
+
 // Request structure
 typedef struct {
     char command[32];
+    unsigned int request_id;  // 0 = untagged
+    int bad_request_id;       // tagged, but not with 1..UINT_MAX
     char token[512];
     char data[4096];
 } Request;
 
-// Response structure
+// Response structure. A list too long for one line also has chunks: the
+// payloads of the STATUS_CHUNK_OK lines sent before it, each ending in '\0'.
 typedef struct {
     int status_code;
     char payload[4096];
+    char* chunks;
+    size_t chunks_len;
 } Response;
 
 // Main functions
 Request* parse_request(const char* raw_message);
 char* build_response(int status_code, const char* payload);
+char* build_tagged_response(int status_code, unsigned int request_id,
+                            const char* payload);
+
+// Conditional list requests: DATA may end with ||VERSION=<tag> (or be just
+// VERSION=<tag>); list responses carry the current tag the same way.
+#define VERSION_FIELD "VERSION="
+
+// Strip the version field from data. Returns 1 if the client sent one.
+int take_version_tag(char* data, char* tag, size_t tag_size);
+
+// List payloads: HEADER||row||row..., a row's columns joined with "&", or
+// HEADER||EMPTY. Rows are written straight into the response payload as they
+// are fetched. When it fills up, its rows move to a chunk, sent ahead as
+// STATUS_CHUNK_OK||row||row..., and the payload starts over after the header:
+// the header and its version tag only go out with the last rows.
+typedef struct {
+    Response* res;
+    char* buf;
+    size_t size;
+    size_t len;
+    size_t header_len;
+    int rows;
+    int full;  // rows were dropped: a row too long for a line, or no memory
+} ListPayload;
+
+// Room for a list in Response.payload that still leaves build_response()
+// space for the status, request id and CRLF
+#define LIST_PAYLOAD_SIZE (sizeof(((Response*)0)->payload) - 32)
+
+void list_payload_init(ListPayload* list, Response* res, const char* header);
+
+// Append one row. Matches the db_stmt_stream() row callback: returns non-zero
+// if the row had to be dropped, which stops the stream.
+int list_payload_add(char** columns, unsigned int count, void* list);
+
+// Writes EMPTY if no row was added. Returns -1, dropping the chunks, if any
+// row was dropped: such a list must not go out as complete.
+int list_payload_finish(ListPayload* list);
 
-// Helper functions - ⚠️ ĐẢM BẢO CÓ 2 DÒNG NÀY
-char** parse_data_fields(const char* data, int* field_count);
-char** parse_subfields(const char* field, int* subfield_count);
+// Helper functions - split in place (see split_fields), return field count
+int parse_data_fields(char* data, FieldList* fields);
+int parse_subfields(char* field, FieldList* subfields);
 
 // Free functions
 void free_request(Request* req);
+void free_response(Response* res);
 void free_response_string(char* response);
 
 #endif
\ No newline at end of file
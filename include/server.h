@@ -1,20 +1,24 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-#include <mysql/mysql.h>
+#include "db_pool.h"
 #include "protocol.h"
 
 #define SERVER_PORT 1234
 #define MAX_CLIENTS 100
 #define BUFFER_SIZE 8192
 
-// Handle client connection
-void handle_client(int client_fd, MYSQL* db_conn);
+// Tagged (COMMAND@<id>) requests in flight per connection
+#define MAX_INFLIGHT_WORKERS 4
+#define MAX_INFLIGHT_REQUESTS 32
+
+// Handle client connection; each request leases a session from the DB pool
+void handle_client(int client_fd);
 
 // Read one line ending with \r\n
 int read_line(int fd, char* buffer, int max_len);
 
 // Process command và trả về response
-Response* process_command(Request* req, MYSQL* db_conn);
+Response* process_command(Request* req, DbConn* db_conn);
 
 #endif
@@ -0,0 +1,64 @@
+#ifndef SLOT_INDEX_H
+#define SLOT_INDEX_H
+
+#include "db_pool.h"
+
+// In-memory interval tree of every teacher's slots, so slot writes check for
+// overlaps without a database round trip. Loaded from the slots table at
+// startup and kept in step by every slot insert, move and delete (the single
+// writer rule is in main(), server.c).
+//
+// A write first claims its interval, which fails if the interval overlaps
+// another slot of the teacher or another claim in flight. The handler then
+// writes the row and either commits the claim under the slot's id or releases
+// it. Intervals are half-open: a slot ending at 10:00 doesn't overlap one
+// starting at 10:00.
+
+// Hash buckets for the teachers and for the slot ids
+#define SLOT_INDEX_TEACHER_BUCKETS 256
+#define SLOT_INDEX_SLOT_BUCKETS 4096
+
+typedef enum {
+  SLOT_INDEX_OK,
+  SLOT_INDEX_OVERLAP,
+  SLOT_INDEX_ERROR // out of memory
+} SlotIndexResult;
+
+// "YYYY-MM-DD HH:MM:SS" plus terminator
+#define SLOT_TIME_SIZE 20
+
+// "YYYY-MM-DD HH:MM[:SS]" on a real day (no 02-31) as a number that sorts
+// like the time.
+// Returns 0, or -1 if text isn't such a time.
+int slot_time_parse(const char *text, long long *out);
+
+// Back to "YYYY-MM-DD HH:MM:SS", as MySQL returns a DATETIME
+void slot_time_format(long long key, char out[SLOT_TIME_SIZE]);
+
+// Load every slot. Returns 0 on success, -1 on error.
+int slot_index_load(DbConn *conn);
+
+// Drop the whole index
+void slot_index_free(void);
+
+// Claim [start, end) for a slot of teacher_id about to be written. The
+// current interval of slot_id is ignored, so a slot may move onto itself;
+// pass 0 for a new slot.
+SlotIndexResult slot_index_claim(int teacher_id, long long start,
+                                 long long end, int slot_id);
+
+// The write went through: the claim at start becomes slot_id's interval at
+// version (the row's version after the write, 1 for a new slot), replacing
+// the one slot_id had. Dropped instead if slot_id is already indexed at that
+// version or a later one, or was deleted.
+void slot_index_commit(int teacher_id, long long start, int slot_id,
+                       int version);
+
+// The write failed: drop the claim at start
+void slot_index_release(int teacher_id, long long start);
+
+// slot_id was deleted. Remembered, so a commit for it arriving late is
+// dropped.
+void slot_index_remove(int slot_id);
+
+#endif
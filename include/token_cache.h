@@ -0,0 +1,26 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+#include "auth.h"
+
+// Recently validated tokens, shared by every client thread, so a request
+// doesn't decode its token again. Direct-mapped by a hash of the token; a new
+// token overwrites whatever shared its entry.
+//
+// Each entry is a seqlock: lookups take no lock and treat an entry being
+// rewritten as a miss, and a writer that finds its entry busy skips caching.
+
+// Entries, a power of two
+#define TOKEN_CACHE_ENTRIES 1024
+
+// Longer tokens are not cached
+#define TOKEN_CACHE_TOKEN_SIZE 256
+
+// Copy what token decoded to into out. Returns 1 on a hit, 0 on a miss.
+// Expiry is left to the caller.
+int token_cache_get(const char *token, TokenData *out);
+
+// Remember the decoded data of a valid token
+void token_cache_put(const char *token, const TokenData *data);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef USER_DIRECTORY_H
+#define USER_DIRECTORY_H
+
+#include "db_pool.h"
+#include "db_stmt.h"
+#include "protocol.h"
+
+// Every user's name and role in memory, in an array indexed by user_id, so
+// list queries return ids and the handlers write the names. Loaded from the
+// users table at startup and extended by REGISTER (the single writer rule is
+// in main(), server.c).
+//
+// Names are interned: the pointers handed out stay valid until
+// user_directory_free(), without holding any lock.
+
+// Ids past this are not kept (their names resolve to NULL)
+#define USER_DIRECTORY_MAX_ID (1 << 22)
+
+// Widest row user_directory_list_add() takes
+#define USER_DIRECTORY_MAX_COLUMNS 16
+
+typedef enum {
+  USER_ROLE_NONE, // no such user
+  USER_ROLE_STUDENT,
+  USER_ROLE_TEACHER
+} UserRole;
+
+// Load every user. Returns 0 on success, -1 on error.
+int user_directory_load(DbConn *conn);
+
+// Drop the whole directory
+void user_directory_free(void);
+
+// A user was registered. role is "student" or "teacher". Returns 0 on
+// success, -1 if the user can't be kept.
+int user_directory_add(int user_id, const char *username, const char *role);
+
+// Name of user_id, NULL if unknown
+const char *user_directory_name(int user_id);
+
+UserRole user_directory_role(int user_id);
+
+// db_stmt_stream() callback: adds the row to list like list_payload_add(),
+// with column user_column (a user id) written as that user's name
+typedef struct {
+  ListPayload *list;
+  unsigned int user_column;
+} NamedRows;
+
+int user_directory_list_add(DbRow row, unsigned int columns, void *arg);
+
+#endif
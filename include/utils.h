@@ -11,14 +11,41 @@ void log_message(const char* level, const char* format, ...);
 
 // String utilities
 char* trim(char* str);
-char** split_string(char* str, const char* delimiter, int* count);
-void free_split(char** parts, int count);
+
+// Field splitting. Fields are views into the split string: the delimiter is
+// overwritten with '\0', so each ptr is also a C string. Empty fields are
+// kept ("a||||b" has 3). items starts as caller-provided storage and moves to
+// the heap only when more fields turn up.
+typedef struct {
+    char* ptr;
+    size_t len;
+} StrView;
+
+typedef struct {
+    StrView* items;
+    int count;
+    int capacity;
+    int on_heap;
+} FieldList;
+
+#define FIELD_LIST_INLINE 16
+#define FIELD_LIST_INIT(storage) \
+    { (storage), 0, (int)(sizeof(storage) / sizeof((storage)[0])), 0 }
+
+// Split str in place on delimiter (any length). max_fields > 0 stops
+// splitting there, leaving the rest in the last field. Returns the field
+// count, or -1 on bad arguments / allocation failure.
+int split_fields(char* str, const char* delimiter, int max_fields, FieldList* out);
+void free_field_list(FieldList* fields);
+
+// First occurrence of delim in str[0..len), NULL if none (SSE2/AVX2 scan)
+const char* find_delimiter(const char* str, size_t len, const char* delim, size_t delim_len);
 
 // Base64 encode/decode
 char* base64_encode(const unsigned char* input, int length);
 unsigned char* base64_decode(const char* input, int* output_length);
 
-// Generate random string
-void generate_random_string(char* dest, int length);
+// Generate random string (dest holds length + 1). Returns 0, -1 on failure
+int generate_random_string(char* dest, int length);
 
 #endif
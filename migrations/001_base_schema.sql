@@ -0,0 +1,38 @@
+-- Base tables. IF NOT EXISTS so installs that predate the migrations
+-- directory keep their tables and just get this version recorded.
+
+CREATE TABLE IF NOT EXISTS users (
+    user_id INT NOT NULL AUTO_INCREMENT PRIMARY KEY,
+    username VARCHAR(50) NOT NULL,
+    password_hash VARCHAR(64) NOT NULL,
+    role ENUM('student', 'teacher') NOT NULL,
+    created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    UNIQUE KEY uq_users_username (username)
+);
+
+-- slot_type: 0 individual, 1 group, 2 both
+CREATE TABLE IF NOT EXISTS slots (
+    slot_id INT NOT NULL AUTO_INCREMENT PRIMARY KEY,
+    teacher_id INT NOT NULL,
+    start_time DATETIME NOT NULL,
+    end_time DATETIME NOT NULL,
+    slot_type TINYINT NOT NULL DEFAULT 0,
+    is_booked TINYINT NOT NULL DEFAULT 0
+);
+
+-- student_id is the booker (group leader for group meetings)
+CREATE TABLE IF NOT EXISTS meetings (
+    meeting_id INT NOT NULL AUTO_INCREMENT PRIMARY KEY,
+    slot_id INT NOT NULL,
+    student_id INT NOT NULL,
+    is_group TINYINT NOT NULL DEFAULT 0,
+    status ENUM('pending', 'cancelled') NOT NULL DEFAULT 'pending',
+    created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE TABLE IF NOT EXISTS group_members (
+    id INT NOT NULL AUTO_INCREMENT PRIMARY KEY,
+    meeting_id INT NOT NULL,
+    student_id INT NOT NULL,
+    UNIQUE KEY uq_group_members (meeting_id, student_id)
+);
@@ -0,0 +1,6 @@
+-- Change counters for conditional list requests (VERSION= tags).
+-- user_id 0 counts every slot change (unfiltered free slot list).
+CREATE TABLE IF NOT EXISTS change_versions (
+    user_id INT NOT NULL PRIMARY KEY,
+    version BIGINT NOT NULL DEFAULT 0
+);
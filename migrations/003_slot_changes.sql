@@ -0,0 +1,13 @@
+-- Slot change log for SYNC_MY_SLOTS: one row per insert/update/delete or
+-- booking-state change. Existing slots are backfilled so that a sync from
+-- version 0 returns the whole list.
+CREATE TABLE IF NOT EXISTS slot_changes (
+    change_id BIGINT NOT NULL AUTO_INCREMENT PRIMARY KEY,
+    teacher_id INT NOT NULL,
+    slot_id INT NOT NULL,
+    INDEX idx_slot_changes_teacher (teacher_id, change_id)
+);
+
+INSERT INTO slot_changes (teacher_id, slot_id)
+SELECT s.teacher_id, s.slot_id FROM slots s
+WHERE NOT EXISTS (SELECT 1 FROM slot_changes c WHERE c.slot_id = s.slot_id);
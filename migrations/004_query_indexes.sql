@@ -0,0 +1,20 @@
+-- Indexes for the handler queries (bin/migrate check EXPLAINs them all).
+-- An index that already exists is skipped by bin/migrate.
+
+-- Overlap check, LIST_MY_SLOTS, appointments, free slots of one teacher
+CREATE INDEX idx_slots_teacher_start ON slots (teacher_id, start_time);
+
+-- LIST_FREE_SLOTS: free slots in start order
+CREATE INDEX idx_slots_booked_start ON slots (is_booked, start_time);
+
+-- LIST_MEETINGS, history
+CREATE INDEX idx_meetings_student_status ON meetings (student_id, status);
+
+-- Slot -> meeting joins, participant lookups on slot changes
+CREATE INDEX idx_meetings_slot ON meetings (slot_id);
+
+-- Group meetings of a student
+CREATE INDEX idx_group_members_student ON group_members (student_id);
+
+-- Student picker (LIST_ALL_STUDENTS)
+CREATE INDEX idx_users_role_name ON users (role, username);
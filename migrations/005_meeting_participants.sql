@@ -0,0 +1,18 @@
+-- One row per student taking part in a meeting: the booker as 'organizer',
+-- group members as 'member'. Meeting lists and history read this table
+-- with one join instead of UNIONing meetings and group_members.
+CREATE TABLE IF NOT EXISTS meeting_participants (
+    meeting_id INT NOT NULL,
+    student_id INT NOT NULL,
+    role ENUM('organizer', 'member') NOT NULL,
+    PRIMARY KEY (meeting_id, student_id),
+    INDEX idx_participants_student (student_id, meeting_id)
+);
+
+-- Existing meetings. group_members is no longer written; it stays for now
+-- so this migration can be rolled back by hand.
+INSERT IGNORE INTO meeting_participants (meeting_id, student_id, role)
+SELECT meeting_id, student_id, 'organizer' FROM meetings;
+
+INSERT IGNORE INTO meeting_participants (meeting_id, student_id, role)
+SELECT meeting_id, student_id, 'member' FROM group_members;
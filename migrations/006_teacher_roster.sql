@@ -0,0 +1,18 @@
+-- Students each teacher has met, kept up to date by booking and cancelling.
+-- meeting_count is the number of pending meetings; a row stays at 0 once
+-- they are all cancelled, so LIST_STUDENTS still lists the student as
+-- before. LIST_STUDENTS reads it by primary key instead of joining slots,
+-- meetings and participants over the teacher's whole history.
+CREATE TABLE IF NOT EXISTS teacher_roster (
+    teacher_id INT NOT NULL,
+    student_id INT NOT NULL,
+    meeting_count INT NOT NULL DEFAULT 0,
+    PRIMARY KEY (teacher_id, student_id)
+);
+
+INSERT IGNORE INTO teacher_roster (teacher_id, student_id, meeting_count)
+SELECT s.teacher_id, p.student_id, SUM(m.status = 'pending')
+FROM slots s
+JOIN meetings m ON m.slot_id = s.slot_id
+JOIN meeting_participants p ON p.meeting_id = m.meeting_id
+GROUP BY s.teacher_id, p.student_id;
@@ -0,0 +1,5 @@
+-- Row version of each slot, bumped by every write to the row: UPDATE_SLOT,
+-- booking and cancelling. List responses carry it, and UPDATE_SLOT,
+-- DELETE_SLOT and the bookings take it back so their single conditional
+-- UPDATE or DELETE fails cleanly when the slot changed in between.
+ALTER TABLE slots ADD COLUMN version INT NOT NULL DEFAULT 1;
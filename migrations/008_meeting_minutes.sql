@@ -0,0 +1,10 @@
+-- Metadata of each meeting's minutes file (minutes/meeting_<id>.txt):
+-- byte size, SHA-256 of the content and last write time. ADD_MINUTES keeps
+-- it current and VIEW_HISTORY joins it instead of opening a file per row.
+-- Files written before this table are recorded by the server at startup.
+CREATE TABLE IF NOT EXISTS meeting_minutes (
+    meeting_id INT NOT NULL PRIMARY KEY,
+    size INT NOT NULL,
+    content_hash CHAR(64) NOT NULL,
+    updated_at DATETIME NOT NULL
+);
@@ -0,0 +1,13 @@
+-- Keeps the slot change log bounded. Each slot keeps only its latest entry,
+-- and the server prunes deletion entries older than 30 days at startup. The
+-- highest change_id it pruned per teacher is recorded here: a sync from
+-- below it gets the full list again.
+ALTER TABLE slot_changes
+    ADD COLUMN changed_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP;
+
+CREATE INDEX idx_slot_changes_slot ON slot_changes (slot_id);
+
+CREATE TABLE IF NOT EXISTS slot_change_floors (
+    teacher_id INT NOT NULL PRIMARY KEY,
+    change_id BIGINT NOT NULL
+);
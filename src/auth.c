@@ -1,4 +1,5 @@
 #include "auth.h"
+#include "token_cache.h"
 #include "utils.h"
 #include <openssl/sha.h>
 #include <string.h>
@@ -21,7 +22,8 @@ char* hash_user_password(const char* password) {
 // ============= GENERATE TOKEN =============
 char* generate_token(int user_id, const char* username, const char* role) {
     char random_str[17];
-    generate_random_string(random_str, 16);
+    if (generate_random_string(random_str, 16) < 0)
+        return NULL;
     
     time_t now = time(NULL);
     
@@ -35,35 +37,26 @@ char* generate_token(int user_id, const char* username, const char* role) {
 }
 
 // ============= VALIDATE TOKEN =============
-TokenData* validate_token(const char* token) {
-    if (!token || strlen(token) == 0) {
-        return NULL;
-    }
-    
+// Decode token vào data. Returns 0, -1 nếu token sai format
+static int decode_token(const char* token, TokenData* data) {
     int decoded_len = 0;
     unsigned char* decoded = base64_decode(token, &decoded_len);
     
     if (!decoded || decoded_len <= 0) {
         if (decoded) free(decoded);
-        return NULL;
+        return -1;
     }
     
     char* decoded_str = malloc(decoded_len + 1);
     if (!decoded_str) {
         free(decoded);
-        return NULL;
+        return -1;
     }
     
     memcpy(decoded_str, decoded, decoded_len);
     decoded_str[decoded_len] = '\0';
     free(decoded);
     
-    TokenData* data = malloc(sizeof(TokenData));
-    if (!data) {
-        free(decoded_str);
-        return NULL;
-    }
-    
     char username[100], role[20];
     long timestamp;
     
@@ -73,20 +66,39 @@ TokenData* validate_token(const char* token) {
     free(decoded_str);
     
     if (parsed < 4) {
-        free(data);
+        return -1;
+    }
+    
+    strcpy(data->username, username);
+    strcpy(data->role, role);
+    data->created_at = timestamp;
+    
+    return 0;
+}
+
+TokenData* validate_token(const char* token) {
+    if (!token || strlen(token) == 0) {
         return NULL;
     }
     
+    // Token đã validate gần đây (token_cache.h): không decode lại
+    TokenData found;
+    if (!token_cache_get(token, &found)) {
+        if (decode_token(token, &found) < 0) {
+            return NULL;
+        }
+        token_cache_put(token, &found);
+    }
+    
     time_t now = time(NULL);
-    if (now - timestamp > 86400) {
-        free(data);
+    if (now - found.created_at > TOKEN_LIFETIME_SEC) {
         return NULL;
     }
     
-    strcpy(data->username, username);
-    strcpy(data->role, role);
-    data->created_at = timestamp;
-    
+    TokenData* data = malloc(sizeof(TokenData));
+    if (data) {
+        *data = found;
+    }
     return data;
 }
 
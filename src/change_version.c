@@ -0,0 +1,109 @@
+#include "change_version.h"
+#include "db_stmt.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ============= BUMP =============
+int bump_change_versions(DbConn *conn, const int *user_ids, int count) {
+  int rc = 0;
+
+  // Up to three counters per statement: a booking touches exactly three
+  while (count > 0) {
+    long long affected;
+
+    if (count >= 3) {
+      affected = db_stmt_execute(conn, STMT_VERSION_BUMP_3, "iii", user_ids[0],
+                                 user_ids[1], user_ids[2]);
+      user_ids += 3;
+      count -= 3;
+    } else if (count == 2) {
+      affected = db_stmt_execute(conn, STMT_VERSION_BUMP_2, "ii", user_ids[0],
+                                 user_ids[1]);
+      user_ids += 2;
+      count -= 2;
+    } else {
+      affected = db_stmt_execute(conn, STMT_VERSION_BUMP, "i", user_ids[0]);
+      user_ids++;
+      count--;
+    }
+
+    if (affected < 0)
+      rc = -1;
+  }
+
+  return rc;
+}
+
+int bump_slot_participant_versions(DbConn *conn, int slot_id) {
+  long long affected =
+      db_stmt_execute(conn, STMT_VERSION_BUMP_PARTICIPANTS, "i", slot_id);
+  return affected < 0 ? -1 : 0;
+}
+
+// ============= SLOT CHANGE LOG =============
+int log_slot_change(DbConn *conn, int teacher_id, int slot_id) {
+  // The new entry supersedes the slot's previous one
+  if (db_stmt_execute(conn, STMT_SLOT_CHANGE_CLEAR, "i", slot_id) < 0)
+    return -1;
+
+  long long affected =
+      db_stmt_execute(conn, STMT_SLOT_CHANGE_LOG, "ii", teacher_id, slot_id);
+  return affected < 0 ? -1 : 0;
+}
+
+int log_slot_changes(DbConn *conn, int teacher_id, const int *slot_ids,
+                     int count) {
+  long long affected = db_stmt_execute_ids(conn, STMT_SLOT_CHANGE_LOG_8,
+                                           &teacher_id, slot_ids, count);
+  return affected < 0 ? -1 : 0;
+}
+
+int prune_slot_changes(DbConn *conn, int keep_days) {
+  if (db_begin(conn) < 0)
+    return -1;
+
+  // Entries superseded before log_slot_change() cleared them, then deletions
+  // older than keep_days, below each teacher's new floor. Live slots below
+  // the floor are logged again, so a sync that pages from below it only ever
+  // happens from before the prune.
+  if (db_stmt_execute(conn, STMT_SLOT_CHANGES_PRUNE_SUPERSEDED, "") < 0 ||
+      db_stmt_execute(conn, STMT_SLOT_CHANGES_RAISE_FLOORS, "i", keep_days) <
+          0 ||
+      db_stmt_execute(conn, STMT_SLOT_CHANGES_RELOG_BELOW_FLOOR, "") < 0 ||
+      db_stmt_execute(conn, STMT_SLOT_CHANGES_DROP_BELOW_FLOOR, "") < 0) {
+    db_rollback(conn);
+    return -1;
+  }
+
+  return db_commit(conn) < 0 ? -1 : 0;
+}
+
+// ============= CURRENT TAG =============
+int current_version_tag(DbConn *conn, int owner_id, const char *window,
+                        char *tag, size_t tag_size) {
+  DbStmt *result = db_stmt_query(conn, STMT_VERSION_GET, "i", owner_id);
+  if (!result)
+    return -1;
+
+  long long version = 0;
+  DbRow row = db_stmt_fetch(result);
+  if (row && row[0])
+    version = atoll(row[0]);
+  db_stmt_done(result);
+
+  // "Today" and "this week" views move on with the calendar
+  if (window) {
+    char day[16];
+    int year = 0, month = 0, mday = 0;
+    sscanf(window, "%4d-%2d-%2d", &year, &month, &mday);
+    snprintf(day, sizeof(day), "%04d%02d%02d", year, month, mday);
+    snprintf(tag, tag_size, "%lld-%s", version, day);
+  } else {
+    snprintf(tag, tag_size, "%lld", version);
+  }
+
+  return 0;
+}
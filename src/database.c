@@ -1,10 +1,15 @@
 #include "database.h"
 #include "utils.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // ============= CONNECT =============
 MYSQL* db_connect() {
+    return db_connect_to(DB_HOST, DB_PORT);
+}
+
+MYSQL* db_connect_to(const char* host, unsigned int port) {
     MYSQL* conn = mysql_init(NULL);
     
     if (!conn) {
@@ -12,8 +17,16 @@ MYSQL* db_connect() {
         return NULL;
     }
     
-    if (!mysql_real_connect(conn, DB_HOST, DB_USER, DB_PASS, DB_NAME, DB_PORT, NULL, 0)) {
-        log_message("ERROR", "MySQL connection failed: %s", mysql_error(conn));
+    char init_command[64];
+    snprintf(init_command, sizeof(init_command),
+             "SET SESSION innodb_lock_wait_timeout=%d", DB_LOCK_WAIT_TIMEOUT_SEC);
+    mysql_options(conn, MYSQL_INIT_COMMAND, init_command);
+    
+    unsigned int connect_timeout = DB_CONNECT_TIMEOUT_SEC;
+    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+    
+    if (!mysql_real_connect(conn, host, DB_USER, DB_PASS, DB_NAME, port, NULL, 0)) {
+        log_message("ERROR", "MySQL connection to %s:%u failed: %s", host, port, mysql_error(conn));
         mysql_close(conn);
         return NULL;
     }
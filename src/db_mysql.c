@@ -0,0 +1,295 @@
+#include "db_backend.h"
+#include "database.h"
+#include "utils.h"
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MySQL engine: a DbSession is the MYSQL handle itself
+const char *const db_backend_name = "mysql";
+
+static MYSQL *mysql_of(DbSession *session) { return (MYSQL *)session; }
+
+struct DbStmt {
+  MYSQL_STMT *stmt;
+  DbConn *conn;
+  StmtId id;
+  unsigned long param_count;
+  unsigned int column_count;
+
+  // Result columns are fetched as strings, like a MYSQL_ROW
+  MYSQL_BIND *results;
+  char **buffers;
+  unsigned long *capacity;
+  unsigned long *lengths;
+  bool *is_null;
+  bool *truncated;
+  char **row;
+};
+
+// ============= SESSIONS =============
+int db_backend_init(void) {
+  if (mysql_library_init(0, NULL, NULL)) {
+    log_message("ERROR", "mysql_library_init() failed");
+    return -1;
+  }
+  return 0;
+}
+
+void db_backend_thread_init(void) { mysql_thread_init(); }
+
+void db_backend_thread_end(void) { mysql_thread_end(); }
+
+DbSession *db_backend_connect(const char *host, unsigned int port) {
+  return (DbSession *)db_connect_to(host, port);
+}
+
+void db_backend_close(DbSession *session) { db_close(mysql_of(session)); }
+
+int db_backend_ping(DbSession *session) {
+  return mysql_ping(mysql_of(session)) ? -1 : 0;
+}
+
+const char *db_backend_error(DbSession *session) {
+  return mysql_error(mysql_of(session));
+}
+
+unsigned int db_backend_errno(DbSession *session) {
+  return mysql_errno(mysql_of(session));
+}
+
+int db_backend_lost(unsigned int err) {
+  return err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
+}
+
+int db_backend_conflict(unsigned int err) {
+  return err == ER_LOCK_WAIT_TIMEOUT || err == ER_LOCK_DEADLOCK;
+}
+
+int db_backend_begin(DbSession *session) {
+  return mysql_query(mysql_of(session), "START TRANSACTION") ? -1 : 0;
+}
+
+int db_backend_commit(DbSession *session) {
+  return mysql_commit(mysql_of(session)) ? -1 : 0;
+}
+
+int db_backend_rollback(DbSession *session) {
+  return mysql_rollback(mysql_of(session)) ? -1 : 0;
+}
+
+// ============= PREPARE =============
+void db_backend_free(DbStmt *s) {
+  if (!s)
+    return;
+
+  if (s->stmt)
+    mysql_stmt_close(s->stmt);
+
+  for (unsigned int i = 0; i < s->column_count; i++)
+    free(s->buffers[i]);
+
+  free(s->results);
+  free(s->buffers);
+  free(s->capacity);
+  free(s->lengths);
+  free(s->is_null);
+  free(s->truncated);
+  free(s->row);
+  free(s);
+}
+
+static int bind_results(DbStmt *s) {
+  unsigned int n = s->column_count;
+
+  s->results = calloc(n, sizeof(MYSQL_BIND));
+  s->buffers = calloc(n, sizeof(char *));
+  s->capacity = calloc(n, sizeof(unsigned long));
+  s->lengths = calloc(n, sizeof(unsigned long));
+  s->is_null = calloc(n, sizeof(bool));
+  s->truncated = calloc(n, sizeof(bool));
+  s->row = calloc(n, sizeof(char *));
+
+  if (!s->results || !s->buffers || !s->capacity || !s->lengths ||
+      !s->is_null || !s->truncated || !s->row)
+    return -1;
+
+  for (unsigned int i = 0; i < n; i++) {
+    // One spare byte for the terminator
+    s->buffers[i] = malloc(DB_STMT_COLUMN_SIZE + 1);
+    if (!s->buffers[i])
+      return -1;
+    s->capacity[i] = DB_STMT_COLUMN_SIZE;
+
+    s->results[i].buffer_type = MYSQL_TYPE_STRING;
+    s->results[i].buffer = s->buffers[i];
+    s->results[i].buffer_length = s->capacity[i];
+    s->results[i].length = &s->lengths[i];
+    s->results[i].is_null = &s->is_null[i];
+    s->results[i].error = &s->truncated[i];
+  }
+
+  return mysql_stmt_bind_result(s->stmt, s->results) ? -1 : 0;
+}
+
+DbStmt *db_backend_prepare(DbConn *conn, StmtId id, const char *sql) {
+  DbStmt *s = calloc(1, sizeof(DbStmt));
+  if (!s)
+    return NULL;
+
+  s->id = id;
+  s->conn = conn;
+  s->stmt = mysql_stmt_init(mysql_of(conn->session));
+  if (!s->stmt) {
+    log_message("ERROR", "mysql_stmt_init() failed");
+    free(s);
+    return NULL;
+  }
+
+  if (mysql_stmt_prepare(s->stmt, sql, strlen(sql))) {
+    log_message("ERROR", "Prepare failed (stmt %d): %s", id,
+                mysql_stmt_error(s->stmt));
+    conn->stmts.last_errno = mysql_stmt_errno(s->stmt);
+    db_backend_free(s);
+    return NULL;
+  }
+
+  s->param_count = mysql_stmt_param_count(s->stmt);
+  s->column_count = mysql_stmt_field_count(s->stmt);
+
+  if (s->column_count > 0 && bind_results(s) < 0) {
+    log_message("ERROR", "Binding results failed (stmt %d)", id);
+    db_backend_free(s);
+    return NULL;
+  }
+
+  return s;
+}
+
+// ============= EXECUTE =============
+static void fail(DbStmt *s, const char *what) {
+  log_message("ERROR", "%s (stmt %d): %s", what, s->id,
+              mysql_stmt_error(s->stmt));
+  s->conn->stmts.last_errno = mysql_stmt_errno(s->stmt);
+}
+
+int db_backend_execute(DbStmt *s, const DbParam *params, size_t count,
+                       DbRunMode mode) {
+  if (count != s->param_count) {
+    log_message("ERROR", "Stmt %d takes %lu parameters, got %zu", s->id,
+                s->param_count, count);
+    return -1;
+  }
+
+  MYSQL_BIND binds[DB_STMT_MAX_BINDS];
+  unsigned long lengths[DB_STMT_MAX_BINDS];
+  memset(binds, 0, count * sizeof(MYSQL_BIND));
+
+  for (size_t i = 0; i < count; i++) {
+    switch (params[i].type) {
+    case 'i':
+      binds[i].buffer_type = MYSQL_TYPE_LONG;
+      binds[i].buffer = (void *)&params[i].value.i;
+      break;
+    case 'l':
+      binds[i].buffer_type = MYSQL_TYPE_LONGLONG;
+      binds[i].buffer = (void *)&params[i].value.l;
+      break;
+    default:
+      lengths[i] = strlen(params[i].value.s);
+      binds[i].buffer_type = MYSQL_TYPE_STRING;
+      binds[i].buffer = (char *)params[i].value.s;
+      binds[i].buffer_length = lengths[i];
+      binds[i].length = &lengths[i];
+      break;
+    }
+  }
+
+  if ((count > 0 && mysql_stmt_bind_param(s->stmt, binds)) ||
+      mysql_stmt_execute(s->stmt)) {
+    fail(s, "Statement failed");
+    return -1;
+  }
+
+  // Buffer the rows so other statements can run while this one is read
+  if (mode == DB_RUN_BUFFERED && mysql_stmt_store_result(s->stmt)) {
+    fail(s, "Storing result failed");
+    mysql_stmt_free_result(s->stmt);
+    return -1;
+  }
+
+  return 0;
+}
+
+long long db_backend_affected_rows(DbStmt *s) {
+  return (long long)mysql_stmt_affected_rows(s->stmt);
+}
+
+unsigned long long db_backend_num_rows(DbStmt *s) {
+  return mysql_stmt_num_rows(s->stmt);
+}
+
+unsigned int db_backend_columns(DbStmt *s) { return s->column_count; }
+
+unsigned long long db_backend_insert_id(DbConn *conn) {
+  return mysql_insert_id(mysql_of(conn->session));
+}
+
+// ============= FETCH =============
+// Grow the buffers of columns that didn't fit and fetch them again
+static int refetch_truncated(DbStmt *s) {
+  for (unsigned int i = 0; i < s->column_count; i++) {
+    if (!s->truncated[i])
+      continue;
+
+    char *grown = realloc(s->buffers[i], s->lengths[i] + 1);
+    if (!grown)
+      return -1;
+
+    s->buffers[i] = grown;
+    s->capacity[i] = s->lengths[i];
+    s->results[i].buffer = grown;
+    s->results[i].buffer_length = s->capacity[i];
+
+    if (mysql_stmt_fetch_column(s->stmt, &s->results[i], i, 0))
+      return -1;
+  }
+
+  // Later rows land in the grown buffers too
+  return mysql_stmt_bind_result(s->stmt, s->results) ? -1 : 0;
+}
+
+// Without mysql_stmt_store_result() each fetch reads the next row off the
+// connection
+int db_backend_fetch(DbStmt *s, DbRow *row) {
+  if (s->column_count == 0)
+    return 1;
+
+  int rc = mysql_stmt_fetch(s->stmt);
+  if (rc == MYSQL_NO_DATA)
+    return 1;
+
+  if (rc == MYSQL_DATA_TRUNCATED && refetch_truncated(s) < 0)
+    rc = 1;
+
+  if (rc == 1) {
+    fail(s, "Fetch failed");
+    return -1;
+  }
+
+  for (unsigned int i = 0; i < s->column_count; i++) {
+    if (s->is_null[i]) {
+      s->row[i] = NULL;
+    } else {
+      s->buffers[i][s->lengths[i]] = '\0';
+      s->row[i] = s->buffers[i];
+    }
+  }
+
+  *row = s->row;
+  return 0;
+}
+
+void db_backend_free_result(DbStmt *s) { mysql_stmt_free_result(s->stmt); }
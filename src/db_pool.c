@@ -0,0 +1,597 @@
+#include "db_pool.h"
+#include "database.h"
+#include "db_backend.h"
+#include "utils.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum { SLOT_CLOSED, SLOT_IDLE, SLOT_LEASED } SlotState;
+
+// Sessions to one server: the primary or one read replica
+typedef struct DbPool {
+  char name[64]; // "host:port" for the logs
+  char host[64];
+  unsigned int port;
+
+  pthread_mutex_t lock;
+  pthread_cond_t available;
+
+  DbConn slots[DB_POOL_MAX];
+  SlotState slot_state[DB_POOL_MAX];
+
+  // Idle sessions, oldest first; leases take from the end
+  int idle[DB_POOL_MAX];
+  int idle_count;
+
+  int min;
+  int max;
+  DbPoolStats stats;
+
+  // Circuit breaker, closed while retry_at_us is 0
+  int connect_failures;           // in a row
+  unsigned long long retry_at_us; // open: leases are refused until then
+  int probing;                    // a lease is trying the server again
+  time_t lost_at; // a session died then; idle ones older get pinged
+} DbPool;
+
+static DbPool primary;
+static DbPool replicas[DB_MAX_REPLICAS];
+static int replica_count = 0;
+static unsigned int next_replica = 0;
+
+// Last write per user, hashed into a fixed table. A collision only sends
+// another user's reads to the primary a little longer, never to a stale
+// replica.
+#define STICKY_SLOTS 4096
+static time_t last_write[STICKY_SLOTS];
+
+static unsigned long long now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Delay before retry `step` (from 0): doubles from DB_BACKOFF_BASE_MS up to
+// DB_BACKOFF_MAX_MS, then a random point in its upper half
+static unsigned long long backoff_ms(int step) {
+  unsigned long long delay = DB_BACKOFF_MAX_MS;
+  if (step < 16 && (unsigned long long)DB_BACKOFF_BASE_MS << step < delay)
+    delay = (unsigned long long)DB_BACKOFF_BASE_MS << step;
+
+  return delay / 2 + (unsigned long long)random() % (delay / 2 + 1);
+}
+
+// ============= CIRCUIT BREAKER =============
+// Caller holds pool->lock. Returns the backoff in ms if this failure opened
+// the breaker or pushed its retry further out, 0 otherwise.
+static unsigned long long breaker_failure(DbPool *pool) {
+  pool->probing = 0;
+  if (++pool->connect_failures < DB_BREAKER_FAILURES)
+    return 0;
+
+  // Idle sessions are likely dead too
+  pool->lost_at = time(NULL);
+
+  unsigned long long delay =
+      backoff_ms(pool->connect_failures - DB_BREAKER_FAILURES);
+  pool->retry_at_us = now_us() + delay * 1000;
+  return delay;
+}
+
+// Caller holds pool->lock. Returns 1 if the breaker was open.
+static int breaker_success(DbPool *pool) {
+  int was_open = pool->retry_at_us != 0;
+  pool->connect_failures = 0;
+  pool->retry_at_us = 0;
+  pool->probing = 0;
+  return was_open;
+}
+
+// Caller holds pool->lock. Whether a lease may go ahead; while the breaker is
+// open, only one lease after the backoff, which becomes the probe.
+static int breaker_allows(DbPool *pool, int *probe) {
+  *probe = 0;
+  if (pool->retry_at_us == 0)
+    return 1;
+
+  if (pool->probing || now_us() < pool->retry_at_us) {
+    pool->stats.refused++;
+    return 0;
+  }
+
+  pool->probing = 1;
+  *probe = 1;
+  return 1;
+}
+
+// Record whether talking to the server worked
+static void breaker_record(DbPool *pool, int ok) {
+  pthread_mutex_lock(&pool->lock);
+  unsigned long long delay = 0;
+  int closed = 0;
+  int failures = pool->connect_failures + 1;
+  if (ok)
+    closed = breaker_success(pool);
+  else
+    delay = breaker_failure(pool);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (closed)
+    log_message("INFO", "DB pool %s: server is back, breaker closed",
+                pool->name);
+  if (delay)
+    log_message("WARN",
+                "DB pool %s: %d failed connects, breaker open, retry in "
+                "%llu ms",
+                pool->name, failures, delay);
+}
+
+// Caller holds pool->lock
+static int find_closed_slot(DbPool *pool) {
+  for (int i = 0; i < pool->max; i++) {
+    if (pool->slot_state[i] == SLOT_CLOSED)
+      return i;
+  }
+  return -1;
+}
+
+// Caller holds pool->lock
+static void push_idle(DbPool *pool, int slot) {
+  pool->slot_state[slot] = SLOT_IDLE;
+  pool->idle[pool->idle_count++] = slot;
+}
+
+// A leased slot whose session could not be (re)opened
+static void drop_leased_slot(DbConn *conn) {
+  DbPool *pool = conn->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  conn->session = NULL;
+  pool->slot_state[conn->slot] = SLOT_CLOSED;
+  pool->stats.open--;
+  pool->stats.in_use--;
+  pthread_cond_signal(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// ============= INIT / DESTROY =============
+// Returns the number of sessions opened
+static int pool_init(DbPool *pool, const char *host, unsigned int port,
+                     int min_size, int max_size) {
+  snprintf(pool->host, sizeof(pool->host), "%s", host);
+  snprintf(pool->name, sizeof(pool->name), "%s:%u", host, port);
+  pool->port = port;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->available, NULL);
+
+  pthread_mutex_lock(&pool->lock);
+
+  pool->min = min_size;
+  pool->max = max_size;
+  pool->idle_count = 0;
+  pool->connect_failures = 0;
+  pool->retry_at_us = 0;
+  pool->probing = 0;
+  pool->lost_at = 0;
+  memset(&pool->stats, 0, sizeof(pool->stats));
+
+  for (int i = 0; i < DB_POOL_MAX; i++) {
+    memset(&pool->slots[i], 0, sizeof(pool->slots[i]));
+    pool->slots[i].slot = i;
+    pool->slots[i].pool = pool;
+    pool->slot_state[i] = SLOT_CLOSED;
+  }
+
+  for (int i = 0; i < min_size; i++) {
+    DbSession *session = db_backend_connect(host, port);
+    if (!session)
+      break;
+
+    pool->slots[i].session = session;
+    pool->slots[i].last_used = time(NULL);
+    push_idle(pool, i);
+    pool->stats.open++;
+  }
+
+  int opened = pool->stats.open;
+  pthread_mutex_unlock(&pool->lock);
+
+  return opened;
+}
+
+// "host:port,host:port" from DB_REPLICAS
+static void init_replicas(int min_size, int max_size) {
+  char list[] = DB_REPLICAS;
+  StrView entry_buf[FIELD_LIST_INLINE];
+  FieldList entries = FIELD_LIST_INIT(entry_buf);
+
+  split_fields(list, ",", 0, &entries);
+
+  for (int i = 0; i < entries.count; i++) {
+    char *host = trim(entries.items[i].ptr);
+    if (*host == '\0')
+      continue;
+
+    if (replica_count == DB_MAX_REPLICAS) {
+      log_message("WARN", "DB pool: more than %d replicas, ignoring %s",
+                  DB_MAX_REPLICAS, host);
+      continue;
+    }
+
+    unsigned int port = DB_PORT;
+    char *colon = strrchr(host, ':');
+    if (colon) {
+      *colon = '\0';
+      port = (unsigned int)atoi(colon + 1);
+    }
+
+    DbPool *pool = &replicas[replica_count++];
+    int opened = pool_init(pool, host, port, min_size, max_size);
+    if (opened == 0) {
+      // Not fatal: reads use the primary until the replica answers again
+      log_message("WARN", "DB pool: replica %s unreachable", pool->name);
+      // Open its breaker now instead of after a few slow failed leases
+      pthread_mutex_lock(&pool->lock);
+      pool->connect_failures = DB_BREAKER_FAILURES - 1;
+      pthread_mutex_unlock(&pool->lock);
+      breaker_record(pool, 0);
+    } else {
+      log_message("INFO", "DB pool: replica %s ready (%d sessions)",
+                  pool->name, opened);
+    }
+  }
+
+  free_field_list(&entries);
+}
+
+int db_pool_init(int min_size, int max_size) {
+  if (max_size > DB_POOL_MAX)
+    max_size = DB_POOL_MAX;
+  if (min_size > max_size)
+    min_size = max_size;
+
+  if (db_backend_init() < 0)
+    return -1;
+
+  int opened = pool_init(&primary, DB_HOST, DB_PORT, min_size, max_size);
+  if (opened == 0) {
+    log_message("ERROR", "DB pool: no session could be opened");
+    return -1;
+  }
+
+  log_message("INFO", "DB pool ready (%s): %d/%d sessions open (max %d)",
+              db_backend_name, opened, min_size, max_size);
+
+  init_replicas(min_size, max_size);
+  return 0;
+}
+
+static void pool_destroy(DbPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+
+  while (pool->idle_count > 0) {
+    int slot = pool->idle[--pool->idle_count];
+    db_stmt_cache_clear(&pool->slots[slot].stmts);
+    db_backend_close(pool->slots[slot].session);
+    pool->slots[slot].session = NULL;
+    pool->slot_state[slot] = SLOT_CLOSED;
+    pool->stats.open--;
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void db_pool_destroy(void) {
+  pool_destroy(&primary);
+  for (int i = 0; i < replica_count; i++)
+    pool_destroy(&replicas[i]);
+}
+
+// ============= LEASE =============
+// wait = 0 returns NULL at once when every session is leased and the pool is
+// full, instead of waiting up to DB_POOL_LEASE_TIMEOUT_MS
+static DbConn *pool_lease(DbPool *pool, int wait, unsigned long long *wait_us) {
+  unsigned long long start = now_us();
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += DB_POOL_LEASE_TIMEOUT_MS / 1000;
+  deadline.tv_nsec += (DB_POOL_LEASE_TIMEOUT_MS % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  int slot = -1;
+  int need_connect = 0;
+  int waited = 0;
+  int probe;
+
+  pthread_mutex_lock(&pool->lock);
+
+  if (!breaker_allows(pool, &probe)) {
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+  }
+
+  while (1) {
+    if (pool->idle_count > 0) {
+      slot = pool->idle[--pool->idle_count];
+      break;
+    }
+
+    if (pool->stats.open < pool->max) {
+      slot = find_closed_slot(pool);
+      if (slot >= 0) {
+        pool->stats.open++;
+        need_connect = 1;
+        break;
+      }
+    }
+
+    if (!wait) {
+      if (probe)
+        pool->probing = 0;
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+
+    waited = 1;
+    int rc = pthread_cond_timedwait(&pool->available, &pool->lock, &deadline);
+    if (rc == ETIMEDOUT && pool->idle_count == 0) {
+      pool->stats.timeouts++;
+      if (probe)
+        pool->probing = 0;
+      int in_use = pool->stats.in_use;
+      pthread_mutex_unlock(&pool->lock);
+      log_message("WARN",
+                  "DB pool %s: lease timed out after %d ms (%d in use)",
+                  pool->name, DB_POOL_LEASE_TIMEOUT_MS, in_use);
+      return NULL;
+    }
+  }
+
+  // Sessions idle a while, or older than a session found dead, may be gone
+  DbConn *conn = &pool->slots[slot];
+  int validate = !need_connect &&
+                 (probe || conn->last_used <= pool->lost_at ||
+                  time(NULL) - conn->last_used > DB_POOL_VALIDATE_IDLE_SEC);
+
+  pool->slot_state[slot] = SLOT_LEASED;
+  pool->stats.in_use++;
+  pthread_mutex_unlock(&pool->lock);
+
+  int reconnected = 0;
+
+  if (need_connect) {
+    conn->session = db_backend_connect(pool->host, pool->port);
+  } else if (validate && db_backend_ping(conn->session) != 0) {
+    log_message("WARN", "DB pool %s: idle session lost (%s), reconnecting",
+                pool->name, db_backend_error(conn->session));
+    db_stmt_cache_clear(&conn->stmts);
+    db_backend_close(conn->session);
+    conn->session = db_backend_connect(pool->host, pool->port);
+    reconnected = 1;
+  }
+
+  if (need_connect || validate)
+    breaker_record(pool, conn->session != NULL);
+
+  if (!conn->session) {
+    drop_leased_slot(conn);
+    return NULL;
+  }
+
+  conn->stmts.last_errno = 0;
+  conn->in_transaction = 0;
+  conn->caller = NULL;
+
+  unsigned long long waited_us = now_us() - start;
+  if (wait_us)
+    *wait_us = waited_us;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stats.leases++;
+  pool->stats.total_wait_us += waited_us;
+  if (waited_us > pool->stats.max_wait_us)
+    pool->stats.max_wait_us = waited_us;
+  if (waited)
+    pool->stats.waited++;
+  if (reconnected)
+    pool->stats.reconnects++;
+  DbPoolStats snapshot = pool->stats;
+  pthread_mutex_unlock(&pool->lock);
+
+  if (waited_us > DB_POOL_SLOW_WAIT_MS * 1000ULL)
+    log_message("WARN", "DB pool %s: lease waited %llu ms", pool->name,
+                waited_us / 1000);
+
+  if (snapshot.leases % DB_POOL_STATS_EVERY == 0) {
+    log_message("INFO",
+                "DB pool %s: open=%d in_use=%d leases=%llu waited=%llu "
+                "timeouts=%llu reconnects=%llu refused=%llu avg_wait=%lluus "
+                "max_wait=%lluus",
+                pool->name, snapshot.open, snapshot.in_use, snapshot.leases,
+                snapshot.waited, snapshot.timeouts, snapshot.reconnects,
+                snapshot.refused, snapshot.total_wait_us / snapshot.leases,
+                snapshot.max_wait_us);
+  }
+
+  return conn;
+}
+
+DbConn *db_pool_lease(unsigned long long *wait_us) {
+  return pool_lease(&primary, 1, wait_us);
+}
+
+// ============= READ ROUTING =============
+static unsigned int sticky_slot(int user_id) {
+  return ((unsigned int)user_id * 2654435761u) % STICKY_SLOTS;
+}
+
+void db_pool_note_write(int user_id) {
+  if (replica_count == 0 || user_id <= 0)
+    return;
+
+  __atomic_store_n(&last_write[sticky_slot(user_id)], time(NULL),
+                   __ATOMIC_RELAXED);
+}
+
+static int wrote_recently(int user_id) {
+  if (user_id <= 0)
+    return 0;
+
+  time_t last =
+      __atomic_load_n(&last_write[sticky_slot(user_id)], __ATOMIC_RELAXED);
+  return last != 0 && time(NULL) - last <= DB_READ_STICKY_SEC;
+}
+
+int db_pool_has_replicas(void) { return replica_count > 0; }
+
+DbConn *db_pool_lease_read(int user_id, unsigned long long *wait_us) {
+  if (replica_count == 0 || wrote_recently(user_id))
+    return pool_lease(&primary, 1, wait_us);
+
+  // Round robin without waiting: a replica with every session leased, or
+  // whose breaker is open, is skipped. Only then wait, on the primary.
+  unsigned int first =
+      __atomic_fetch_add(&next_replica, 1, __ATOMIC_RELAXED) % replica_count;
+
+  for (int i = 0; i < replica_count; i++) {
+    DbConn *conn =
+        pool_lease(&replicas[(first + i) % replica_count], 0, wait_us);
+    if (conn)
+      return conn;
+  }
+
+  return pool_lease(&primary, 1, wait_us);
+}
+
+// ============= RETURN =============
+static unsigned int session_error(DbConn *conn) {
+  return conn->stmts.last_errno ? conn->stmts.last_errno
+                                : db_backend_errno(conn->session);
+}
+
+int db_pool_lost(DbConn *conn) {
+  return db_backend_lost(session_error(conn));
+}
+
+void db_pool_backoff(int attempt) {
+  unsigned long long ms = backoff_ms(attempt);
+  struct timespec delay = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+  nanosleep(&delay, NULL);
+}
+
+void db_pool_return(DbConn *conn) {
+  if (!conn)
+    return;
+
+  DbPool *pool = conn->pool;
+
+  if (conn->in_transaction) {
+    log_message("WARN", "DB pool: session returned mid-transaction");
+    db_rollback(conn);
+  }
+
+  unsigned int err = session_error(conn);
+  int broken = db_backend_lost(err);
+
+  // Statements die with their session
+  if (broken)
+    db_stmt_cache_clear(&conn->stmts);
+
+  DbSession *to_close[DB_POOL_MAX];
+  int close_count = 0;
+  time_t now = time(NULL);
+
+  pthread_mutex_lock(&pool->lock);
+
+  pool->stats.in_use--;
+  conn->last_used = now;
+
+  if (broken) {
+    // Other idle sessions may have died with it: ping them before reuse
+    pool->lost_at = now;
+    to_close[close_count++] = conn->session;
+    conn->session = NULL;
+    pool->slot_state[conn->slot] = SLOT_CLOSED;
+    pool->stats.open--;
+  } else {
+    push_idle(pool, conn->slot);
+  }
+
+  // Shrink back towards the minimum, oldest idle sessions first
+  while (pool->idle_count > 0 && pool->stats.open > pool->min &&
+         now - pool->slots[pool->idle[0]].last_used >
+             DB_POOL_IDLE_TIMEOUT_SEC) {
+    int slot = pool->idle[0];
+    memmove(pool->idle, pool->idle + 1,
+            (pool->idle_count - 1) * sizeof(pool->idle[0]));
+    pool->idle_count--;
+
+    db_stmt_cache_clear(&pool->slots[slot].stmts);
+    to_close[close_count++] = pool->slots[slot].session;
+    pool->slots[slot].session = NULL;
+    pool->slot_state[slot] = SLOT_CLOSED;
+    pool->stats.open--;
+  }
+
+  pthread_cond_signal(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (broken)
+    log_message("WARN", "DB pool %s: dropping session after error %u",
+                pool->name, err);
+
+  for (int i = 0; i < close_count; i++)
+    db_backend_close(to_close[i]);
+}
+
+// ============= STATS =============
+void db_pool_stats(DbPoolStats *out) {
+  pthread_mutex_lock(&primary.lock);
+  *out = primary.stats;
+  pthread_mutex_unlock(&primary.lock);
+}
+
+// ============= THREADS =============
+void db_thread_init(void) { db_backend_thread_init(); }
+
+void db_thread_end(void) { db_backend_thread_end(); }
+
+// ============= TRANSACTIONS =============
+int db_begin(DbConn *conn) {
+  if (db_backend_begin(conn->session) < 0) {
+    log_message("ERROR", "BEGIN failed: %s", db_backend_error(conn->session));
+    conn->stmts.last_errno = db_backend_errno(conn->session);
+    return -1;
+  }
+
+  conn->in_transaction = 1;
+  return 0;
+}
+
+int db_commit(DbConn *conn) {
+  conn->in_transaction = 0;
+
+  if (db_backend_commit(conn->session) < 0) {
+    log_message("ERROR", "COMMIT failed: %s", db_backend_error(conn->session));
+    return -1;
+  }
+
+  return 0;
+}
+
+void db_rollback(DbConn *conn) {
+  conn->in_transaction = 0;
+
+  if (db_backend_rollback(conn->session) < 0)
+    log_message("ERROR", "ROLLBACK failed: %s",
+                db_backend_error(conn->session));
+}
@@ -0,0 +1,566 @@
+#include "db_backend.h"
+#include "database.h"
+#include "utils.h"
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SQLite engine: every pooled session opens the same database file. WAL lets
+// readers run next to the one writer; writers queue on the file lock for up
+// to DB_LOCK_WAIT_TIMEOUT_SEC.
+const char *const db_backend_name = "sqlite";
+
+struct DbSession {
+  sqlite3 *db;
+  long long returned_id; // first RETURNING value of the last execute
+  int has_returned;
+};
+
+// Offset of an SQL NULL in a buffered result
+#define NO_VALUE ((size_t)-1)
+
+struct DbStmt {
+  sqlite3_stmt *stmt;
+  DbConn *conn;
+  StmtId id;
+  int param_count;
+  unsigned int column_count;
+  int streaming;
+  long long affected;
+
+  // Buffered result: column values back to back in data, located by offsets
+  // (row_count * column_count of them). Kept between runs for reuse.
+  char *data;
+  size_t data_len;
+  size_t data_capacity;
+  size_t *offsets;
+  size_t offsets_capacity;
+  unsigned long long row_count;
+  unsigned long long next_row;
+
+  char **row;
+};
+
+// Schema versions, applied in order and counted in PRAGMA user_version (the
+// SQLite side of migrations/). Append new versions; never edit old ones.
+// slot_changes ids must never be reused, hence AUTOINCREMENT.
+static const char *const schema_versions[] = {
+    // 1: tables and indexes of migrations/001 to 004. IF NOT EXISTS keeps
+    // files created before user_version was counted.
+    "CREATE TABLE IF NOT EXISTS users ("
+    "user_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+    "username TEXT NOT NULL UNIQUE, "
+    "password_hash TEXT NOT NULL, "
+    "role TEXT NOT NULL CHECK (role IN ('student', 'teacher')), "
+    "created_at TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP);"
+
+    "CREATE TABLE IF NOT EXISTS slots ("
+    "slot_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+    "teacher_id INTEGER NOT NULL, "
+    "start_time TEXT NOT NULL, "
+    "end_time TEXT NOT NULL, "
+    "slot_type INTEGER NOT NULL DEFAULT 0, "
+    "is_booked INTEGER NOT NULL DEFAULT 0);"
+
+    "CREATE TABLE IF NOT EXISTS meetings ("
+    "meeting_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+    "slot_id INTEGER NOT NULL, "
+    "student_id INTEGER NOT NULL, "
+    "is_group INTEGER NOT NULL DEFAULT 0, "
+    "status TEXT NOT NULL DEFAULT 'pending' "
+    "CHECK (status IN ('pending', 'cancelled')), "
+    "created_at TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP);"
+
+    "CREATE TABLE IF NOT EXISTS group_members ("
+    "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+    "meeting_id INTEGER NOT NULL, "
+    "student_id INTEGER NOT NULL, "
+    "UNIQUE (meeting_id, student_id));"
+
+    "CREATE TABLE IF NOT EXISTS change_versions ("
+    "user_id INTEGER PRIMARY KEY, "
+    "version INTEGER NOT NULL DEFAULT 0);"
+
+    "CREATE TABLE IF NOT EXISTS slot_changes ("
+    "change_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+    "teacher_id INTEGER NOT NULL, "
+    "slot_id INTEGER NOT NULL);"
+
+    "CREATE INDEX IF NOT EXISTS idx_slot_changes_teacher "
+    "ON slot_changes (teacher_id, change_id);"
+    "CREATE INDEX IF NOT EXISTS idx_slots_teacher_start "
+    "ON slots (teacher_id, start_time);"
+    "CREATE INDEX IF NOT EXISTS idx_slots_booked_start "
+    "ON slots (is_booked, start_time);"
+    "CREATE INDEX IF NOT EXISTS idx_meetings_student_status "
+    "ON meetings (student_id, status);"
+    "CREATE INDEX IF NOT EXISTS idx_meetings_slot ON meetings (slot_id);"
+    "CREATE INDEX IF NOT EXISTS idx_group_members_student "
+    "ON group_members (student_id);"
+    "CREATE INDEX IF NOT EXISTS idx_users_role_name "
+    "ON users (role, username);",
+
+    // 2: migrations/005_meeting_participants.sql
+    "CREATE TABLE meeting_participants ("
+    "meeting_id INTEGER NOT NULL, "
+    "student_id INTEGER NOT NULL, "
+    "role TEXT NOT NULL CHECK (role IN ('organizer', 'member')), "
+    "PRIMARY KEY (meeting_id, student_id));"
+    "CREATE INDEX idx_participants_student "
+    "ON meeting_participants (student_id, meeting_id);"
+    "INSERT OR IGNORE INTO meeting_participants (meeting_id, student_id, role) "
+    "SELECT meeting_id, student_id, 'organizer' FROM meetings;"
+    "INSERT OR IGNORE INTO meeting_participants (meeting_id, student_id, role) "
+    "SELECT meeting_id, student_id, 'member' FROM group_members;",
+
+    // 3: migrations/006_teacher_roster.sql
+    "CREATE TABLE teacher_roster ("
+    "teacher_id INTEGER NOT NULL, "
+    "student_id INTEGER NOT NULL, "
+    "meeting_count INTEGER NOT NULL DEFAULT 0, "
+    "PRIMARY KEY (teacher_id, student_id));"
+    "INSERT OR IGNORE INTO teacher_roster "
+    "(teacher_id, student_id, meeting_count) "
+    "SELECT s.teacher_id, p.student_id, SUM(m.status = 'pending') "
+    "FROM slots s "
+    "JOIN meetings m ON m.slot_id = s.slot_id "
+    "JOIN meeting_participants p ON p.meeting_id = m.meeting_id "
+    "GROUP BY s.teacher_id, p.student_id;",
+
+    // 4: migrations/007_slot_versions.sql
+    "ALTER TABLE slots ADD COLUMN version INTEGER NOT NULL DEFAULT 1;",
+
+    // 5: migrations/008_meeting_minutes.sql
+    "CREATE TABLE meeting_minutes ("
+    "meeting_id INTEGER PRIMARY KEY, "
+    "size INTEGER NOT NULL, "
+    "content_hash TEXT NOT NULL, "
+    "updated_at TEXT NOT NULL);",
+
+    // 6: migrations/009_slot_change_pruning.sql. SQLite can't add a column
+    // defaulting to the current time; the server always sets it.
+    "ALTER TABLE slot_changes ADD COLUMN changed_at TEXT;"
+    "UPDATE slot_changes SET changed_at = datetime('now', 'localtime');"
+    "CREATE INDEX idx_slot_changes_slot ON slot_changes (slot_id);"
+    "CREATE TABLE slot_change_floors ("
+    "teacher_id INTEGER PRIMARY KEY, "
+    "change_id INTEGER NOT NULL);",
+};
+
+#define SCHEMA_VERSION_COUNT                                                   \
+  (int)(sizeof(schema_versions) / sizeof(schema_versions[0]))
+
+static pthread_mutex_t schema_lock = PTHREAD_MUTEX_INITIALIZER;
+static int schema_ready = 0;
+
+static int exec_sql(DbSession *session, const char *sql) {
+  return sqlite3_exec(session->db, sql, NULL, NULL, NULL) == SQLITE_OK ? 0
+                                                                       : -1;
+}
+
+// ============= SESSIONS =============
+int db_backend_init(void) {
+  if (!sqlite3_threadsafe()) {
+    log_message("ERROR", "SQLite library built without thread support");
+    return -1;
+  }
+
+  if (sqlite3_initialize() != SQLITE_OK) {
+    log_message("ERROR", "sqlite3_initialize() failed");
+    return -1;
+  }
+  return 0;
+}
+
+// SQLite keeps no per-thread state
+void db_backend_thread_init(void) {}
+
+void db_backend_thread_end(void) {}
+
+static int schema_version(DbSession *session) {
+  sqlite3_stmt *stmt;
+  int version = -1;
+
+  if (sqlite3_prepare_v2(session->db, "PRAGMA user_version", -1, &stmt,
+                         NULL) != SQLITE_OK)
+    return -1;
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    version = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return version;
+}
+
+// Each pending version runs in its own transaction with its version bump
+static int apply_schema(DbSession *session) {
+  int version = schema_version(session);
+  if (version < 0)
+    return -1;
+
+  for (; version < SCHEMA_VERSION_COUNT; version++) {
+    char bump[48];
+    snprintf(bump, sizeof(bump), "PRAGMA user_version = %d", version + 1);
+
+    if (exec_sql(session, "BEGIN IMMEDIATE") < 0)
+      return -1;
+    if (exec_sql(session, schema_versions[version]) < 0 ||
+        exec_sql(session, bump) < 0) {
+      log_message("ERROR", "SQLite schema version %d failed: %s",
+                  version + 1, sqlite3_errmsg(session->db));
+      exec_sql(session, "ROLLBACK");
+      return -1;
+    }
+    if (exec_sql(session, "COMMIT") < 0)
+      return -1;
+
+    log_message("INFO", "SQLite schema at version %d", version + 1);
+  }
+
+  return 0;
+}
+
+// The first session of the process brings the schema up to date
+static int ensure_schema(DbSession *session) {
+  int rc = 0;
+
+  pthread_mutex_lock(&schema_lock);
+  if (!schema_ready) {
+    rc = apply_schema(session);
+    schema_ready = rc == 0;
+  }
+  pthread_mutex_unlock(&schema_lock);
+
+  return rc;
+}
+
+DbSession *db_backend_connect(const char *host, unsigned int port) {
+  (void)host;
+  (void)port;
+
+  DbSession *session = calloc(1, sizeof(DbSession));
+  if (!session)
+    return NULL;
+
+  // Sessions are leased to one thread at a time, so no per-handle mutex
+  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+  if (sqlite3_open_v2(DB_SQLITE_PATH, &session->db, flags, NULL) !=
+      SQLITE_OK) {
+    log_message("ERROR", "SQLite open of %s failed: %s", DB_SQLITE_PATH,
+                session->db ? sqlite3_errmsg(session->db) : "out of memory");
+    db_backend_close(session);
+    return NULL;
+  }
+
+  sqlite3_extended_result_codes(session->db, 1);
+  sqlite3_busy_timeout(session->db, DB_LOCK_WAIT_TIMEOUT_SEC * 1000);
+
+  if (exec_sql(session, "PRAGMA journal_mode=WAL; "
+                        "PRAGMA synchronous=NORMAL") < 0 ||
+      ensure_schema(session) < 0) {
+    log_message("ERROR", "SQLite setup of %s failed: %s", DB_SQLITE_PATH,
+                sqlite3_errmsg(session->db));
+    db_backend_close(session);
+    return NULL;
+  }
+
+  log_message("INFO", "SQLite database %s opened", DB_SQLITE_PATH);
+  return session;
+}
+
+void db_backend_close(DbSession *session) {
+  if (!session)
+    return;
+
+  sqlite3_close_v2(session->db);
+  free(session);
+}
+
+// A file never goes away like a server does
+int db_backend_ping(DbSession *session) {
+  (void)session;
+  return 0;
+}
+
+const char *db_backend_error(DbSession *session) {
+  return sqlite3_errmsg(session->db);
+}
+
+unsigned int db_backend_errno(DbSession *session) {
+  return (unsigned int)sqlite3_extended_errcode(session->db);
+}
+
+int db_backend_lost(unsigned int err) {
+  (void)err;
+  return 0;
+}
+
+int db_backend_conflict(unsigned int err) {
+  int primary = err & 0xff;
+  return primary == SQLITE_BUSY || primary == SQLITE_LOCKED;
+}
+
+// IMMEDIATE takes the write lock up front, so a transaction that reads
+// before writing can't fail on the upgrade halfway through
+int db_backend_begin(DbSession *session) {
+  return exec_sql(session, "BEGIN IMMEDIATE");
+}
+
+int db_backend_commit(DbSession *session) {
+  return exec_sql(session, "COMMIT");
+}
+
+int db_backend_rollback(DbSession *session) {
+  return exec_sql(session, "ROLLBACK");
+}
+
+// ============= PREPARE =============
+void db_backend_free(DbStmt *s) {
+  if (!s)
+    return;
+
+  sqlite3_finalize(s->stmt);
+  free(s->data);
+  free(s->offsets);
+  free(s->row);
+  free(s);
+}
+
+DbStmt *db_backend_prepare(DbConn *conn, StmtId id, const char *sql) {
+  DbStmt *s = calloc(1, sizeof(DbStmt));
+  if (!s)
+    return NULL;
+
+  s->id = id;
+  s->conn = conn;
+
+  sqlite3 *db = conn->session->db;
+  if (sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &s->stmt,
+                         NULL) != SQLITE_OK) {
+    log_message("ERROR", "Prepare failed (stmt %d): %s", id,
+                sqlite3_errmsg(db));
+    conn->stmts.last_errno = (unsigned int)sqlite3_extended_errcode(db);
+    db_backend_free(s);
+    return NULL;
+  }
+
+  s->param_count = sqlite3_bind_parameter_count(s->stmt);
+  s->column_count = (unsigned int)sqlite3_column_count(s->stmt);
+
+  if (s->column_count > 0) {
+    s->row = calloc(s->column_count, sizeof(char *));
+    if (!s->row) {
+      db_backend_free(s);
+      return NULL;
+    }
+  }
+
+  return s;
+}
+
+// ============= EXECUTE =============
+static void fail(DbStmt *s, const char *what) {
+  sqlite3 *db = s->conn->session->db;
+
+  log_message("ERROR", "%s (stmt %d): %s", what, s->id, sqlite3_errmsg(db));
+  s->conn->stmts.last_errno = (unsigned int)sqlite3_extended_errcode(db);
+}
+
+static int bind_params(DbStmt *s, const DbParam *params, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    int column = (int)i + 1;
+    int rc;
+
+    switch (params[i].type) {
+    case 'i':
+      rc = sqlite3_bind_int(s->stmt, column, params[i].value.i);
+      break;
+    case 'l':
+      rc = sqlite3_bind_int64(s->stmt, column, params[i].value.l);
+      break;
+    default:
+      // The caller's string outlives the call, so no copy
+      rc = sqlite3_bind_text(s->stmt, column, params[i].value.s, -1,
+                             SQLITE_STATIC);
+      break;
+    }
+
+    if (rc != SQLITE_OK)
+      return -1;
+  }
+  return 0;
+}
+
+static int reserve(void **buf, size_t *capacity, size_t needed, size_t unit) {
+  if (needed <= *capacity)
+    return 0;
+
+  size_t grown = *capacity ? *capacity * 2 : 64;
+  while (grown < needed)
+    grown *= 2;
+
+  void *p = realloc(*buf, grown * unit);
+  if (!p)
+    return -1;
+
+  *buf = p;
+  *capacity = grown;
+  return 0;
+}
+
+// Append the current row to the buffered result
+static int store_row(DbStmt *s) {
+  size_t first = s->row_count * s->column_count;
+  if (reserve((void **)&s->offsets, &s->offsets_capacity,
+              first + s->column_count, sizeof(size_t)) < 0)
+    return -1;
+
+  for (unsigned int i = 0; i < s->column_count; i++) {
+    const char *value = (const char *)sqlite3_column_text(s->stmt, (int)i);
+    if (!value) {
+      s->offsets[first + i] = NO_VALUE;
+      continue;
+    }
+
+    size_t len = (size_t)sqlite3_column_bytes(s->stmt, (int)i);
+    if (reserve((void **)&s->data, &s->data_capacity, s->data_len + len + 1,
+                1) < 0)
+      return -1;
+
+    memcpy(s->data + s->data_len, value, len + 1);
+    s->offsets[first + i] = s->data_len;
+    s->data_len += len + 1;
+  }
+
+  s->row_count++;
+  return 0;
+}
+
+// Read every row now; resetting right after ends the read transaction
+static int buffer_rows(DbStmt *s) {
+  int rc;
+  while ((rc = sqlite3_step(s->stmt)) == SQLITE_ROW) {
+    if (store_row(s) < 0) {
+      log_message("ERROR", "Buffering result failed (stmt %d)", s->id);
+      sqlite3_reset(s->stmt);
+      return -1;
+    }
+  }
+
+  if (rc != SQLITE_DONE) {
+    fail(s, "Statement failed");
+    sqlite3_reset(s->stmt);
+    return -1;
+  }
+
+  sqlite3_reset(s->stmt);
+  return 0;
+}
+
+// Like MySQL's LAST_INSERT_ID(expr), the first RETURNING value becomes the
+// session's insert id
+static int run_to_end(DbStmt *s) {
+  DbSession *session = s->conn->session;
+  session->has_returned = 0;
+
+  int rc;
+  while ((rc = sqlite3_step(s->stmt)) == SQLITE_ROW) {
+    if (!session->has_returned && s->column_count > 0) {
+      session->returned_id = sqlite3_column_int64(s->stmt, 0);
+      session->has_returned = 1;
+    }
+  }
+
+  if (rc != SQLITE_DONE) {
+    fail(s, "Statement failed");
+    sqlite3_reset(s->stmt);
+    return -1;
+  }
+
+  s->affected = sqlite3_changes(session->db);
+  sqlite3_reset(s->stmt);
+  return 0;
+}
+
+int db_backend_execute(DbStmt *s, const DbParam *params, size_t count,
+                       DbRunMode mode) {
+  if (count != (size_t)s->param_count) {
+    log_message("ERROR", "Stmt %d takes %d parameters, got %zu", s->id,
+                s->param_count, count);
+    return -1;
+  }
+
+  sqlite3_reset(s->stmt);
+  s->streaming = 0;
+  s->affected = 0;
+  s->data_len = 0;
+  s->row_count = 0;
+  s->next_row = 0;
+
+  if (bind_params(s, params, count) < 0) {
+    fail(s, "Binding parameters failed");
+    return -1;
+  }
+
+  switch (mode) {
+  case DB_RUN_STREAM:
+    s->streaming = 1;
+    return 0;
+  case DB_RUN_BUFFERED:
+    return buffer_rows(s);
+  default:
+    return run_to_end(s);
+  }
+}
+
+long long db_backend_affected_rows(DbStmt *s) { return s->affected; }
+
+unsigned long long db_backend_num_rows(DbStmt *s) { return s->row_count; }
+
+unsigned int db_backend_columns(DbStmt *s) { return s->column_count; }
+
+unsigned long long db_backend_insert_id(DbConn *conn) {
+  DbSession *session = conn->session;
+  if (session->has_returned)
+    return (unsigned long long)session->returned_id;
+  return (unsigned long long)sqlite3_last_insert_rowid(session->db);
+}
+
+// ============= FETCH =============
+int db_backend_fetch(DbStmt *s, DbRow *row) {
+  if (s->column_count == 0)
+    return 1;
+
+  if (s->streaming) {
+    int rc = sqlite3_step(s->stmt);
+    if (rc == SQLITE_DONE)
+      return 1;
+    if (rc != SQLITE_ROW) {
+      fail(s, "Fetch failed");
+      return -1;
+    }
+
+    // Valid until the next step; NULL for SQL NULL
+    for (unsigned int i = 0; i < s->column_count; i++)
+      s->row[i] = (char *)sqlite3_column_text(s->stmt, (int)i);
+  } else {
+    if (s->next_row == s->row_count)
+      return 1;
+
+    const size_t *cells = s->offsets + s->next_row++ * s->column_count;
+    for (unsigned int i = 0; i < s->column_count; i++)
+      s->row[i] = cells[i] == NO_VALUE ? NULL : s->data + cells[i];
+  }
+
+  *row = s->row;
+  return 0;
+}
+
+void db_backend_free_result(DbStmt *s) {
+  sqlite3_reset(s->stmt);
+  s->streaming = 0;
+  s->data_len = 0;
+  s->row_count = 0;
+  s->next_row = 0;
+}
@@ -0,0 +1,699 @@
+#include "db_stmt.h"
+#include "db_backend.h"
+#include "db_pool.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SLOT_TYPE_NAME                                                         \
+  "CASE s.slot_type WHEN 0 THEN 'Individual' WHEN 1 THEN 'Group' "             \
+  "ELSE 'Both' END"
+
+// Organizer and member meetings alike, through meeting_participants. The
+// teacher (student for appointments) comes back as an id; the handler writes
+// the name from the user directory.
+#define MEETINGS_OF_STUDENT(range)                                             \
+  "SELECT m.meeting_id, s.start_time, s.end_time, s.teacher_id, m.is_group "   \
+  "FROM meeting_participants p "                                               \
+  "JOIN meetings m ON p.meeting_id = m.meeting_id "                            \
+  "JOIN slots s ON m.slot_id = s.slot_id "                                     \
+  "WHERE p.student_id=? AND m.status='pending' " range "ORDER BY s.start_time"
+
+#define APPOINTMENTS_OF_TEACHER(range)                                         \
+  "SELECT m.meeting_id, s.start_time, s.end_time, m.student_id, m.is_group "   \
+  "FROM meetings m "                                                           \
+  "JOIN slots s ON m.slot_id = s.slot_id "                                     \
+  "WHERE s.teacher_id=? AND m.status='pending' " range "ORDER BY s.start_time"
+
+// Placeholder lists for the id-list statements
+#define IDS_8 "?, ?, ?, ?, ?, ?, ?, ?"
+#define IDS_16 IDS_8 ", " IDS_8
+#define IDS_32 IDS_16 ", " IDS_16
+#define IDS_64 IDS_32 ", " IDS_32
+
+// Only existing students become members; affected rows tell how many were
+#define GROUP_MEMBERS_ADD(ids)                                                 \
+  "INSERT INTO meeting_participants (meeting_id, student_id, role) "           \
+  "SELECT ?, user_id, 'member' FROM users "                                    \
+  "WHERE role='student' AND user_id IN (" ids ")"
+
+#define STUDENTS_IN(ids)                                                       \
+  "SELECT user_id FROM users WHERE role='student' AND user_id IN (" ids ")"
+
+#define SLOT_CHANGE_LOG_IN(ids)                                                \
+  "INSERT INTO slot_changes (teacher_id, slot_id, changed_at) "                \
+  "SELECT ?, slot_id, " NOW " FROM slots WHERE slot_id IN (" ids ")"
+
+// Day offsets as a one-column table; UNION drops the repeated padding
+#define DAYS_8                                                                 \
+  "SELECT ? AS k UNION SELECT ? UNION SELECT ? UNION SELECT ? "                \
+  "UNION SELECT ? UNION SELECT ? UNION SELECT ? UNION SELECT ?"
+#define DAYS_16 DAYS_8 " UNION " DAYS_8
+#define DAYS_32 DAYS_16 " UNION " DAYS_16
+#define DAYS_64 DAYS_32 " UNION " DAYS_32
+
+// One slot per day offset, the first day's start and end moved by d.k days
+#define SLOT_INSERT_DAYS(days)                                                 \
+  "INSERT INTO slots (teacher_id, start_time, end_time, slot_type) "           \
+  "SELECT ?, " PLUS_DAYS("?") ", " PLUS_DAYS("?") ", ? "                       \
+  "FROM (" days ") d"
+
+// Optimistic check on a slot's row version; callers bind the client's version
+// twice, and 0 (no version sent) matches any
+#define VERSION_MATCHES "(? = 0 OR version = ?)"
+
+// Every column of the free slot index, booked slots included
+#define FREE_SLOTS_ROWS                                                        \
+  "SELECT slot_id, teacher_id, start_time, end_time, slot_type, is_booked, "   \
+  "version FROM slots"
+
+// Half-open [from, to) on start_time; a bare column keeps the index usable
+#define IN_RANGE "AND s.start_time >= ? AND s.start_time < ? "
+
+// SQL for the engine built in, for the few statements that differ
+#ifdef DB_BACKEND_SQLITE
+#define DIALECT(mysql, sqlite) sqlite
+#else
+#define DIALECT(mysql, sqlite) mysql
+#endif
+
+#define NOW DIALECT("NOW()", "datetime('now', 'localtime')")
+
+#define PLUS_DAYS(t)                                                           \
+  DIALECT("CAST(" t " AS DATETIME) + INTERVAL d.k DAY",                        \
+          "datetime(" t ", '+' || d.k || ' days')")
+
+// Upsert tail for change_versions: an existing counter is bumped
+#define BUMP_EXISTING                                                          \
+  DIALECT("ON DUPLICATE KEY UPDATE ",                                          \
+          "ON CONFLICT (user_id) DO UPDATE SET ")                              \
+  "version = change_versions.version + 1"
+
+// Deletion entries of the change log written more than ? days ago
+#define OLD_DELETIONS                                                          \
+  "c.changed_at < "                                                            \
+  DIALECT("NOW() - INTERVAL ? DAY",                                            \
+          "datetime('now', 'localtime', '-' || ? || ' days')")                 \
+  " AND NOT EXISTS (SELECT 1 FROM slots s WHERE s.slot_id = c.slot_id)"
+
+// Upsert tail for slot_change_floors: a floor only moves up
+#define FLOOR_EXISTING                                                         \
+  DIALECT("ON DUPLICATE KEY UPDATE change_id = "                               \
+          "GREATEST(slot_change_floors.change_id, VALUES(change_id))",         \
+          "ON CONFLICT (teacher_id) DO UPDATE SET change_id = "                \
+          "MAX(slot_change_floors.change_id, excluded.change_id)")
+
+// Upsert tail for teacher_roster: a student already listed counts one more
+// meeting
+#define ROSTER_EXISTING                                                        \
+  DIALECT("ON DUPLICATE KEY UPDATE ",                                          \
+          "ON CONFLICT (teacher_id, student_id) DO UPDATE SET ")               \
+  "meeting_count = teacher_roster.meeting_count + 1"
+
+// ============= CATALOG =============
+// Parameter types as db_stmt_query() takes them. Id-list statements give only
+// the parameters before the list, NULL if those are ints as well.
+typedef struct {
+  const char *params;
+  const char *sql;
+} StmtDef;
+
+static const StmtDef catalog[STMT_COUNT] = {
+    // handler_auth.c
+    [STMT_USER_ID_BY_NAME] = {"s",
+         "SELECT user_id FROM users WHERE username=?"},
+    [STMT_USER_LOGIN] = {"ss",
+         "SELECT user_id, role FROM users "
+         "WHERE username=? AND password_hash=?"},
+    [STMT_USER_INSERT] = {"sss",
+         "INSERT INTO users (username, password_hash, role) "
+         "VALUES (?, ?, ?)"},
+
+    // handler_slot.c
+    [STMT_SLOT_RANGE] = {"iss",
+         "SELECT slot_id, start_time FROM slots "
+         "WHERE teacher_id=? AND start_time >= ? AND start_time <= ? "
+         "ORDER BY start_time"},
+    [STMT_SLOT_INSERT] = {"issi",
+         "INSERT INTO slots (teacher_id, start_time, end_time, slot_type) "
+         "VALUES (?, ?, ?, ?)"},
+    [STMT_SLOT_INSERT_DAYS_8] = {"issi", SLOT_INSERT_DAYS(DAYS_8)},
+    [STMT_SLOT_INSERT_DAYS_16] = {"issi", SLOT_INSERT_DAYS(DAYS_16)},
+    [STMT_SLOT_INSERT_DAYS_32] = {"issi", SLOT_INSERT_DAYS(DAYS_32)},
+    [STMT_SLOT_INSERT_DAYS_64] = {"issi", SLOT_INSERT_DAYS(DAYS_64)},
+    // Why an UPDATE or DELETE of a teacher's slot matched no row
+    [STMT_SLOT_STATE_OWNED] = {"ii",
+         "SELECT is_booked, version FROM slots "
+         "WHERE slot_id=? AND teacher_id=?"},
+    // LAST_INSERT_ID (RETURNING under SQLite) hands back the new version
+    [STMT_SLOT_UPDATE] = {"ssiiiii",
+         DIALECT("UPDATE slots SET start_time=?, end_time=?, slot_type=?, "
+                 "version=LAST_INSERT_ID(version + 1) "
+                 "WHERE slot_id=? AND teacher_id=? AND " VERSION_MATCHES,
+                 "UPDATE slots SET start_time=?, end_time=?, slot_type=?, "
+                 "version=version + 1 "
+                 "WHERE slot_id=? AND teacher_id=? AND " VERSION_MATCHES " "
+                 "RETURNING version")},
+    [STMT_SLOT_DELETE] = {"iiii",
+         "DELETE FROM slots WHERE slot_id=? AND teacher_id=? AND is_booked=0 "
+         "AND " VERSION_MATCHES},
+    [STMT_MY_SLOTS] = {"i",
+         "SELECT s.slot_id, DATE(s.start_time), TIME(s.start_time), "
+         "TIME(s.end_time), " SLOT_TYPE_NAME ", s.is_booked, s.version "
+         "FROM slots s WHERE s.teacher_id=? ORDER BY s.start_time"},
+    [STMT_SLOT_CHANGES_LATEST] = {"ii",
+         "SELECT COALESCE(MAX(change_id), 0), "
+         "(SELECT COALESCE(MAX(f.change_id), 0) FROM slot_change_floors f "
+         "WHERE f.teacher_id=?) "
+         "FROM slot_changes WHERE teacher_id=?"},
+    [STMT_SLOT_CHANGES_SINCE] = {"ili",
+         "SELECT c.last_change, c.slot_id, s.slot_id IS NULL, "
+         "DATE(s.start_time), TIME(s.start_time), TIME(s.end_time), "
+         "" SLOT_TYPE_NAME ", s.is_booked, s.version "
+         "FROM (SELECT slot_id, MAX(change_id) AS last_change "
+         "FROM slot_changes WHERE teacher_id=? AND change_id > ? "
+         "GROUP BY slot_id) c "
+         "LEFT JOIN slots s ON s.slot_id = c.slot_id "
+         "ORDER BY c.last_change LIMIT ?"},
+    [STMT_STUDENTS_OF_TEACHER] = {"i",
+         "SELECT u.user_id, u.username FROM teacher_roster r "
+         "JOIN users u ON u.user_id = r.student_id "
+         "WHERE r.teacher_id = ? "
+         "ORDER BY u.username"},
+    [STMT_ALL_STUDENTS] = {"i",
+         "SELECT user_id, username FROM users "
+         "WHERE role='student' AND user_id != ? "
+         "ORDER BY username"},
+
+    // handler_meeting.c
+    [STMT_SLOT_FOR_BOOKING] = {"i",
+         "SELECT slot_type, is_booked, version FROM slots WHERE slot_id=?"},
+    // Books a free slot of an allowed type at the version the student saw;
+    // LAST_INSERT_ID (RETURNING under SQLite) hands back the teacher so no
+    // SELECT is needed
+    [STMT_SLOT_CLAIM] = {"iiii",
+         DIALECT("UPDATE slots SET is_booked=1, version=version + 1, "
+                 "teacher_id=LAST_INSERT_ID(teacher_id) "
+                 "WHERE slot_id=? AND is_booked=0 AND slot_type<>? "
+                 "AND " VERSION_MATCHES,
+                 "UPDATE slots SET is_booked=1, version=version + 1 "
+                 "WHERE slot_id=? AND is_booked=0 AND slot_type<>? "
+                 "AND " VERSION_MATCHES " RETURNING teacher_id")},
+    [STMT_SLOT_SET_BOOKED] = {"ii",
+         "UPDATE slots SET is_booked=?, version=version + 1 "
+         "WHERE slot_id=?"},
+    [STMT_MEETING_INSERT] = {"iii",
+         "INSERT INTO meetings (slot_id, student_id, is_group) "
+         "VALUES (?, ?, ?)"},
+    [STMT_ORGANIZER_ADD] = {"ii",
+         "INSERT INTO meeting_participants (meeting_id, student_id, role) "
+         "VALUES (?, ?, 'organizer')"},
+    [STMT_GROUP_MEMBERS_ADD_8] = {NULL, GROUP_MEMBERS_ADD(IDS_8)},
+    [STMT_GROUP_MEMBERS_ADD_16] = {NULL, GROUP_MEMBERS_ADD(IDS_16)},
+    [STMT_GROUP_MEMBERS_ADD_32] = {NULL, GROUP_MEMBERS_ADD(IDS_32)},
+    [STMT_GROUP_MEMBERS_ADD_64] = {NULL, GROUP_MEMBERS_ADD(IDS_64)},
+    [STMT_STUDENTS_IN_8] = {NULL, STUDENTS_IN(IDS_8)},
+    [STMT_STUDENTS_IN_16] = {NULL, STUDENTS_IN(IDS_16)},
+    [STMT_STUDENTS_IN_32] = {NULL, STUDENTS_IN(IDS_32)},
+    [STMT_STUDENTS_IN_64] = {NULL, STUDENTS_IN(IDS_64)},
+    [STMT_MEETING_FOR_CANCEL] = {"i",
+         "SELECT m.slot_id, m.student_id, s.teacher_id FROM meetings m "
+         "JOIN slots s ON m.slot_id = s.slot_id "
+         "WHERE m.meeting_id=? AND m.status='pending'"},
+    [STMT_MEETING_CANCEL] = {"i",
+         "UPDATE meetings SET status='cancelled' "
+         "WHERE meeting_id=? AND status='pending'"},
+    [STMT_ROSTER_ADD] = {"ii",
+         "INSERT INTO teacher_roster (teacher_id, student_id, meeting_count) "
+         "SELECT ?, student_id, 1 FROM meeting_participants "
+         "WHERE meeting_id=? " ROSTER_EXISTING},
+    [STMT_ROSTER_DROP] = {"ii",
+         "UPDATE teacher_roster SET meeting_count = meeting_count - 1 "
+         "WHERE teacher_id=? AND meeting_count > 0 AND student_id IN "
+         "(SELECT student_id FROM meeting_participants WHERE meeting_id=?)"},
+    [STMT_MEETINGS_ALL] = {"i", MEETINGS_OF_STUDENT("")},
+    [STMT_MEETINGS_RANGE] = {"iss", MEETINGS_OF_STUDENT(IN_RANGE)},
+    [STMT_APPOINTMENTS_ALL] = {"i", APPOINTMENTS_OF_TEACHER("")},
+    [STMT_APPOINTMENTS_RANGE] = {"iss", APPOINTMENTS_OF_TEACHER(IN_RANGE)},
+    [STMT_MEETING_FOR_MINUTES] = {"i",
+         "SELECT s.teacher_id, s.start_time <= " NOW " AS has_started "
+         "FROM meetings m JOIN slots s ON m.slot_id = s.slot_id "
+         "WHERE m.meeting_id=?"},
+    // Minutes metadata comes along, so no file is opened per row
+    [STMT_HISTORY] = {"ii",
+         "SELECT m.meeting_id, s.start_time, mm.meeting_id IS NOT NULL, "
+         "mm.size, mm.updated_at, mm.content_hash "
+         "FROM meeting_participants p "
+         "JOIN meetings m ON p.meeting_id = m.meeting_id "
+         "JOIN slots s ON m.slot_id = s.slot_id "
+         "LEFT JOIN meeting_minutes mm ON mm.meeting_id = m.meeting_id "
+         "WHERE p.student_id=? AND s.teacher_id=? "
+         "ORDER BY s.start_time DESC"},
+
+    // slot_index.c
+    [STMT_SLOT_INDEX_LOAD] = {"",
+         "SELECT slot_id, teacher_id, start_time, end_time, version "
+         "FROM slots"},
+
+    // user_directory.c
+    [STMT_USER_DIRECTORY_LOAD] = {"",
+         "SELECT user_id, username, role FROM users"},
+
+    // free_slots.c
+    [STMT_FREE_SLOTS_LOAD] = {"", FREE_SLOTS_ROWS},
+    [STMT_FREE_SLOTS_ONE] = {"i", FREE_SLOTS_ROWS " WHERE slot_id=?"},
+
+    // minutes.c
+    [STMT_MINUTES_SAVE] = {"iiss",
+         "REPLACE INTO meeting_minutes "
+         "(meeting_id, size, content_hash, updated_at) VALUES (?, ?, ?, ?)"},
+    [STMT_MINUTES_KNOWN] = {"",
+         "SELECT meeting_id, size, updated_at FROM meeting_minutes"},
+
+    // change_version.c
+    [STMT_VERSION_GET] = {"i",
+         "SELECT version FROM change_versions WHERE user_id=?"},
+    [STMT_VERSION_BUMP] = {"i",
+         "INSERT INTO change_versions (user_id, version) "
+         "VALUES (?, 1) " BUMP_EXISTING},
+    [STMT_VERSION_BUMP_2] = {"ii",
+         "INSERT INTO change_versions (user_id, version) "
+         "VALUES (?, 1), (?, 1) " BUMP_EXISTING},
+    [STMT_VERSION_BUMP_3] = {"iii",
+         "INSERT INTO change_versions (user_id, version) "
+         "VALUES (?, 1), (?, 1), (?, 1) " BUMP_EXISTING},
+    [STMT_VERSION_BUMP_PARTICIPANTS] = {"i",
+         "INSERT INTO change_versions (user_id, version) "
+         "SELECT DISTINCT p.student_id, 1 FROM meetings m "
+         "JOIN meeting_participants p ON p.meeting_id = m.meeting_id "
+         "WHERE m.slot_id=? " BUMP_EXISTING},
+    [STMT_SLOT_CHANGE_LOG] = {"ii",
+         "INSERT INTO slot_changes (teacher_id, slot_id, changed_at) "
+         "VALUES (?, ?, " NOW ")"},
+    [STMT_SLOT_CHANGE_LOG_8] = {NULL, SLOT_CHANGE_LOG_IN(IDS_8)},
+    [STMT_SLOT_CHANGE_LOG_16] = {NULL, SLOT_CHANGE_LOG_IN(IDS_16)},
+    [STMT_SLOT_CHANGE_LOG_32] = {NULL, SLOT_CHANGE_LOG_IN(IDS_32)},
+    [STMT_SLOT_CHANGE_LOG_64] = {NULL, SLOT_CHANGE_LOG_IN(IDS_64)},
+    [STMT_SLOT_CHANGE_CLEAR] = {"i",
+         "DELETE FROM slot_changes WHERE slot_id=?"},
+    [STMT_SLOT_CHANGES_PRUNE_SUPERSEDED] = {"",
+         DIALECT("DELETE c FROM slot_changes c "
+                 "JOIN slot_changes n ON n.slot_id = c.slot_id "
+                 "AND n.change_id > c.change_id",
+                 "DELETE FROM slot_changes WHERE EXISTS "
+                 "(SELECT 1 FROM slot_changes n "
+                 "WHERE n.slot_id = slot_changes.slot_id "
+                 "AND n.change_id > slot_changes.change_id)")},
+    [STMT_SLOT_CHANGES_RAISE_FLOORS] = {"i",
+         "INSERT INTO slot_change_floors (teacher_id, change_id) "
+         "SELECT c.teacher_id, MAX(c.change_id) FROM slot_changes c "
+         "WHERE " OLD_DELETIONS " "
+         "GROUP BY c.teacher_id " FLOOR_EXISTING},
+    [STMT_SLOT_CHANGES_RELOG_BELOW_FLOOR] = {"",
+         "INSERT INTO slot_changes (teacher_id, slot_id, changed_at) "
+         "SELECT c.teacher_id, c.slot_id, c.changed_at FROM slot_changes c "
+         "JOIN slot_change_floors f ON f.teacher_id = c.teacher_id "
+         "WHERE c.change_id <= f.change_id "
+         "AND EXISTS (SELECT 1 FROM slots s WHERE s.slot_id = c.slot_id) "
+         "ORDER BY c.change_id"},
+    [STMT_SLOT_CHANGES_DROP_BELOW_FLOOR] = {"",
+         "DELETE FROM slot_changes WHERE change_id <= "
+         "(SELECT f.change_id FROM slot_change_floors f "
+         "WHERE f.teacher_id = slot_changes.teacher_id)"},
+};
+
+// ============= PREPARE =============
+static DbStmt *prepare(DbConn *conn, StmtId id) {
+  if (!conn->stmts.stmts[id])
+    conn->stmts.stmts[id] = db_backend_prepare(conn, id, catalog[id].sql);
+  return conn->stmts.stmts[id];
+}
+
+void db_stmt_cache_clear(StmtCache *cache) {
+  for (int i = 0; i < STMT_COUNT; i++) {
+    db_backend_free(cache->stmts[i]);
+    cache->stmts[i] = NULL;
+  }
+  cache->last_errno = 0;
+}
+
+// ============= TIMING =============
+static DbStmtTiming timings[STMT_COUNT];
+static unsigned long long statements_run = 0;
+static pthread_mutex_t slow_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Bucket i holds durations below 2^i us; the last one takes the rest
+static int timing_bucket(unsigned long long us) {
+  int bucket = 0;
+  while (bucket < DB_STMT_TIMING_BUCKETS - 1 && us >= (1ULL << bucket))
+    bucket++;
+  return bucket;
+}
+
+static void log_slow_statement(DbConn *conn, StmtId id, double ms,
+                               long long rows) {
+  const char *caller = conn->caller ? conn->caller : "-";
+
+  log_message("SLOW", "%s stmt %d: %.1f ms, %lld rows: %s", caller, id, ms,
+              rows, catalog[id].sql);
+
+  if (DB_SLOW_QUERY_LOG[0] == '\0')
+    return;
+
+  time_t now = time(NULL);
+  struct tm tm_now;
+  char timestamp[32];
+  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S",
+           localtime_r(&now, &tm_now));
+
+  pthread_mutex_lock(&slow_log_lock);
+  FILE *file = fopen(DB_SLOW_QUERY_LOG, "a");
+  if (file) {
+    fprintf(file, "%s\t%s\tstmt %d\t%.3f ms\t%lld rows\t%s\n", timestamp,
+            caller, id, ms, rows, catalog[id].sql);
+    fclose(file);
+  }
+  pthread_mutex_unlock(&slow_log_lock);
+}
+
+// Account one statement started at start_us; rows < 0 means it failed
+static void record_timing(DbConn *conn, StmtId id, unsigned long long start_us,
+                          long long rows) {
+  unsigned long long us = now_us() - start_us;
+  DbStmtTiming *t = &timings[id];
+
+  __atomic_fetch_add(&t->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&t->total_us, us, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&t->buckets[timing_bucket(us)], 1, __ATOMIC_RELAXED);
+  if (rows < 0)
+    __atomic_fetch_add(&t->errors, 1, __ATOMIC_RELAXED);
+
+  unsigned long long max = __atomic_load_n(&t->max_us, __ATOMIC_RELAXED);
+  while (us > max && !__atomic_compare_exchange_n(&t->max_us, &max, us, 1,
+                                                  __ATOMIC_RELAXED,
+                                                  __ATOMIC_RELAXED))
+    ;
+
+  if (DB_SLOW_QUERY_MS >= 0 && us >= DB_SLOW_QUERY_MS * 1000ULL)
+    log_slow_statement(conn, id, us / 1000.0, rows);
+
+  if (__atomic_add_fetch(&statements_run, 1, __ATOMIC_RELAXED) %
+          DB_STMT_STATS_EVERY ==
+      0)
+    db_stmt_log_timings();
+}
+
+void db_stmt_timing(StmtId id, DbStmtTiming *out) {
+  DbStmtTiming *t = &timings[id];
+
+  out->calls = __atomic_load_n(&t->calls, __ATOMIC_RELAXED);
+  out->errors = __atomic_load_n(&t->errors, __ATOMIC_RELAXED);
+  out->total_us = __atomic_load_n(&t->total_us, __ATOMIC_RELAXED);
+  out->max_us = __atomic_load_n(&t->max_us, __ATOMIC_RELAXED);
+  for (int i = 0; i < DB_STMT_TIMING_BUCKETS; i++)
+    out->buckets[i] = __atomic_load_n(&t->buckets[i], __ATOMIC_RELAXED);
+}
+
+// Upper bound of the bucket holding the given fraction of the calls
+static unsigned long long timing_percentile(const DbStmtTiming *t,
+                                            double fraction) {
+  unsigned long long target = (unsigned long long)(t->calls * fraction);
+  unsigned long long seen = 0;
+
+  for (int i = 0; i < DB_STMT_TIMING_BUCKETS - 1; i++) {
+    seen += t->buckets[i];
+    if (seen > target)
+      return 1ULL << i;
+  }
+  return t->max_us;
+}
+
+void db_stmt_log_timings(void) {
+  for (int id = 0; id < STMT_COUNT; id++) {
+    DbStmtTiming t;
+    db_stmt_timing(id, &t);
+    if (t.calls == 0)
+      continue;
+
+    log_message("INFO",
+                "DB stmt %d: calls=%llu errors=%llu avg=%lluus p50<%lluus "
+                "p95<%lluus p99<%lluus max=%lluus | %.48s",
+                id, t.calls, t.errors, t.total_us / t.calls,
+                timing_percentile(&t, 0.50), timing_percentile(&t, 0.95),
+                timing_percentile(&t, 0.99), t.max_us, catalog[id].sql);
+  }
+}
+
+// ============= EXECUTE =============
+static DbStmt *run_params(DbConn *conn, StmtId id, const DbParam *params,
+                          size_t count, DbRunMode mode) {
+  DbStmt *s = prepare(conn, id);
+  if (!s || db_backend_execute(s, params, count, mode) < 0)
+    return NULL;
+  return s;
+}
+
+// Check `types` against the catalog and read the arguments into params.
+// Returns how many were read, -1 on error.
+static int collect_params(StmtId id, const char *types, va_list args,
+                          DbParam *params) {
+  if (!catalog[id].params || strcmp(types, catalog[id].params) != 0) {
+    log_message("ERROR", "Stmt %d takes parameters \"%s\", got \"%s\"", id,
+                catalog[id].params ? catalog[id].params : "ids", types);
+    return -1;
+  }
+
+  int count = (int)strlen(types);
+  if (count > DB_STMT_MAX_PARAMS) {
+    log_message("ERROR", "Stmt %d: too many parameters (%d)", id, count);
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    params[i].type = types[i];
+    switch (types[i]) {
+    case 'i':
+      params[i].value.i = va_arg(args, int);
+      break;
+    case 'l':
+      params[i].value.l = va_arg(args, long long);
+      break;
+    case 's':
+      params[i].value.s = va_arg(args, const char *);
+      break;
+    default:
+      log_message("ERROR", "Stmt %d: unknown parameter type '%c'", id,
+                  types[i]);
+      return -1;
+    }
+  }
+
+  return count;
+}
+
+static DbStmt *run(DbConn *conn, StmtId id, DbRunMode mode, const char *types,
+                   va_list args) {
+  DbParam params[DB_STMT_MAX_PARAMS];
+
+  int count = collect_params(id, types, args, params);
+  if (count < 0)
+    return NULL;
+
+  return run_params(conn, id, params, count, mode);
+}
+
+// Smallest variant of an id-list family that fits count ids: _8 to _64
+static StmtId ids_variant(StmtId family, int count, int *size) {
+  int variant = 0;
+  *size = 8;
+  while (*size < count) {
+    *size *= 2;
+    variant++;
+  }
+  return family + variant;
+}
+
+// Append the ids to the n parameters already in params, padded to size
+static DbStmt *run_list(DbConn *conn, StmtId id, DbParam *params, size_t n,
+                        int size, const int *ids, int count, DbRunMode mode) {
+  for (int i = 0; i < size; i++) {
+    params[n].type = 'i';
+    params[n++].value.i = ids[i < count ? i : count - 1];
+  }
+
+  return run_params(conn, id, params, n, mode);
+}
+
+static DbStmt *run_ids(DbConn *conn, StmtId id, int size, const int *lead,
+                       const int *ids, int count, DbRunMode mode) {
+  DbParam params[DB_STMT_MAX_BINDS];
+
+  size_t n = 0;
+  if (lead) {
+    params[n].type = 'i';
+    params[n++].value.i = *lead;
+  }
+
+  return run_list(conn, id, params, n, size, ids, count, mode);
+}
+
+static int bad_id_count(StmtId family, int count) {
+  if (count >= 1 && count <= DB_STMT_MAX_IDS)
+    return 0;
+
+  log_message("ERROR", "Stmt %d: bad id list length %d", family, count);
+  return 1;
+}
+
+DbStmt *db_stmt_query(DbConn *conn, StmtId id, const char *types, ...) {
+  unsigned long long start = now_us();
+
+  va_list args;
+  va_start(args, types);
+  DbStmt *s = run(conn, id, DB_RUN_BUFFERED, types, args);
+  va_end(args);
+
+  record_timing(conn, id, start, s ? (long long)db_backend_num_rows(s) : -1);
+  return s;
+}
+
+long long db_stmt_execute(DbConn *conn, StmtId id, const char *types, ...) {
+  unsigned long long start = now_us();
+
+  va_list args;
+  va_start(args, types);
+  DbStmt *s = run(conn, id, DB_RUN_EXECUTE, types, args);
+  va_end(args);
+
+  long long affected = s ? db_backend_affected_rows(s) : -1;
+  record_timing(conn, id, start, affected);
+  return affected;
+}
+
+DbStmt *db_stmt_query_ids(DbConn *conn, StmtId family, const int *lead,
+                          const int *ids, int count) {
+  if (bad_id_count(family, count))
+    return NULL;
+
+  unsigned long long start = now_us();
+  int size;
+  StmtId id = ids_variant(family, count, &size);
+  DbStmt *s = run_ids(conn, id, size, lead, ids, count, DB_RUN_BUFFERED);
+
+  record_timing(conn, id, start, s ? (long long)db_backend_num_rows(s) : -1);
+  return s;
+}
+
+long long db_stmt_execute_ids(DbConn *conn, StmtId family, const int *lead,
+                              const int *ids, int count) {
+  if (bad_id_count(family, count))
+    return -1;
+
+  unsigned long long start = now_us();
+  int size;
+  StmtId id = ids_variant(family, count, &size);
+  DbStmt *s = run_ids(conn, id, size, lead, ids, count, DB_RUN_EXECUTE);
+
+  long long affected = s ? db_backend_affected_rows(s) : -1;
+  record_timing(conn, id, start, affected);
+  return affected;
+}
+
+long long db_stmt_execute_ids_after(DbConn *conn, StmtId family,
+                                    const int *ids, int count,
+                                    const char *types, ...) {
+  if (bad_id_count(family, count))
+    return -1;
+
+  unsigned long long start = now_us();
+  int size;
+  StmtId id = ids_variant(family, count, &size);
+
+  DbParam params[DB_STMT_MAX_BINDS];
+  va_list args;
+  va_start(args, types);
+  int n = collect_params(id, types, args, params);
+  va_end(args);
+
+  DbStmt *s = NULL;
+  if (n >= 0)
+    s = run_list(conn, id, params, n, size, ids, count, DB_RUN_EXECUTE);
+
+  long long affected = s ? db_backend_affected_rows(s) : -1;
+  record_timing(conn, id, start, affected);
+  return affected;
+}
+
+unsigned long long db_stmt_insert_id(DbConn *conn) {
+  return db_backend_insert_id(conn);
+}
+
+int db_stmt_conflict(DbConn *conn) {
+  return db_backend_conflict(conn->stmts.last_errno);
+}
+
+const char *db_stmt_sql(StmtId id, const char **params) {
+  if (params)
+    *params = catalog[id].params;
+  return catalog[id].sql;
+}
+
+// ============= FETCH =============
+DbRow db_stmt_fetch(DbStmt *s) {
+  DbRow row;
+  return s && db_backend_fetch(s, &row) == 0 ? row : NULL;
+}
+
+long long db_stmt_stream(DbConn *conn, StmtId id, DbRowFn on_row, void *arg,
+                         const char *types, ...) {
+  unsigned long long start = now_us();
+
+  va_list args;
+  va_start(args, types);
+  DbStmt *s = run(conn, id, DB_RUN_STREAM, types, args);
+  va_end(args);
+
+  if (!s) {
+    record_timing(conn, id, start, -1);
+    return -1;
+  }
+
+  long long rows = 0;
+  unsigned int columns = db_backend_columns(s);
+  DbRow row;
+  int rc;
+  while ((rc = db_backend_fetch(s, &row)) == 0) {
+    rows++;
+    if (on_row(row, columns, arg) != 0)
+      break;
+  }
+
+  if (rc < 0)
+    rows = -1;
+
+  // Also skips the rows left after an early stop, freeing the session
+  db_backend_free_result(s);
+
+  // Includes the time spent in on_row
+  record_timing(conn, id, start, rows);
+  return rows;
+}
+
+unsigned long long db_stmt_num_rows(DbStmt *s) {
+  return s ? db_backend_num_rows(s) : 0;
+}
+
+void db_stmt_done(DbStmt *s) {
+  if (s)
+    db_backend_free_result(s);
+}
@@ -0,0 +1,449 @@
+#include "free_slots.h"
+#include "db_stmt.h"
+#include "slot_index.h"
+#include "user_directory.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct FreeSlot {
+  int slot_id;
+  int teacher_id;
+  int slot_type;
+  int version;
+  int is_booked;
+  long long start;
+  long long end;
+  char *row; // the list row, rebuilt on every change
+  struct FreeSlot *next;
+} FreeSlot;
+
+// Free slots sorted by (start, slot_id)
+typedef struct {
+  FreeSlot **items;
+  int count;
+  int capacity;
+} SlotList;
+
+typedef struct Teacher {
+  int teacher_id;
+  SlotList free;
+  unsigned long long generation;
+  struct Teacher *next;
+} Teacher;
+
+static FreeSlot *slots[FREE_SLOTS_SLOT_BUCKETS];
+static Teacher *teachers[FREE_SLOTS_TEACHER_BUCKETS];
+static SlotList all_free;
+static unsigned long long all_generation;
+static time_t started;
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// A read-back holds its slot's lock from the query to applying the row, so a
+// delete can't land in between and be undone by the older row
+static pthread_mutex_t refresh_locks[FREE_SLOTS_REFRESH_LOCKS];
+static pthread_once_t refresh_locks_once = PTHREAD_ONCE_INIT;
+
+static void init_refresh_locks(void) {
+  for (int i = 0; i < FREE_SLOTS_REFRESH_LOCKS; i++)
+    pthread_mutex_init(&refresh_locks[i], NULL);
+}
+
+static pthread_mutex_t *refresh_lock(int slot_id) {
+  pthread_once(&refresh_locks_once, init_refresh_locks);
+  return &refresh_locks[(unsigned int)slot_id % FREE_SLOTS_REFRESH_LOCKS];
+}
+
+// ============= LOOKUP =============
+// Callers hold index_lock
+static FreeSlot **find_slot(int slot_id) {
+  FreeSlot **link = &slots[(unsigned int)slot_id % FREE_SLOTS_SLOT_BUCKETS];
+  while (*link && (*link)->slot_id != slot_id)
+    link = &(*link)->next;
+  return link;
+}
+
+// With create, a missing teacher is added (for writers only)
+static Teacher *find_teacher(int teacher_id, int create) {
+  unsigned int bucket = (unsigned int)teacher_id % FREE_SLOTS_TEACHER_BUCKETS;
+
+  Teacher *t = teachers[bucket];
+  while (t && t->teacher_id != teacher_id)
+    t = t->next;
+
+  if (t || !create)
+    return t;
+
+  t = calloc(1, sizeof(Teacher));
+  if (!t)
+    return NULL;
+  t->teacher_id = teacher_id;
+  t->next = teachers[bucket];
+  teachers[bucket] = t;
+  return t;
+}
+
+// ============= SORTED LISTS =============
+static int compare(const FreeSlot *a, const FreeSlot *b) {
+  if (a->start != b->start)
+    return a->start < b->start ? -1 : 1;
+  if (a->slot_id != b->slot_id)
+    return a->slot_id < b->slot_id ? -1 : 1;
+  return 0;
+}
+
+// Where slot is or would go
+static int position(const SlotList *list, const FreeSlot *slot) {
+  int low = 0, high = list->count;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (compare(list->items[mid], slot) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static int list_insert(SlotList *list, FreeSlot *slot) {
+  if (list->count == list->capacity) {
+    int capacity = list->capacity ? list->capacity * 2 : 64;
+    FreeSlot **grown = realloc(list->items, capacity * sizeof(FreeSlot *));
+    if (!grown)
+      return -1;
+    list->items = grown;
+    list->capacity = capacity;
+  }
+
+  int at = position(list, slot);
+  memmove(&list->items[at + 1], &list->items[at],
+          (list->count - at) * sizeof(FreeSlot *));
+  list->items[at] = slot;
+  list->count++;
+  return 0;
+}
+
+static void list_remove(SlotList *list, const FreeSlot *slot) {
+  int at = position(list, slot);
+  if (at == list->count || list->items[at] != slot)
+    return;
+
+  memmove(&list->items[at], &list->items[at + 1],
+          (list->count - at - 1) * sizeof(FreeSlot *));
+  list->count--;
+}
+
+// ============= SLOTS =============
+// Callers hold index_lock for writing
+static void show(FreeSlot *slot) {
+  Teacher *t = find_teacher(slot->teacher_id, 0);
+  if (list_insert(&all_free, slot) < 0 || !t ||
+      list_insert(&t->free, slot) < 0)
+    log_message("ERROR", "Free slots: out of memory, slot %d not listed",
+                slot->slot_id);
+
+  all_generation++;
+  if (t)
+    t->generation++;
+}
+
+static void hide(FreeSlot *slot) {
+  Teacher *t = find_teacher(slot->teacher_id, 0);
+  list_remove(&all_free, slot);
+  if (t)
+    list_remove(&t->free, slot);
+
+  all_generation++;
+  if (t)
+    t->generation++;
+}
+
+static void build_row(FreeSlot *slot) {
+  static const char *const type_names[] = {"Individual", "Group", "Both"};
+  const char *type = type_names[2];
+  if (slot->slot_type == 0 || slot->slot_type == 1)
+    type = type_names[slot->slot_type];
+
+  const char *teacher = user_directory_name(slot->teacher_id);
+  if (!teacher)
+    teacher = "";
+
+  char start_time[SLOT_TIME_SIZE], end_time[SLOT_TIME_SIZE];
+  slot_time_format(slot->start, start_time);
+  slot_time_format(slot->end, end_time);
+
+  char row[256];
+  snprintf(row, sizeof(row), "%d&%d&%s&%s&%s&%s&%d", slot->slot_id,
+           slot->teacher_id, teacher, start_time, end_time, type,
+           slot->version);
+
+  char *copy = strdup(row);
+  if (copy) {
+    free(slot->row);
+    slot->row = copy;
+  }
+}
+
+// Set a slot's state, adding it if new
+static void put_slot(const FreeSlot *state) {
+  FreeSlot **link = find_slot(state->slot_id);
+  FreeSlot *slot = *link;
+
+  if (slot) {
+    if (!slot->is_booked)
+      hide(slot);
+  } else {
+    slot = calloc(1, sizeof(FreeSlot));
+    if (!slot) {
+      log_message("ERROR", "Free slots: out of memory, slot %d not indexed",
+                  state->slot_id);
+      return;
+    }
+    *link = slot;
+  }
+
+  FreeSlot *next = slot->next;
+  char *row = slot->row;
+  *slot = *state;
+  slot->next = next;
+  slot->row = row;
+
+  build_row(slot);
+  if (!slot->is_booked)
+    show(slot);
+}
+
+static void drop_slot(int slot_id) {
+  FreeSlot **link = find_slot(slot_id);
+  FreeSlot *slot = *link;
+  if (!slot)
+    return;
+
+  if (!slot->is_booked)
+    hide(slot);
+  *link = slot->next;
+  free(slot->row);
+  free(slot);
+}
+
+// A slot as read from the database, applied unless older than the indexed one
+static int apply_slot(const FreeSlot *slot) {
+  if (!find_teacher(slot->teacher_id, 1))
+    return -1;
+
+  FreeSlot *known = *find_slot(slot->slot_id);
+  if (!known || known->version <= slot->version)
+    put_slot(slot);
+  return 0;
+}
+
+// ============= LOAD =============
+// Row: slot_id, teacher_id, start_time, end_time, slot_type, is_booked,
+// version. Returns 0, or -1 if the times don't parse (such a slot isn't in the
+// slot index either).
+static int parse_row(DbRow row, FreeSlot *slot) {
+  memset(slot, 0, sizeof(*slot));
+  slot->slot_id = atoi(row[0]);
+  slot->teacher_id = atoi(row[1]);
+  slot->slot_type = atoi(row[4]);
+  slot->is_booked = atoi(row[5]);
+  slot->version = atoi(row[6]);
+
+  if (!row[2] || !row[3] || slot_time_parse(row[2], &slot->start) < 0 ||
+      slot_time_parse(row[3], &slot->end) < 0)
+    return -1;
+  return 0;
+}
+
+// Caller holds index_lock for writing
+static int load_row(DbRow row, unsigned int columns, void *arg) {
+  (void)columns;
+  int *failed = arg;
+
+  FreeSlot slot;
+  if (parse_row(row, &slot) < 0)
+    return 0;
+
+  if (apply_slot(&slot) < 0) {
+    *failed = 1;
+    return 1;
+  }
+  return 0;
+}
+
+int free_slots_load(DbConn *conn) {
+  int failed = 0;
+
+  pthread_rwlock_wrlock(&index_lock);
+  started = time(NULL);
+  long long rows =
+      db_stmt_stream(conn, STMT_FREE_SLOTS_LOAD, load_row, &failed, "");
+  pthread_rwlock_unlock(&index_lock);
+
+  if (rows < 0 || failed) {
+    log_message("ERROR", "Free slots: loading failed");
+    free_slots_free();
+    return -1;
+  }
+
+  log_message("INFO", "Free slots: %d of %lld slots free", all_free.count,
+              rows);
+  return 0;
+}
+
+void free_slots_free(void) {
+  pthread_rwlock_wrlock(&index_lock);
+
+  for (int i = 0; i < FREE_SLOTS_SLOT_BUCKETS; i++) {
+    while (slots[i]) {
+      FreeSlot *slot = slots[i];
+      slots[i] = slot->next;
+      free(slot->row);
+      free(slot);
+    }
+  }
+
+  for (int i = 0; i < FREE_SLOTS_TEACHER_BUCKETS; i++) {
+    while (teachers[i]) {
+      Teacher *t = teachers[i];
+      teachers[i] = t->next;
+      free(t->free.items);
+      free(t);
+    }
+  }
+
+  free(all_free.items);
+  memset(&all_free, 0, sizeof(all_free));
+
+  pthread_rwlock_unlock(&index_lock);
+}
+
+// ============= WRITES =============
+void free_slots_add(int slot_id, int teacher_id, long long start,
+                    long long end, int slot_type) {
+  FreeSlot slot = {0};
+  slot.slot_id = slot_id;
+  slot.teacher_id = teacher_id;
+  slot.slot_type = slot_type;
+  slot.version = 1;
+  slot.start = start;
+  slot.end = end;
+
+  pthread_rwlock_wrlock(&index_lock);
+
+  // Already there if a booking read it back first
+  if (find_teacher(teacher_id, 1) && !*find_slot(slot_id))
+    put_slot(&slot);
+
+  pthread_rwlock_unlock(&index_lock);
+}
+
+int free_slots_update(DbConn *conn, int slot_id, long long start,
+                      long long end, int slot_type, int version) {
+  pthread_mutex_t *lock = refresh_lock(slot_id);
+  pthread_mutex_lock(lock);
+  pthread_rwlock_wrlock(&index_lock);
+
+  // Every write bumps the version, so only the version right before this one
+  // has the booking state the update left alone
+  FreeSlot *known = *find_slot(slot_id);
+  int applied = known && known->version >= version;
+  if (known && known->version == version - 1) {
+    FreeSlot slot = *known;
+    slot.start = start;
+    slot.end = end;
+    slot.slot_type = slot_type;
+    slot.version = version;
+    put_slot(&slot);
+    applied = 1;
+  }
+
+  pthread_rwlock_unlock(&index_lock);
+  pthread_mutex_unlock(lock);
+
+  // A write in between hasn't been applied yet: read the slot back
+  return applied ? 0 : free_slots_refresh(conn, slot_id);
+}
+
+void free_slots_remove(int slot_id) {
+  pthread_mutex_t *lock = refresh_lock(slot_id);
+  pthread_mutex_lock(lock);
+  pthread_rwlock_wrlock(&index_lock);
+  drop_slot(slot_id);
+  pthread_rwlock_unlock(&index_lock);
+  pthread_mutex_unlock(lock);
+}
+
+typedef struct {
+  int found;
+  FreeSlot slot;
+} ReadBack;
+
+static int read_back_row(DbRow row, unsigned int columns, void *arg) {
+  (void)columns;
+  ReadBack *read = arg;
+
+  if (parse_row(row, &read->slot) == 0)
+    read->found = 1;
+  return 0;
+}
+
+int free_slots_refresh(DbConn *conn, int slot_id) {
+  ReadBack read = {0};
+
+  // Readers only wait for the update, not for the query
+  pthread_mutex_t *lock = refresh_lock(slot_id);
+  pthread_mutex_lock(lock);
+  long long rows = db_stmt_stream(conn, STMT_FREE_SLOTS_ONE, read_back_row,
+                                  &read, "i", slot_id);
+
+  int rc = rows < 0 ? -1 : 0;
+  if (rows >= 0) {
+    pthread_rwlock_wrlock(&index_lock);
+    if (rows == 0)
+      drop_slot(slot_id);
+    else if (read.found)
+      rc = apply_slot(&read.slot);
+    pthread_rwlock_unlock(&index_lock);
+  }
+  pthread_mutex_unlock(lock);
+
+  if (rc < 0)
+    log_message("ERROR", "Free slots: slot %d not refreshed", slot_id);
+  return rc;
+}
+
+// ============= READS =============
+void free_slots_tag(int teacher_id, char *tag, size_t tag_size) {
+  pthread_rwlock_rdlock(&index_lock);
+
+  unsigned long long generation = all_generation;
+  if (teacher_id != 0) {
+    Teacher *t = find_teacher(teacher_id, 0);
+    generation = t ? t->generation : 0;
+  }
+  snprintf(tag, tag_size, "%lld.%llu", (long long)started, generation);
+
+  pthread_rwlock_unlock(&index_lock);
+}
+
+void free_slots_list(int teacher_id, ListPayload *list) {
+  pthread_rwlock_rdlock(&index_lock);
+
+  const SlotList *free_list = &all_free;
+  if (teacher_id != 0) {
+    Teacher *t = find_teacher(teacher_id, 0);
+    free_list = t ? &t->free : NULL;
+  }
+
+  for (int i = 0; free_list && i < free_list->count; i++) {
+    char *row = free_list->items[i]->row;
+    if (row && list_payload_add(&row, 1, list))
+      break;
+  }
+
+  pthread_rwlock_unlock(&index_lock);
+}
@@ -1,34 +1,36 @@
 #include "handler_auth.h"
 #include "auth.h"
-#include "database.h"
+#include "db_stmt.h"
+#include "user_directory.h"
 #include "utils.h"
 #include <stdlib.h>
 #include <string.h>
 
 // ============= REGISTER =============
-Response *handle_register(Request *req, MYSQL *db_conn) {
+Response *handle_register(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Parse data: username||password||role
-  int field_count;
-  char **fields = parse_data_fields(req->data, &field_count);
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_data_fields(req->data, &fields);
 
   if (field_count != 3) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "REGISTER_INVALID_FORMAT");
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  char *username = trim(fields[0]);
-  char *password = trim(fields[1]);
-  char *role = trim(fields[2]);
+  char *username = trim(fields.items[0].ptr);
+  char *password = trim(fields.items[1].ptr);
+  char *role = trim(fields.items[2].ptr);
 
   // Validate
   if (strlen(username) == 0 || strlen(password) == 0 || strlen(role) == 0) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "REGISTER_INVALID_FORMAT");
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
@@ -36,50 +38,51 @@ Response *handle_register(Request *req, MYSQL *db_conn) {
   if (strcmp(role, "student") != 0 && strcmp(role, "teacher") != 0) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "REGISTER_INVALID_ROLE");
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
   // Check username exists
-  char query[512];
-  snprintf(query, sizeof(query),
-           "SELECT user_id FROM users WHERE username='%s'", username);
-
-  MYSQL_RES *result = db_query(db_conn, query);
-  if (result && mysql_num_rows(result) > 0) {
+  DbStmt *result =
+      db_stmt_query(db_conn, STMT_USER_ID_BY_NAME, "s", username);
+  if (result && db_stmt_num_rows(result) > 0) {
     res->status_code = STATUS_USERNAME_EXISTS;
     strcpy(res->payload, "REGISTER_USERNAME_EXISTS");
-    mysql_free_result(result);
-    free_split(fields, field_count);
+    db_stmt_done(result);
+    free_field_list(&fields);
     return res;
   }
   if (result)
-    mysql_free_result(result);
+    db_stmt_done(result);
 
   // Hash password
   char *password_hash = hash_user_password(password);
 
   // Insert new user with selected role
-  snprintf(query, sizeof(query),
-           "INSERT INTO users (username, password_hash, role) VALUES ('%s', "
-           "'%s', '%s')",
-           username, password_hash, role);
-
-  int affected = db_execute(db_conn, query);
+  long long affected = db_stmt_execute(db_conn, STMT_USER_INSERT, "sss",
+                                       username, password_hash, role);
 
   if (affected <= 0) {
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "REGISTER_INTERNAL_ERROR");
     free(password_hash);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
   // Get user_id
-  int user_id = mysql_insert_id(db_conn);
+  int user_id = db_stmt_insert_id(db_conn);
+  user_directory_add(user_id, username, role);
 
   // Generate token with selected role
   char *token = generate_token(user_id, username, role);
+  if (!token) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "REGISTER_INTERNAL_ERROR");
+    free(password_hash);
+    free_field_list(&fields);
+    return res;
+  }
 
   // Build response: REGISTER_SUCCESS||<token>||<role>
   res->status_code = STATUS_OK;
@@ -92,48 +95,43 @@ Response *handle_register(Request *req, MYSQL *db_conn) {
   // Cleanup
   free(password_hash);
   free(token);
-  free_split(fields, field_count);
+  free_field_list(&fields);
 
   return res;
 }
 
 // ============= LOGIN =============
-Response *handle_login(Request *req, MYSQL *db_conn) {
+Response *handle_login(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Parse data: username&password
-  int field_count;
-  char **fields = parse_subfields(req->data, &field_count);
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_subfields(req->data, &fields);
 
   if (field_count != 2) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "LOGIN_INVALID_FORMAT");
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  char *username = trim(fields[0]);
-  char *password = trim(fields[1]);
+  char *username = trim(fields.items[0].ptr);
+  char *password = trim(fields.items[1].ptr);
 
   // Hash password
   char *password_hash = hash_user_password(password);
 
   // Query user
-  char query[512];
-  snprintf(query, sizeof(query),
-           "SELECT user_id, role FROM users WHERE username='%s' AND "
-           "password_hash='%s'",
-           username, password_hash);
-
-  MYSQL_RES *result = db_query(db_conn, query);
+  DbStmt *result = db_stmt_query(db_conn, STMT_USER_LOGIN, "ss", username,
+                                 password_hash);
 
-  if (!result || mysql_num_rows(result) == 0) {
+  if (!result || db_stmt_num_rows(result) == 0) {
     // Check if user exists
-    snprintf(query, sizeof(query),
-             "SELECT user_id FROM users WHERE username='%s'", username);
-    MYSQL_RES *check = db_query(db_conn, query);
+    DbStmt *check =
+        db_stmt_query(db_conn, STMT_USER_ID_BY_NAME, "s", username);
 
-    if (!check || mysql_num_rows(check) == 0) {
+    if (!check || db_stmt_num_rows(check) == 0) {
       res->status_code = STATUS_NOT_FOUND;
       strcpy(res->payload, "LOGIN_USER_NOT_FOUND");
     } else {
@@ -142,21 +140,29 @@ Response *handle_login(Request *req, MYSQL *db_conn) {
     }
 
     if (check)
-      mysql_free_result(check);
+      db_stmt_done(check);
     if (result)
-      mysql_free_result(result);
+      db_stmt_done(result);
     free(password_hash);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
   // Get user info
-  MYSQL_ROW row = mysql_fetch_row(result);
+  DbRow row = db_stmt_fetch(result);
   int user_id = atoi(row[0]);
   char *role = row[1];
 
   // Generate token
   char *token = generate_token(user_id, username, role);
+  if (!token) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "LOGIN_INTERNAL_ERROR");
+    db_stmt_done(result);
+    free(password_hash);
+    free_field_list(&fields);
+    return res;
+  }
 
   // Build response: LOGIN_SUCCESS||<token>||<role>
   res->status_code = STATUS_OK;
@@ -167,16 +173,16 @@ Response *handle_login(Request *req, MYSQL *db_conn) {
               role);
 
   // Cleanup
-  mysql_free_result(result);
+  db_stmt_done(result);
   free(password_hash);
   free(token);
-  free_split(fields, field_count);
+  free_field_list(&fields);
 
   return res;
 }
 
 // ============= LOGOUT =============
-Response *handle_logout(Request *req, MYSQL *db_conn) {
+Response *handle_logout(Request *req, DbConn *db_conn) {
   (void)db_conn; // Unused
 
   Response *res = calloc(1, sizeof(Response));
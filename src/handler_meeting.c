@@ -1,13 +1,242 @@
 #include "handler_meeting.h"
 #include "auth.h"
-#include "database.h"
+#include "change_version.h"
+#include "db_stmt.h"
+#include "free_slots.h"
+#include "minutes.h"
+#include "user_directory.h"
 #include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// ============= SLOT CLAIM =============
+typedef enum {
+  CLAIM_OK,
+  CLAIM_NOT_FOUND,
+  CLAIM_NOT_SUITABLE,
+  CLAIM_NOT_FREE,
+  CLAIM_CHANGED,
+  CLAIM_ERROR
+} ClaimResult;
+
+// Book slot_id inside the caller's transaction. One conditional UPDATE checks
+// and books the slot, so two students can't both get it; only a failed claim
+// reads the slot to tell why. wrong_type is the slot_type this kind of
+// booking can't use; version is the slot's row version the student listed,
+// 0 to book it whatever changed since.
+static ClaimResult claim_slot(DbConn *db_conn, int slot_id, int wrong_type,
+                              int version, int *teacher_id) {
+  long long affected = db_stmt_execute(db_conn, STMT_SLOT_CLAIM, "iiii",
+                                       slot_id, wrong_type, version, version);
+
+  if (affected == 1) {
+    *teacher_id = (int)db_stmt_insert_id(db_conn);
+    return CLAIM_OK;
+  }
+
+  if (affected < 0) {
+    // Another booking holds the row: report it taken instead of waiting
+    if (db_stmt_conflict(db_conn))
+      return CLAIM_NOT_FREE;
+    return CLAIM_ERROR;
+  }
+
+  DbStmt *result =
+      db_stmt_query(db_conn, STMT_SLOT_FOR_BOOKING, "i", slot_id);
+  if (!result)
+    return CLAIM_ERROR;
+
+  ClaimResult claim = CLAIM_NOT_FOUND;
+  DbRow row = db_stmt_fetch(result);
+  if (row) {
+    if (atoi(row[0]) == wrong_type)
+      claim = CLAIM_NOT_SUITABLE;
+    else if (!atoi(row[1]) && version && atoi(row[2]) != version)
+      claim = CLAIM_CHANGED; // moved or retyped since the student listed it
+    else
+      claim = CLAIM_NOT_FREE;
+  }
+  db_stmt_done(result);
+
+  return claim;
+}
+
+// Insert the meeting and its organizer as a participant, inside the caller's
+// transaction. Returns the meeting id, -1 on error.
+static int create_meeting(DbConn *db_conn, int slot_id, int student_id,
+                          int is_group) {
+  if (db_stmt_execute(db_conn, STMT_MEETING_INSERT, "iii", slot_id,
+                      student_id, is_group) <= 0)
+    return -1;
+
+  int meeting_id = (int)db_stmt_insert_id(db_conn);
+
+  if (db_stmt_execute(db_conn, STMT_ORGANIZER_ADD, "ii", meeting_id,
+                      student_id) <= 0)
+    return -1;
+
+  return meeting_id;
+}
+
+// Count the meeting on the teacher's roster for every participant, inside the
+// caller's transaction. Returns 0 on success, -1 on error.
+static int add_to_roster(DbConn *db_conn, int teacher_id, int meeting_id) {
+  if (db_stmt_execute(db_conn, STMT_ROSTER_ADD, "ii", teacher_id,
+                      meeting_id) < 0)
+    return -1;
+  return 0;
+}
+
+static void set_claim_error(Response *res, ClaimResult claim,
+                            const char *command) {
+  const char *reason;
+
+  switch (claim) {
+  case CLAIM_NOT_FOUND:
+    res->status_code = STATUS_NOT_FOUND;
+    reason = "SLOT_NOT_FOUND";
+    break;
+  case CLAIM_NOT_SUITABLE:
+    res->status_code = STATUS_FORBIDDEN;
+    reason = "SLOT_NOT_SUITABLE";
+    break;
+  case CLAIM_NOT_FREE:
+    res->status_code = STATUS_CONFLICT;
+    reason = "SLOT_NOT_FREE";
+    break;
+  case CLAIM_CHANGED:
+    res->status_code = STATUS_CONFLICT;
+    reason = "SLOT_CHANGED";
+    break;
+  default:
+    res->status_code = STATUS_INTERNAL_ERROR;
+    reason = "INTERNAL_ERROR";
+    break;
+  }
+
+  snprintf(res->payload, sizeof(res->payload), "%s_%s", command, reason);
+}
+
+// ============= DATE FILTERS =============
+// LIST_MEETINGS / LIST_APPOINTMENTS filters, resolved here into a half-open
+// [from, to) range on start_time so the query can range-scan the index:
+//   ""                        everything
+//   date[&+HH:MM]             today
+//   week[&+HH:MM]             this week, Monday to Monday
+//   range&YYYY-MM-DD&YYYY-MM-DD  both days included
+// The UTC offset picks the client's calendar day (default: server local
+// time); slot times are stored as wall-clock times and compared as they are.
+#define DATE_BOUND_SIZE 20 // "YYYY-MM-DD 00:00:00"
+
+typedef struct {
+  int is_set;   // 0: no date filter
+  int relative; // today / this week: moves on with the calendar
+  char from[DATE_BOUND_SIZE];
+  char to[DATE_BOUND_SIZE];
+} DateRange;
+
+// Midnight starting the day `add_days` after year-month-day
+static void format_day(int year, int month, int day, int add_days,
+                       char *out) {
+  struct tm tm = {0};
+  tm.tm_year = year - 1900;
+  tm.tm_mon = month - 1;
+  tm.tm_mday = day + add_days;
+
+  time_t t = timegm(&tm);
+  gmtime_r(&t, &tm);
+  strftime(out, DATE_BOUND_SIZE, "%Y-%m-%d 00:00:00", &tm);
+}
+
+// "YYYY-MM-DD" naming a real day
+static int parse_day(const char *text, int *year, int *month, int *day) {
+  int len = 0;
+  if (sscanf(text, "%4d-%2d-%2d%n", year, month, day, &len) != 3 ||
+      text[len] != '\0')
+    return -1;
+
+  char check[DATE_BOUND_SIZE], expect[DATE_BOUND_SIZE];
+  format_day(*year, *month, *day, 0, check);
+  snprintf(expect, sizeof(expect), "%04d-%02d-%02d 00:00:00", *year, *month,
+           *day);
+  return strcmp(check, expect) == 0 ? 0 : -1;
+}
+
+// "+HH:MM" / "-HH:MM" as seconds east of UTC
+static int parse_utc_offset(const char *text, long *offset) {
+  int hours = 0, minutes = 0, len = 0;
+  if ((text[0] != '+' && text[0] != '-') ||
+      sscanf(text + 1, "%2d:%2d%n", &hours, &minutes, &len) != 2 ||
+      text[len + 1] != '\0' || hours > 14 || minutes > 59)
+    return -1;
+
+  *offset = (hours * 3600L + minutes * 60L) * (text[0] == '-' ? -1 : 1);
+  return 0;
+}
+
+// Returns 0 on success, -1 for a malformed filter
+static int parse_date_filter(const char *filter, DateRange *range) {
+  memset(range, 0, sizeof(*range));
+  if (!filter || filter[0] == '\0')
+    return 0;
+
+  char copy[128];
+  if (strlen(filter) >= sizeof(copy))
+    return -1;
+  strcpy(copy, filter);
+
+  StrView field_buf[4];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int count = parse_subfields(copy, &fields);
+  int rc = -1;
+
+  if (count >= 1 && count <= 2 &&
+      (strcmp(fields.items[0].ptr, "date") == 0 ||
+       strcmp(fields.items[0].ptr, "week") == 0)) {
+    time_t now = time(NULL);
+    struct tm today;
+    long offset = 0;
+
+    if (count == 2) {
+      if (parse_utc_offset(fields.items[1].ptr, &offset) == 0) {
+        now += offset;
+        gmtime_r(&now, &today);
+        rc = 0;
+      }
+    } else {
+      localtime_r(&now, &today);
+      rc = 0;
+    }
+
+    if (rc == 0) {
+      int is_week = fields.items[0].ptr[0] == 'w';
+      int start = is_week ? -((today.tm_wday + 6) % 7) : 0; // back to Monday
+      int year = today.tm_year + 1900, month = today.tm_mon + 1;
+
+      format_day(year, month, today.tm_mday, start, range->from);
+      format_day(year, month, today.tm_mday, start + (is_week ? 7 : 1),
+                 range->to);
+      range->is_set = 1;
+      range->relative = 1;
+    }
+  } else if (count == 3 && strcmp(fields.items[0].ptr, "range") == 0) {
+    int y1, m1, d1, y2, m2, d2;
+    if (parse_day(fields.items[1].ptr, &y1, &m1, &d1) == 0 &&
+        parse_day(fields.items[2].ptr, &y2, &m2, &d2) == 0) {
+      format_day(y1, m1, d1, 0, range->from);
+      format_day(y2, m2, d2, 1, range->to);
+      range->is_set = 1;
+      rc = strcmp(range->from, range->to) < 0 ? 0 : -1;
+    }
+  }
+
+  free_field_list(&fields);
+  return rc;
+}
+
 // ============= BOOK_INDIVIDUAL =============
-Response *handle_book_individual(Request *req, MYSQL *db_conn) {
+Response *handle_book_individual(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Validate token
@@ -26,8 +255,14 @@ Response *handle_book_individual(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  // Parse data: slot_id only
-  int slot_id = atoi(trim(req->data));
+  // Parse data: slot_id[&version]
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_subfields(req->data, &fields);
+
+  int slot_id = field_count > 0 ? atoi(trim(fields.items[0].ptr)) : 0;
+  int version = field_count > 1 ? atoi(trim(fields.items[1].ptr)) : 0;
+  free_field_list(&fields);
 
   if (slot_id <= 0) {
     res->status_code = STATUS_BAD_REQUEST;
@@ -36,66 +271,47 @@ Response *handle_book_individual(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  // Check slot exists, not booked, and allows individual
-  char query[1024];
-  snprintf(query, sizeof(query),
-           "SELECT slot_type, is_booked, teacher_id FROM slots "
-           "WHERE slot_id=%d",
-           slot_id);
-
-  MYSQL_RES *result = db_query(db_conn, query);
-
-  if (!result || mysql_num_rows(result) == 0) {
-    res->status_code = STATUS_NOT_FOUND;
-    strcpy(res->payload, "BOOK_INDIVIDUAL_SLOT_NOT_FOUND");
-    if (result)
-      mysql_free_result(result);
+  // Claim the slot and create the meeting in one transaction
+  if (db_begin(db_conn) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "BOOK_INDIVIDUAL_INTERNAL_ERROR");
     free_token_data(token_data);
     return res;
   }
 
-  MYSQL_ROW row = mysql_fetch_row(result);
-  int slot_type = atoi(row[0]);
-  int is_booked = atoi(row[1]);
-  int teacher_id = atoi(row[2]);
-  mysql_free_result(result);
+  // Group-only slots (type 1) can't be booked individually
+  int teacher_id = 0;
+  ClaimResult claim = claim_slot(db_conn, slot_id, 1, version, &teacher_id);
 
-  // Check if slot allows individual (type 0 or 2)
-  if (slot_type == 1) {
-    res->status_code = STATUS_FORBIDDEN;
-    strcpy(res->payload, "BOOK_INDIVIDUAL_SLOT_NOT_SUITABLE");
+  if (claim != CLAIM_OK) {
+    db_rollback(db_conn);
+    set_claim_error(res, claim, "BOOK_INDIVIDUAL");
     free_token_data(token_data);
     return res;
   }
 
-  if (is_booked) {
-    res->status_code = STATUS_CONFLICT;
-    strcpy(res->payload, "BOOK_INDIVIDUAL_SLOT_NOT_FREE");
+  int meeting_id = create_meeting(db_conn, slot_id, token_data->user_id, 0);
+
+  if (meeting_id < 0 || add_to_roster(db_conn, teacher_id, meeting_id) < 0) {
+    db_rollback(db_conn);
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "BOOK_INDIVIDUAL_INTERNAL_ERROR");
     free_token_data(token_data);
     return res;
   }
 
-  // Create meeting
-  snprintf(query, sizeof(query),
-           "INSERT INTO meetings (slot_id, student_id, is_group) "
-           "VALUES (%d, %d, 0)",
-           slot_id, token_data->user_id);
+  int changed[] = {teacher_id, token_data->user_id};
+  bump_change_versions(db_conn, changed, 2);
+  log_slot_change(db_conn, teacher_id, slot_id);
 
-  int affected = db_execute(db_conn, query);
-
-  if (affected <= 0) {
+  if (db_commit(db_conn) < 0) {
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "BOOK_INDIVIDUAL_INTERNAL_ERROR");
     free_token_data(token_data);
     return res;
   }
 
-  int meeting_id = mysql_insert_id(db_conn);
-
-  // Mark slot as booked
-  snprintf(query, sizeof(query),
-           "UPDATE slots SET is_booked=1 WHERE slot_id=%d", slot_id);
-  db_execute(db_conn, query);
+  free_slots_refresh(db_conn, slot_id);
 
   // Build response: BOOK_INDIVIDUAL_SUCCESS||meeting_id
   res->status_code = STATUS_OK;
@@ -112,7 +328,39 @@ Response *handle_book_individual(Request *req, MYSQL *db_conn) {
 }
 
 // ============= BOOK_GROUP =============
-Response *handle_book_group(Request *req, MYSQL *db_conn) {
+_Static_assert(MAX_GROUP_MEMBERS <= DB_STMT_MAX_IDS,
+               "group members must fit one id-list statement");
+
+// Members that are not existing students, as "id,id,..." (one query, only
+// run when a booking is rejected)
+static void find_invalid_members(DbConn *db_conn, const int *member_ids,
+                                 int member_count, char *out, size_t size) {
+  int valid[MAX_GROUP_MEMBERS] = {0};
+
+  DbStmt *result = db_stmt_query_ids(db_conn, STMT_STUDENTS_IN_8, NULL,
+                                     member_ids, member_count);
+  if (result) {
+    DbRow row;
+    while ((row = db_stmt_fetch(result))) {
+      int student_id = atoi(row[0]);
+      for (int i = 0; i < member_count; i++) {
+        if (member_ids[i] == student_id)
+          valid[i] = 1;
+      }
+    }
+    db_stmt_done(result);
+  }
+
+  size_t len = 0;
+  out[0] = '\0';
+  for (int i = 0; i < member_count && len < size; i++) {
+    if (!valid[i])
+      len += snprintf(out + len, size - len, "%s%d", len > 0 ? "," : "",
+                      member_ids[i]);
+  }
+}
+
+Response *handle_book_group(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Validate token
@@ -131,125 +379,148 @@ Response *handle_book_group(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  // Parse data: slot_id&member_id|member_id|...
-  int field_count;
-  char **fields = parse_subfields(req->data, &field_count);
+  // Parse data: slot_id&member_id|member_id|...[&version]
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_subfields(req->data, &fields);
 
   if (field_count < 1) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "BOOK_GROUP_INVALID_FORMAT");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  int slot_id = atoi(trim(fields[0]));
+  int slot_id = atoi(trim(fields.items[0].ptr));
+  int version = field_count > 2 ? atoi(trim(fields.items[2].ptr)) : 0;
 
   if (slot_id <= 0) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "BOOK_GROUP_INVALID_SLOT_ID");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  // Parse member IDs (if provided)
-  int *member_ids = NULL;
+  // Parse member IDs (if provided), without duplicates or the leader
+  int member_ids[MAX_GROUP_MEMBERS];
   int member_count = 0;
+  int too_many = 0;
 
   if (field_count > 1) {
-    int sub_count;
-    char **members = split_string(fields[1], "|", &sub_count);
-    member_ids = malloc(sizeof(int) * sub_count);
-
-    for (int i = 0; i < sub_count; i++) {
-      member_ids[member_count++] = atoi(trim(members[i]));
+    StrView member_buf[FIELD_LIST_INLINE];
+    FieldList members = FIELD_LIST_INIT(member_buf);
+    int sub_count = split_fields(fields.items[1].ptr, "|", 0, &members);
+
+    for (int i = 0; i < sub_count && !too_many; i++) {
+      // Empty fields ("2||3") carry no member
+      int member_id = atoi(trim(members.items[i].ptr));
+      if (member_id <= 0 || member_id == token_data->user_id)
+        continue;
+
+      int seen = 0;
+      for (int j = 0; j < member_count && !seen; j++)
+        seen = (member_ids[j] == member_id);
+      if (seen)
+        continue;
+
+      if (member_count == MAX_GROUP_MEMBERS)
+        too_many = 1;
+      else
+        member_ids[member_count++] = member_id;
     }
 
-    free_split(members, sub_count);
+    free_field_list(&members);
   }
 
-  // Check slot exists and allows group
-  char query[1024];
-  snprintf(query, sizeof(query),
-           "SELECT slot_type, is_booked, teacher_id FROM slots "
-           "WHERE slot_id=%d",
-           slot_id);
+  free_field_list(&fields);
 
-  MYSQL_RES *result = db_query(db_conn, query);
+  if (too_many) {
+    res->status_code = STATUS_BAD_REQUEST;
+    snprintf(res->payload, sizeof(res->payload),
+             "BOOK_GROUP_TOO_MANY_MEMBERS||%d", MAX_GROUP_MEMBERS);
+    free_token_data(token_data);
+    return res;
+  }
 
-  if (!result || mysql_num_rows(result) == 0) {
-    res->status_code = STATUS_NOT_FOUND;
-    strcpy(res->payload, "BOOK_GROUP_SLOT_NOT_FOUND");
-    if (result)
-      mysql_free_result(result);
+  // Claim the slot, create the meeting and add the members in one
+  // transaction: a constant number of statements whatever the group size
+  if (db_begin(db_conn) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "BOOK_GROUP_INTERNAL_ERROR");
     free_token_data(token_data);
-    free_split(fields, field_count);
-    if (member_ids)
-      free(member_ids);
     return res;
   }
 
-  MYSQL_ROW row = mysql_fetch_row(result);
-  int slot_type = atoi(row[0]);
-  int is_booked = atoi(row[1]);
-  int teacher_id = atoi(row[2]);
-  mysql_free_result(result);
+  // Individual-only slots (type 0) can't take a group
+  int teacher_id = 0;
+  ClaimResult claim = claim_slot(db_conn, slot_id, 0, version, &teacher_id);
 
-  // Check if slot allows group (type 1 or 2)
-  if (slot_type == 0) {
-    res->status_code = STATUS_FORBIDDEN;
-    strcpy(res->payload, "BOOK_GROUP_SLOT_NOT_SUITABLE");
+  if (claim != CLAIM_OK) {
+    db_rollback(db_conn);
+    set_claim_error(res, claim, "BOOK_GROUP");
     free_token_data(token_data);
-    free_split(fields, field_count);
-    if (member_ids)
-      free(member_ids);
     return res;
   }
 
-  if (is_booked) {
-    res->status_code = STATUS_CONFLICT;
-    strcpy(res->payload, "BOOK_GROUP_SLOT_NOT_FREE");
+  int meeting_id = create_meeting(db_conn, slot_id, token_data->user_id, 1);
+
+  if (meeting_id < 0) {
+    db_rollback(db_conn);
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "BOOK_GROUP_INTERNAL_ERROR");
     free_token_data(token_data);
-    free_split(fields, field_count);
-    if (member_ids)
-      free(member_ids);
     return res;
   }
 
-  // Create meeting
-  snprintf(query, sizeof(query),
-           "INSERT INTO meetings (slot_id, student_id, is_group) "
-           "VALUES (%d, %d, 1)",
-           slot_id, token_data->user_id);
-
-  int affected = db_execute(db_conn, query);
+  // Insert group members; only existing students are inserted, so a short
+  // count means some IDs were invalid
+  if (member_count > 0) {
+    long long affected =
+        db_stmt_execute_ids(db_conn, STMT_GROUP_MEMBERS_ADD_8, &meeting_id,
+                            member_ids, member_count);
+
+    if (affected != member_count) {
+      if (affected < 0) {
+        res->status_code = STATUS_INTERNAL_ERROR;
+        strcpy(res->payload, "BOOK_GROUP_INTERNAL_ERROR");
+      } else {
+        char invalid[512];
+        find_invalid_members(db_conn, member_ids, member_count, invalid,
+                             sizeof(invalid));
+        res->status_code = STATUS_BAD_REQUEST;
+        snprintf(res->payload, sizeof(res->payload),
+                 "BOOK_GROUP_INVALID_MEMBERS||%s", invalid);
+      }
+
+      db_rollback(db_conn);
+      free_token_data(token_data);
+      return res;
+    }
+  }
 
-  if (affected <= 0) {
+  if (add_to_roster(db_conn, teacher_id, meeting_id) < 0) {
+    db_rollback(db_conn);
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "BOOK_GROUP_INTERNAL_ERROR");
     free_token_data(token_data);
-    free_split(fields, field_count);
-    if (member_ids)
-      free(member_ids);
     return res;
   }
 
-  int meeting_id = mysql_insert_id(db_conn);
+  // Leader and members are all participants of the slot by now
+  bump_change_versions(db_conn, &teacher_id, 1);
+  bump_slot_participant_versions(db_conn, slot_id);
+  log_slot_change(db_conn, teacher_id, slot_id);
 
-  // Insert group members
-  for (int i = 0; i < member_count; i++) {
-    snprintf(query, sizeof(query),
-             "INSERT INTO group_members (meeting_id, student_id) "
-             "VALUES (%d, %d)",
-             meeting_id, member_ids[i]);
-    db_execute(db_conn, query);
+  if (db_commit(db_conn) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "BOOK_GROUP_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
   }
 
-  // Mark slot as booked
-  snprintf(query, sizeof(query),
-           "UPDATE slots SET is_booked=1 WHERE slot_id=%d", slot_id);
-  db_execute(db_conn, query);
+  free_slots_refresh(db_conn, slot_id);
 
   // Build response: BOOK_GROUP_SUCCESS||meeting_id
   res->status_code = STATUS_OK;
@@ -262,15 +533,12 @@ Response *handle_book_group(Request *req, MYSQL *db_conn) {
 
   // Cleanup
   free_token_data(token_data);
-  free_split(fields, field_count);
-  if (member_ids)
-    free(member_ids);
 
   return res;
 }
 
 // ============= CANCEL_MEETING =============
-Response *handle_cancel_meeting(Request *req, MYSQL *db_conn) {
+Response *handle_cancel_meeting(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Validate token
@@ -285,27 +553,23 @@ Response *handle_cancel_meeting(Request *req, MYSQL *db_conn) {
   int meeting_id = atoi(trim(req->data));
 
   // Check meeting exists and belongs to student
-  char query[512];
-  snprintf(query, sizeof(query),
-           "SELECT slot_id, student_id FROM meetings "
-           "WHERE meeting_id=%d AND status='pending'",
-           meeting_id);
-
-  MYSQL_RES *result = db_query(db_conn, query);
+  DbStmt *result =
+      db_stmt_query(db_conn, STMT_MEETING_FOR_CANCEL, "i", meeting_id);
 
-  if (!result || mysql_num_rows(result) == 0) {
+  if (!result || db_stmt_num_rows(result) == 0) {
     res->status_code = STATUS_NOT_FOUND;
     strcpy(res->payload, "CANCEL_MEETING_NOT_FOUND");
     if (result)
-      mysql_free_result(result);
+      db_stmt_done(result);
     free_token_data(token_data);
     return res;
   }
 
-  MYSQL_ROW row = mysql_fetch_row(result);
+  DbRow row = db_stmt_fetch(result);
   int slot_id = atoi(row[0]);
   int student_id = atoi(row[1]);
-  mysql_free_result(result);
+  int teacher_id = atoi(row[2]);
+  db_stmt_done(result);
 
   // Check permission
   if (token_data->user_id != student_id) {
@@ -315,24 +579,56 @@ Response *handle_cancel_meeting(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  // Update meeting status
-  snprintf(query, sizeof(query),
-           "UPDATE meetings SET status='cancelled' WHERE meeting_id=%d",
-           meeting_id);
+  // Meeting, slot and roster change together or not at all
+  if (db_begin(db_conn) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "CANCEL_MEETING_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
+  }
 
-  int affected = db_execute(db_conn, query);
+  // Only a pending meeting is cancelled: of two concurrent cancels, the
+  // second matches no row
+  long long affected =
+      db_stmt_execute(db_conn, STMT_MEETING_CANCEL, "i", meeting_id);
 
-  if (affected <= 0) {
+  if (affected != 1) {
+    db_rollback(db_conn);
+    if (affected == 0) {
+      res->status_code = STATUS_NOT_FOUND;
+      strcpy(res->payload, "CANCEL_MEETING_NOT_FOUND");
+    } else {
+      res->status_code = STATUS_INTERNAL_ERROR;
+      strcpy(res->payload, "CANCEL_MEETING_INTERNAL_ERROR");
+    }
+    free_token_data(token_data);
+    return res;
+  }
+
+  // Mark slot as free; the participants keep their roster rows, one meeting
+  // fewer
+  if (db_stmt_execute(db_conn, STMT_SLOT_SET_BOOKED, "ii", 0, slot_id) != 1 ||
+      db_stmt_execute(db_conn, STMT_ROSTER_DROP, "ii", teacher_id,
+                      meeting_id) < 0) {
+    db_rollback(db_conn);
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "CANCEL_MEETING_INTERNAL_ERROR");
     free_token_data(token_data);
     return res;
   }
 
-  // Mark slot as free
-  snprintf(query, sizeof(query),
-           "UPDATE slots SET is_booked=0 WHERE slot_id=%d", slot_id);
-  db_execute(db_conn, query);
+  bump_change_versions(db_conn, &teacher_id, 1);
+  bump_slot_participant_versions(db_conn, slot_id);
+  log_slot_change(db_conn, teacher_id, slot_id);
+
+  if (db_commit(db_conn) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "CANCEL_MEETING_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
+  }
+
+  free_slots_refresh(db_conn, slot_id);
 
   // Success
   res->status_code = STATUS_OK;
@@ -347,7 +643,7 @@ Response *handle_cancel_meeting(Request *req, MYSQL *db_conn) {
 }
 
 // ============= LIST_MEETINGS (Student) =============
-Response *handle_list_meetings(Request *req, MYSQL *db_conn) {
+Response *handle_list_meetings(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Validate token
@@ -358,116 +654,66 @@ Response *handle_list_meetings(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  // Parse filter: "date" = today, "week" = this week, "" = all
-  char *filter = req->data;
-
-  // Build query with filter - include both organizer and group members
-  char query[2048];
-
-  if (filter && strcmp(filter, "date") == 0) {
-    // Filter: Today only
-    snprintf(
-        query, sizeof(query),
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON s.teacher_id = u.user_id "
-        "WHERE m.student_id=%d AND m.status='pending' "
-        "AND DATE(s.start_time) = CURDATE() "
-        "UNION "
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON s.teacher_id = u.user_id "
-        "JOIN group_members gm ON m.meeting_id = gm.meeting_id "
-        "WHERE gm.student_id=%d AND m.status='pending' "
-        "AND DATE(s.start_time) = CURDATE() "
-        "ORDER BY start_time",
-        token_data->user_id, token_data->user_id);
-  } else if (filter && strcmp(filter, "week") == 0) {
-    // Filter: This week
-    snprintf(
-        query, sizeof(query),
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON s.teacher_id = u.user_id "
-        "WHERE m.student_id=%d AND m.status='pending' "
-        "AND YEARWEEK(s.start_time, 1) = YEARWEEK(CURDATE(), 1) "
-        "UNION "
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON s.teacher_id = u.user_id "
-        "JOIN group_members gm ON m.meeting_id = gm.meeting_id "
-        "WHERE gm.student_id=%d AND m.status='pending' "
-        "AND YEARWEEK(s.start_time, 1) = YEARWEEK(CURDATE(), 1) "
-        "ORDER BY start_time",
-        token_data->user_id, token_data->user_id);
-  } else {
-    // No filter: All meetings
-    snprintf(
-        query, sizeof(query),
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON s.teacher_id = u.user_id "
-        "WHERE m.student_id=%d AND m.status='pending' "
-        "UNION "
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON s.teacher_id = u.user_id "
-        "JOIN group_members gm ON m.meeting_id = gm.meeting_id "
-        "WHERE gm.student_id=%d AND m.status='pending' "
-        "ORDER BY start_time",
-        token_data->user_id, token_data->user_id);
-  }
-
-  MYSQL_RES *result = db_query(db_conn, query);
-
-  if (!result) {
-    res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "LIST_MEETINGS_INTERNAL_ERROR");
+  // Parse filter: "date" = today, "week" = this week, "range" = days, "" = all
+  char client_tag[VERSION_TAG_SIZE], tag[VERSION_TAG_SIZE] = "";
+  int has_tag = take_version_tag(req->data, client_tag, sizeof(client_tag));
+
+  DateRange range;
+  if (parse_date_filter(req->data, &range) < 0) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "LIST_MEETINGS_INVALID_FILTER");
     free_token_data(token_data);
     return res;
   }
 
-  // Build response: meeting_id&date&time&teacher&is_group|...
-  char payload[4096] = "LIST_MEETINGS_SUCCESS||";
-  int first = 1;
+  current_version_tag(db_conn, token_data->user_id,
+                      range.relative ? range.from : NULL, tag, sizeof(tag));
+  if (has_tag && tag[0] && strcmp(client_tag, tag) == 0) {
+    res->status_code = STATUS_NOT_MODIFIED;
+    snprintf(res->payload, sizeof(res->payload),
+             "LIST_MEETINGS_NOT_MODIFIED||" VERSION_FIELD "%s", tag);
+    free_token_data(token_data);
+    return res;
+  }
 
-  MYSQL_ROW row;
-  while ((row = mysql_fetch_row(result))) {
-    if (!first)
-      strcat(payload, "||");
+  char header[48 + VERSION_TAG_SIZE] = "LIST_MEETINGS_SUCCESS";
+  if (tag[0])
+    snprintf(header, sizeof(header),
+             "LIST_MEETINGS_SUCCESS||" VERSION_FIELD "%s", tag);
 
-    char meeting_str[512];
-    snprintf(meeting_str, sizeof(meeting_str), "%s&%s&%s&%s&%s", row[0], row[1],
-             row[2], row[3], row[4]);
-    strcat(payload, meeting_str);
+  // meeting_id&start&end&teacher&is_group per row, written as fetched.
+  // Include both organizer and group members.
+  ListPayload list;
+  list_payload_init(&list, res, header);
+  NamedRows named = {&list, 3};
 
-    first = 0;
-  }
+  int user_id = token_data->user_id;
+  long long rows =
+      range.is_set
+          ? db_stmt_stream(db_conn, STMT_MEETINGS_RANGE,
+                           user_directory_list_add, &named, "iss", user_id,
+                           range.from, range.to)
+          : db_stmt_stream(db_conn, STMT_MEETINGS_ALL, user_directory_list_add,
+                           &named, "i", user_id);
 
-  if (first) {
-    strcpy(payload, "LIST_MEETINGS_SUCCESS||EMPTY");
+  if (rows < 0 || list_payload_finish(&list) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "LIST_MEETINGS_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
   }
 
   res->status_code = STATUS_OK;
-  strcpy(res->payload, payload);
 
   log_message("INFO", "Listed meetings for student_id=%d", token_data->user_id);
 
-  // Cleanup
-  mysql_free_result(result);
   free_token_data(token_data);
 
   return res;
 }
 
 // ============= LIST_APPOINTMENTS (Teacher) =============
-Response *handle_list_appointments(Request *req, MYSQL *db_conn) {
+Response *handle_list_appointments(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Validate token
@@ -486,94 +732,66 @@ Response *handle_list_appointments(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  // Parse filter: "date" = today, "week" = this week, "" = all
-  char *filter = req->data;
-
-  // Build query with filter
-  char query[1024];
-
-  if (filter && strcmp(filter, "date") == 0) {
-    // Filter: Today only
-    snprintf(
-        query, sizeof(query),
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON m.student_id = u.user_id "
-        "WHERE s.teacher_id=%d AND m.status='pending' "
-        "AND DATE(s.start_time) = CURDATE() "
-        "ORDER BY s.start_time",
-        token_data->user_id);
-  } else if (filter && strcmp(filter, "week") == 0) {
-    // Filter: This week
-    snprintf(
-        query, sizeof(query),
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON m.student_id = u.user_id "
-        "WHERE s.teacher_id=%d AND m.status='pending' "
-        "AND YEARWEEK(s.start_time, 1) = YEARWEEK(CURDATE(), 1) "
-        "ORDER BY s.start_time",
-        token_data->user_id);
-  } else {
-    // No filter: All appointments
-    snprintf(
-        query, sizeof(query),
-        "SELECT m.meeting_id, s.start_time, s.end_time, u.username, m.is_group "
-        "FROM meetings m "
-        "JOIN slots s ON m.slot_id = s.slot_id "
-        "JOIN users u ON m.student_id = u.user_id "
-        "WHERE s.teacher_id=%d AND m.status='pending' "
-        "ORDER BY s.start_time",
-        token_data->user_id);
-  }
-
-  MYSQL_RES *result = db_query(db_conn, query);
-
-  if (!result) {
-    res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "LIST_APPOINTMENTS_INTERNAL_ERROR");
+  // Parse filter: "date" = today, "week" = this week, "range" = days, "" = all
+  char client_tag[VERSION_TAG_SIZE], tag[VERSION_TAG_SIZE] = "";
+  int has_tag = take_version_tag(req->data, client_tag, sizeof(client_tag));
+
+  DateRange range;
+  if (parse_date_filter(req->data, &range) < 0) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "LIST_APPOINTMENTS_INVALID_FILTER");
     free_token_data(token_data);
     return res;
   }
 
-  // Build response
-  char payload[4096] = "LIST_APPOINTMENTS_SUCCESS||";
-  int first = 1;
+  current_version_tag(db_conn, token_data->user_id,
+                      range.relative ? range.from : NULL, tag, sizeof(tag));
+  if (has_tag && tag[0] && strcmp(client_tag, tag) == 0) {
+    res->status_code = STATUS_NOT_MODIFIED;
+    snprintf(res->payload, sizeof(res->payload),
+             "LIST_APPOINTMENTS_NOT_MODIFIED||" VERSION_FIELD "%s", tag);
+    free_token_data(token_data);
+    return res;
+  }
 
-  MYSQL_ROW row;
-  while ((row = mysql_fetch_row(result))) {
-    if (!first)
-      strcat(payload, "||");
+  char header[48 + VERSION_TAG_SIZE] = "LIST_APPOINTMENTS_SUCCESS";
+  if (tag[0])
+    snprintf(header, sizeof(header),
+             "LIST_APPOINTMENTS_SUCCESS||" VERSION_FIELD "%s", tag);
 
-    char meeting_str[512];
-    snprintf(meeting_str, sizeof(meeting_str), "%s&%s&%s&%s&%s", row[0], row[1],
-             row[2], row[3], row[4]);
-    strcat(payload, meeting_str);
+  // meeting_id&start&end&student&is_group per row, written as fetched
+  ListPayload list;
+  list_payload_init(&list, res, header);
+  NamedRows named = {&list, 3};
 
-    first = 0;
-  }
+  long long rows =
+      range.is_set
+          ? db_stmt_stream(db_conn, STMT_APPOINTMENTS_RANGE,
+                           user_directory_list_add, &named, "iss",
+                           token_data->user_id, range.from, range.to)
+          : db_stmt_stream(db_conn, STMT_APPOINTMENTS_ALL,
+                           user_directory_list_add, &named, "i",
+                           token_data->user_id);
 
-  if (first) {
-    strcpy(payload, "LIST_APPOINTMENTS_SUCCESS||EMPTY");
+  if (rows < 0 || list_payload_finish(&list) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "LIST_APPOINTMENTS_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
   }
 
   res->status_code = STATUS_OK;
-  strcpy(res->payload, payload);
 
   log_message("INFO", "Listed appointments for teacher_id=%d",
               token_data->user_id);
 
-  // Cleanup
-  mysql_free_result(result);
   free_token_data(token_data);
 
   return res;
 }
 
 // ============= ADD_MINUTES =============
-Response *handle_add_minutes(Request *req, MYSQL *db_conn) {
+Response *handle_add_minutes(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Validate token
@@ -593,51 +811,46 @@ Response *handle_add_minutes(Request *req, MYSQL *db_conn) {
   }
 
   // Parse data: meeting_id||<base64_content>
-  int field_count;
-  char **fields = parse_data_fields(req->data, &field_count);
+  // The content is everything after the first delimiter, "||" included
+  StrView field_buf[2];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = split_fields(req->data, "||", 2, &fields);
 
   if (field_count != 2) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "ADD_MINUTES_INVALID_FORMAT");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  int meeting_id = atoi(trim(fields[0]));
-  char *content = fields[1]; // Plain text content
+  int meeting_id = atoi(trim(fields.items[0].ptr));
+  char *content = fields.items[1].ptr; // Plain text content
 
   // Check meeting exists, belongs to teacher, and has already started
-  char query[512];
-  snprintf(query, sizeof(query),
-           "SELECT s.teacher_id, s.start_time <= NOW() as has_started "
-           "FROM meetings m "
-           "JOIN slots s ON m.slot_id = s.slot_id "
-           "WHERE m.meeting_id=%d",
-           meeting_id);
-
-  MYSQL_RES *result = db_query(db_conn, query);
+  DbStmt *result =
+      db_stmt_query(db_conn, STMT_MEETING_FOR_MINUTES, "i", meeting_id);
 
-  if (!result || mysql_num_rows(result) == 0) {
+  if (!result || db_stmt_num_rows(result) == 0) {
     res->status_code = STATUS_NOT_FOUND;
     strcpy(res->payload, "ADD_MINUTES_MEETING_NOT_FOUND");
     if (result)
-      mysql_free_result(result);
+      db_stmt_done(result);
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  MYSQL_ROW row = mysql_fetch_row(result);
+  DbRow row = db_stmt_fetch(result);
   int teacher_id = atoi(row[0]);
   int has_started = atoi(row[1]);
-  mysql_free_result(result);
+  db_stmt_done(result);
 
   if (teacher_id != token_data->user_id) {
     res->status_code = STATUS_FORBIDDEN;
     strcpy(res->payload, "ADD_MINUTES_FORBIDDEN");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
@@ -646,26 +859,22 @@ Response *handle_add_minutes(Request *req, MYSQL *db_conn) {
     res->status_code = STATUS_FORBIDDEN;
     strcpy(res->payload, "ADD_MINUTES_MEETING_NOT_STARTED");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  // Save to file: minutes/meeting_<id>.txt
-  char filename[256];
-  snprintf(filename, sizeof(filename), "minutes/meeting_%d.txt", meeting_id);
+  // Save to minutes/meeting_<id>.txt, with its metadata for VIEW_HISTORY
+  int saved = minutes_save(db_conn, meeting_id, content);
 
-  FILE *file = fopen(filename, "w");
-  if (!file) {
+  if (saved < 0) {
     res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "ADD_MINUTES_FILE_ERROR");
+    strcpy(res->payload, saved == -1 ? "ADD_MINUTES_FILE_ERROR"
+                                     : "ADD_MINUTES_INTERNAL_ERROR");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  fputs(content, file);
-  fclose(file);
-
   // Success
   res->status_code = STATUS_OK;
   strcpy(res->payload, "ADD_MINUTES_SUCCESS");
@@ -674,13 +883,13 @@ Response *handle_add_minutes(Request *req, MYSQL *db_conn) {
 
   // Cleanup
   free_token_data(token_data);
-  free_split(fields, field_count);
+  free_field_list(&fields);
 
   return res;
 }
 
 // ============= GET_MINUTES =============
-Response *handle_get_minutes(Request *req, MYSQL *db_conn) {
+Response *handle_get_minutes(Request *req, DbConn *db_conn) {
   (void)db_conn;
   Response *res = calloc(1, sizeof(Response));
 
@@ -696,8 +905,8 @@ Response *handle_get_minutes(Request *req, MYSQL *db_conn) {
   int meeting_id = atoi(trim(req->data));
 
   // Read file: minutes/meeting_<id>.txt
-  char filename[256];
-  snprintf(filename, sizeof(filename), "minutes/meeting_%d.txt", meeting_id);
+  char filename[MINUTES_PATH_SIZE];
+  minutes_path(meeting_id, filename, sizeof(filename));
 
   FILE *file = fopen(filename, "r");
   if (!file) {
@@ -731,7 +940,7 @@ Response *handle_get_minutes(Request *req, MYSQL *db_conn) {
 }
 
 // ============= VIEW_HISTORY (Teacher) =============
-Response *handle_view_history(Request *req, MYSQL *db_conn) {
+Response *handle_view_history(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   // Validate token
@@ -753,67 +962,25 @@ Response *handle_view_history(Request *req, MYSQL *db_conn) {
   // Parse data: student_id
   int student_id = atoi(trim(req->data));
 
-  // Query history - include both organizer and group member
-  char query[2048];
-  snprintf(query, sizeof(query),
-           "SELECT m.meeting_id, s.start_time FROM meetings m "
-           "JOIN slots s ON m.slot_id = s.slot_id "
-           "WHERE m.student_id=%d AND s.teacher_id=%d "
-           "UNION "
-           "SELECT m.meeting_id, s.start_time FROM meetings m "
-           "JOIN slots s ON m.slot_id = s.slot_id "
-           "JOIN group_members gm ON m.meeting_id = gm.meeting_id "
-           "WHERE gm.student_id=%d AND s.teacher_id=%d "
-           "ORDER BY start_time DESC",
-           student_id, token_data->user_id, student_id, token_data->user_id);
-
-  MYSQL_RES *result = db_query(db_conn, query);
-
-  if (!result) {
+  // Query history - include both organizer and group member. Rows are
+  // meeting_id&start_time&minutes_exist&size&updated_at&content_hash, the
+  // last three empty without minutes.
+  ListPayload list;
+  list_payload_init(&list, res, "VIEW_HISTORY_SUCCESS");
+
+  if (db_stmt_stream(db_conn, STMT_HISTORY, list_payload_add, &list, "ii",
+                     student_id, token_data->user_id) < 0 ||
+      list_payload_finish(&list) < 0) {
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "VIEW_HISTORY_INTERNAL_ERROR");
     free_token_data(token_data);
     return res;
   }
 
-  // Build response: meeting_id&date&minutes_exist|...
-  char payload[4096] = "VIEW_HISTORY_SUCCESS||";
-  int first = 1;
-
-  MYSQL_ROW row;
-  while ((row = mysql_fetch_row(result))) {
-    if (!first)
-      strcat(payload, "||");
-
-    int meeting_id = atoi(row[0]);
-
-    // Check if minutes exist
-    char filename[256];
-    snprintf(filename, sizeof(filename), "minutes/meeting_%d.txt", meeting_id);
-    FILE *file = fopen(filename, "r");
-    int minutes_exist = (file != NULL);
-    if (file)
-      fclose(file);
-
-    char history_str[256];
-    snprintf(history_str, sizeof(history_str), "%s&%s&%d", row[0], row[1],
-             minutes_exist);
-    strcat(payload, history_str);
-
-    first = 0;
-  }
-
-  if (first) {
-    strcpy(payload, "VIEW_HISTORY_SUCCESS||EMPTY");
-  }
-
   res->status_code = STATUS_OK;
-  strcpy(res->payload, payload);
 
   log_message("INFO", "Viewed history for student_id=%d", student_id);
 
-  // Cleanup
-  mysql_free_result(result);
   free_token_data(token_data);
 
   return res;
@@ -1,13 +1,18 @@
 #include "handler_slot.h"
 #include "auth.h"
-#include "database.h"
+#include "change_version.h"
+#include "db_stmt.h"
+#include "free_slots.h"
 #include "protocol.h"
+#include "slot_index.h"
 #include "utils.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // ============= ADD_SLOT =============
-Response *handle_add_slot(Request *req, MYSQL *db_conn) {
+Response *handle_add_slot(Request *req, DbConn *db_conn) {
   Response *res = malloc(sizeof(Response));
   if (!res) {
     log_message("ERROR", "ADD_SLOT: malloc failed");
@@ -30,27 +35,27 @@ Response *handle_add_slot(Request *req, MYSQL *db_conn) {
   }
 
   // Parse data: date||start_time||end_time||slot_type
-  int field_count;
-  char **fields = parse_data_fields(req->data, &field_count);
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_data_fields(req->data, &fields);
 
   if (field_count != 4) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "ADD_SLOT_INVALID_FORMAT");
-    if (fields)
-      free_split(fields, field_count);
+    free_field_list(&fields);
     free_token_data(token_data);
     return res;
   }
 
-  char *date = trim(fields[0]);
-  char *start_time_only = trim(fields[1]);
-  char *end_time_only = trim(fields[2]);
-  int slot_type = atoi(trim(fields[3]));
+  char *date = trim(fields.items[0].ptr);
+  char *start_time_only = trim(fields.items[1].ptr);
+  char *end_time_only = trim(fields.items[2].ptr);
+  int slot_type = atoi(trim(fields.items[3].ptr));
 
   if (slot_type < 0 || slot_type > 2) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "ADD_SLOT_INVALID_TYPE");
-    free_split(fields, field_count);
+    free_field_list(&fields);
     free_token_data(token_data);
     return res;
   }
@@ -60,53 +65,74 @@ Response *handle_add_slot(Request *req, MYSQL *db_conn) {
   snprintf(start_time, sizeof(start_time), "%s %s:00", date, start_time_only);
   snprintf(end_time, sizeof(end_time), "%s %s:00", date, end_time_only);
 
-  char query[1024];
-  snprintf(query, sizeof(query),
-           "SELECT slot_id FROM slots WHERE teacher_id=%d AND ("
-           "(start_time <= '%s' AND end_time > '%s') OR "
-           "(start_time < '%s' AND end_time >= '%s'))",
-           token_data->user_id, start_time, start_time, end_time, end_time);
+  long long start_key, end_key;
+  if (slot_time_parse(start_time, &start_key) < 0 ||
+      slot_time_parse(end_time, &end_key) < 0 || end_key <= start_key) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "ADD_SLOT_INVALID_FORMAT");
+    free_field_list(&fields);
+    free_token_data(token_data);
+    return res;
+  }
 
-  MYSQL_RES *result = db_query(db_conn, query);
+  // Holds the interval until the insert went through or failed
+  SlotIndexResult claim =
+      slot_index_claim(token_data->user_id, start_key, end_key, 0);
 
-  if (result == NULL && mysql_errno(db_conn) != 0) {
+  if (claim != SLOT_INDEX_OK) {
+    if (claim == SLOT_INDEX_OVERLAP) {
+      res->status_code = STATUS_USERNAME_EXISTS;
+      strcpy(res->payload, "ADD_SLOT_TIME_OVERLAP");
+    } else {
+      res->status_code = STATUS_INTERNAL_ERROR;
+      strcpy(res->payload, "ADD_SLOT_INTERNAL_ERROR");
+    }
+    free_field_list(&fields);
+    free_token_data(token_data);
+    return res;
+  }
+
+  if (db_begin(db_conn) < 0) {
+    slot_index_release(token_data->user_id, start_key);
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "ADD_SLOT_INTERNAL_ERROR");
-    free_split(fields, field_count);
+    free_field_list(&fields);
     free_token_data(token_data);
     return res;
   }
 
-  int has_overlap = 0;
-  if (result) {
-    has_overlap = (mysql_num_rows(result) > 0);
-    mysql_free_result(result);
-  }
+  long long affected =
+      db_stmt_execute(db_conn, STMT_SLOT_INSERT, "issi", token_data->user_id,
+                      start_time, end_time, slot_type);
 
-  if (has_overlap) {
-    res->status_code = STATUS_USERNAME_EXISTS;
-    strcpy(res->payload, "ADD_SLOT_TIME_OVERLAP");
-    free_split(fields, field_count);
+  if (affected <= 0) {
+    db_rollback(db_conn);
+    slot_index_release(token_data->user_id, start_key);
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "ADD_SLOT_INTERNAL_ERROR");
+    free_field_list(&fields);
     free_token_data(token_data);
     return res;
   }
 
-  snprintf(query, sizeof(query),
-           "INSERT INTO slots (teacher_id, start_time, end_time, slot_type) "
-           "VALUES (%d, '%s', '%s', %d)",
-           token_data->user_id, start_time, end_time, slot_type);
+  int slot_id = db_stmt_insert_id(db_conn);
 
-  int affected = db_execute(db_conn, query);
+  // Counter first: its row lock orders the change log (change_version.h)
+  bump_change_versions(db_conn, &token_data->user_id, 1);
+  log_slot_change(db_conn, token_data->user_id, slot_id);
 
-  if (affected <= 0) {
+  if (db_commit(db_conn) < 0) {
+    slot_index_release(token_data->user_id, start_key);
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "ADD_SLOT_INTERNAL_ERROR");
-    free_split(fields, field_count);
+    free_field_list(&fields);
     free_token_data(token_data);
     return res;
   }
 
-  int slot_id = mysql_insert_id(db_conn);
+  slot_index_commit(token_data->user_id, start_key, slot_id, 1);
+  free_slots_add(slot_id, token_data->user_id, start_key, end_key,
+                 slot_type);
 
   res->status_code = STATUS_OK;
   snprintf(res->payload, sizeof(res->payload), "ADD_SLOT_SUCCESS||%d", slot_id);
@@ -114,14 +140,337 @@ Response *handle_add_slot(Request *req, MYSQL *db_conn) {
   log_message("INFO", "Slot added: id=%d by teacher=%d", slot_id,
               token_data->user_id);
 
-  free_split(fields, field_count);
+  free_field_list(&fields);
   free_token_data(token_data);
 
   return res;
 }
 
+// ============= ADD_SLOTS_RECURRING =============
+typedef struct {
+  int count;
+  int day_offsets[RECURRING_MAX_SLOTS]; // days after the first slot's day
+  char starts[RECURRING_MAX_SLOTS][SLOT_TIME_SIZE];
+  char ends[RECURRING_MAX_SLOTS][SLOT_TIME_SIZE];
+  long long start_keys[RECURRING_MAX_SLOTS]; // for the slot index
+  long long end_keys[RECURRING_MAX_SLOTS];
+} RecurringPlan;
+
+// "YYYY-MM-DD" naming a real day, as its midnight UTC
+static int parse_slot_day(const char *text, time_t *day) {
+  int year, month, mday, len = 0;
+  if (sscanf(text, "%4d-%2d-%2d%n", &year, &month, &mday, &len) != 3 ||
+      text[len] != '\0')
+    return -1;
+
+  struct tm tm = {0};
+  tm.tm_year = year - 1900;
+  tm.tm_mon = month - 1;
+  tm.tm_mday = mday;
+  *day = timegm(&tm);
+
+  // timegm() rolls 02-30 over to March; a real day comes back unchanged
+  gmtime_r(day, &tm);
+  if (tm.tm_year != year - 1900 || tm.tm_mon != month - 1 ||
+      tm.tm_mday != mday)
+    return -1;
+  return 0;
+}
+
+// "HH:MM" as minutes after midnight
+static int parse_slot_clock(const char *text, int *minutes) {
+  int hours, mins, len = 0;
+  if (sscanf(text, "%2d:%2d%n", &hours, &mins, &len) != 2 ||
+      text[len] != '\0' || hours < 0 || hours > 23 || mins < 0 || mins > 59)
+    return -1;
+
+  *minutes = hours * 60 + mins;
+  return 0;
+}
+
+static void format_slot_time(time_t day, int minutes, char *out) {
+  struct tm tm;
+  gmtime_r(&day, &tm);
+  tm.tm_hour = minutes / 60;
+  tm.tm_min = minutes % 60;
+  tm.tm_sec = 0;
+  strftime(out, SLOT_TIME_SIZE, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+// Every slot of the rule from `from` to `to` (both included).
+// Returns 0, or -1 if there would be more than RECURRING_MAX_SLOTS.
+static int plan_recurring(RecurringPlan *plan, int step, time_t from,
+                          time_t to, int start, int end) {
+  plan->count = 0;
+
+  for (int k = 0; from + k * 86400L <= to; k += step) {
+    if (plan->count == RECURRING_MAX_SLOTS)
+      return -1;
+
+    time_t day = from + k * 86400L;
+    plan->day_offsets[plan->count] = k;
+    format_slot_time(day, start, plan->starts[plan->count]);
+    format_slot_time(day, end, plan->ends[plan->count]);
+    slot_time_parse(plan->starts[plan->count], &plan->start_keys[plan->count]);
+    slot_time_parse(plan->ends[plan->count], &plan->end_keys[plan->count]);
+    plan->count++;
+  }
+
+  return 0;
+}
+
+static void release_recurring(int teacher_id, const RecurringPlan *plan,
+                              int count) {
+  for (int i = 0; i < count; i++)
+    slot_index_release(teacher_id, plan->start_keys[i]);
+}
+
+// Claim every planned slot in the slot index. Returns -1 when all are
+// claimed, else nothing is left claimed and it returns the index of the first
+// planned slot that overlaps, or -2 on error.
+static int claim_recurring(int teacher_id, const RecurringPlan *plan) {
+  for (int i = 0; i < plan->count; i++) {
+    SlotIndexResult claim = slot_index_claim(teacher_id, plan->start_keys[i],
+                                             plan->end_keys[i], 0);
+    if (claim != SLOT_INDEX_OK) {
+      release_recurring(teacher_id, plan, i);
+      return claim == SLOT_INDEX_OVERLAP ? i : -2;
+    }
+  }
+  return -1;
+}
+
+// Insert the plan, DB_STMT_MAX_IDS days per statement, read back the new ids
+// in plan order with one range query and log them for SYNC_MY_SLOTS. Nothing
+// else of the teacher's starts at a planned time, since the claims held.
+// Returns 0 on success, -1 on error.
+static int insert_recurring(DbConn *db_conn, int teacher_id, int slot_type,
+                            const RecurringPlan *plan, int *slot_ids) {
+  for (int first = 0; first < plan->count; first += DB_STMT_MAX_IDS) {
+    int count = plan->count - first;
+    if (count > DB_STMT_MAX_IDS)
+      count = DB_STMT_MAX_IDS;
+
+    long long affected = db_stmt_execute_ids_after(
+        db_conn, STMT_SLOT_INSERT_DAYS_8, plan->day_offsets + first, count,
+        "issi", teacher_id, plan->starts[0], plan->ends[0], slot_type);
+    if (affected != count)
+      return -1;
+  }
+
+  DbStmt *result =
+      db_stmt_query(db_conn, STMT_SLOT_RANGE, "iss", teacher_id,
+                    plan->starts[0], plan->starts[plan->count - 1]);
+  if (!result)
+    return -1;
+
+  int found = 0;
+  DbRow row;
+  while (found < plan->count && (row = db_stmt_fetch(result))) {
+    if (strcmp(row[1], plan->starts[found]) == 0)
+      slot_ids[found++] = atoi(row[0]);
+  }
+  db_stmt_done(result);
+
+  if (found < plan->count)
+    return -1;
+
+  for (int first = 0; first < plan->count; first += DB_STMT_MAX_IDS) {
+    int count = plan->count - first;
+    if (count > DB_STMT_MAX_IDS)
+      count = DB_STMT_MAX_IDS;
+
+    if (log_slot_changes(db_conn, teacher_id, slot_ids + first, count) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+Response *handle_add_slots_recurring(Request *req, DbConn *db_conn) {
+  Response *res = calloc(1, sizeof(Response));
+
+  TokenData *token_data = validate_token(req->token);
+  if (!token_data) {
+    res->status_code = STATUS_TOKEN_INVALID;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INVALID_TOKEN");
+    return res;
+  }
+
+  if (strcmp(token_data->role, "teacher") != 0) {
+    res->status_code = STATUS_FORBIDDEN;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_FORBIDDEN");
+    free_token_data(token_data);
+    return res;
+  }
+
+  // Parse data: daily|weekly||from_date||to_date||start_time||end_time||type
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_data_fields(req->data, &fields);
+
+  time_t from, to;
+  int start, end;
+  if (field_count != 6 ||
+      parse_slot_day(trim(fields.items[1].ptr), &from) < 0 ||
+      parse_slot_day(trim(fields.items[2].ptr), &to) < 0 ||
+      parse_slot_clock(trim(fields.items[3].ptr), &start) < 0 ||
+      parse_slot_clock(trim(fields.items[4].ptr), &end) < 0 || to < from ||
+      end <= start) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INVALID_FORMAT");
+    free_field_list(&fields);
+    free_token_data(token_data);
+    return res;
+  }
+
+  const char *rule = trim(fields.items[0].ptr);
+  int step = 0;
+  if (strcmp(rule, "daily") == 0)
+    step = 1;
+  else if (strcmp(rule, "weekly") == 0)
+    step = 7;
+  int slot_type = atoi(trim(fields.items[5].ptr));
+  free_field_list(&fields);
+
+  if (step == 0) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INVALID_RULE");
+    free_token_data(token_data);
+    return res;
+  }
+
+  if (slot_type < 0 || slot_type > 2) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INVALID_TYPE");
+    free_token_data(token_data);
+    return res;
+  }
+
+  RecurringPlan *plan = malloc(sizeof(RecurringPlan));
+  if (!plan) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
+  }
+
+  if (plan_recurring(plan, step, from, to, start, end) < 0) {
+    res->status_code = STATUS_BAD_REQUEST;
+    snprintf(res->payload, sizeof(res->payload),
+             "ADD_SLOTS_RECURRING_TOO_MANY||%d", RECURRING_MAX_SLOTS);
+    free(plan);
+    free_token_data(token_data);
+    return res;
+  }
+
+  int teacher_id = token_data->user_id;
+
+  int clash = claim_recurring(teacher_id, plan);
+  if (clash != -1) {
+    if (clash == -2) {
+      res->status_code = STATUS_INTERNAL_ERROR;
+      strcpy(res->payload, "ADD_SLOTS_RECURRING_INTERNAL_ERROR");
+    } else {
+      // Name the first slot that clashes so the teacher can move the range
+      res->status_code = STATUS_USERNAME_EXISTS;
+      snprintf(res->payload, sizeof(res->payload),
+               "ADD_SLOTS_RECURRING_TIME_OVERLAP||%s", plan->starts[clash]);
+    }
+    free(plan);
+    free_token_data(token_data);
+    return res;
+  }
+
+  if (db_begin(db_conn) < 0) {
+    release_recurring(teacher_id, plan, plan->count);
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INTERNAL_ERROR");
+    free(plan);
+    free_token_data(token_data);
+    return res;
+  }
+
+  // Counter first: its row lock orders the change log (change_version.h)
+  int slot_ids[RECURRING_MAX_SLOTS];
+  if (bump_change_versions(db_conn, &teacher_id, 1) < 0 ||
+      insert_recurring(db_conn, teacher_id, slot_type, plan, slot_ids) < 0) {
+    db_rollback(db_conn);
+    release_recurring(teacher_id, plan, plan->count);
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INTERNAL_ERROR");
+    free(plan);
+    free_token_data(token_data);
+    return res;
+  }
+
+  if (db_commit(db_conn) < 0) {
+    release_recurring(teacher_id, plan, plan->count);
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "ADD_SLOTS_RECURRING_INTERNAL_ERROR");
+    free(plan);
+    free_token_data(token_data);
+    return res;
+  }
+
+  for (int i = 0; i < plan->count; i++) {
+    slot_index_commit(teacher_id, plan->start_keys[i], slot_ids[i], 1);
+    free_slots_add(slot_ids[i], teacher_id, plan->start_keys[i],
+                   plan->end_keys[i], slot_type);
+  }
+
+  // Build response: ADD_SLOTS_RECURRING_SUCCESS||slot_id||slot_id||...
+  res->status_code = STATUS_OK;
+  int len = snprintf(res->payload, sizeof(res->payload),
+                     "ADD_SLOTS_RECURRING_SUCCESS");
+  for (int i = 0; i < plan->count; i++)
+    len += snprintf(res->payload + len, sizeof(res->payload) - len, "||%d",
+                    slot_ids[i]);
+
+  log_message("INFO", "%d %s slots added from %s by teacher=%d", plan->count,
+              rule, plan->starts[0], teacher_id);
+
+  free(plan);
+  free_token_data(token_data);
+
+  return res;
+}
+
+// ============= SLOT VERSIONS =============
+static void set_internal_error(Response *res, const char *command) {
+  res->status_code = STATUS_INTERNAL_ERROR;
+  snprintf(res->payload, sizeof(res->payload), "%s_INTERNAL_ERROR", command);
+}
+
+// A conditional UPDATE or DELETE of a teacher's slot matched no row: read the
+// slot to tell whether it is gone, booked (if free_only) or at another version
+static void set_unmatched_slot(Response *res, DbConn *db_conn, int slot_id,
+                               int teacher_id, int free_only,
+                               const char *command) {
+  DbStmt *result = db_stmt_query(db_conn, STMT_SLOT_STATE_OWNED, "ii",
+                                 slot_id, teacher_id);
+  if (!result) {
+    set_internal_error(res, command);
+    return;
+  }
+
+  DbRow row = db_stmt_fetch(result);
+  if (!row) {
+    res->status_code = STATUS_NOT_FOUND;
+    snprintf(res->payload, sizeof(res->payload), "%s_NOT_FOUND", command);
+  } else if (free_only && atoi(row[0])) {
+    res->status_code = STATUS_USERNAME_EXISTS;
+    snprintf(res->payload, sizeof(res->payload), "%s_IN_USE", command);
+  } else {
+    res->status_code = STATUS_CONFLICT;
+    snprintf(res->payload, sizeof(res->payload), "%s_VERSION_CONFLICT||%s",
+             command, row[1]);
+  }
+  db_stmt_done(result);
+}
+
 // ============= UPDATE_SLOT =============
-Response *handle_update_slot(Request *req, MYSQL *db_conn) {
+Response *handle_update_slot(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   TokenData *token_data = validate_token(req->token);
@@ -138,67 +487,112 @@ Response *handle_update_slot(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  int field_count;
-  char **fields = parse_subfields(req->data, &field_count);
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_subfields(req->data, &fields);
 
-  if (field_count != 4) {
+  // slot_id&start&end&type[&version]
+  if (field_count != 4 && field_count != 5) {
     res->status_code = STATUS_BAD_REQUEST;
     strcpy(res->payload, "UPDATE_SLOT_INVALID_FORMAT");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
-  int slot_id = atoi(trim(fields[0]));
-  char *start_time = trim(fields[1]);
-  char *end_time = trim(fields[2]);
-  int slot_type = atoi(trim(fields[3]));
+  int slot_id = atoi(trim(fields.items[0].ptr));
+  char *start_time = trim(fields.items[1].ptr);
+  char *end_time = trim(fields.items[2].ptr);
+  int slot_type = atoi(trim(fields.items[3].ptr));
+  int version = field_count == 5 ? atoi(trim(fields.items[4].ptr)) : 0;
 
-  char query[1024];
-  snprintf(query, sizeof(query),
-           "SELECT slot_id FROM slots WHERE slot_id=%d AND teacher_id=%d",
-           slot_id, token_data->user_id);
+  long long start_key, end_key;
+  if (slot_time_parse(start_time, &start_key) < 0 ||
+      slot_time_parse(end_time, &end_key) < 0 || end_key <= start_key) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "UPDATE_SLOT_INVALID_FORMAT");
+    free_token_data(token_data);
+    free_field_list(&fields);
+    return res;
+  }
 
-  MYSQL_RES *result = db_query(db_conn, query);
-  if (!result || mysql_num_rows(result) == 0) {
-    res->status_code = STATUS_NOT_FOUND;
-    strcpy(res->payload, "UPDATE_SLOT_NOT_FOUND");
-    if (result)
-      mysql_free_result(result);
+  // The slot's current interval doesn't count against its new one
+  SlotIndexResult claim =
+      slot_index_claim(token_data->user_id, start_key, end_key, slot_id);
+
+  if (claim != SLOT_INDEX_OK) {
+    if (claim == SLOT_INDEX_OVERLAP) {
+      res->status_code = STATUS_USERNAME_EXISTS;
+      strcpy(res->payload, "UPDATE_SLOT_TIME_OVERLAP");
+    } else {
+      res->status_code = STATUS_INTERNAL_ERROR;
+      strcpy(res->payload, "UPDATE_SLOT_INTERNAL_ERROR");
+    }
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
-  mysql_free_result(result);
 
-  snprintf(query, sizeof(query),
-           "UPDATE slots SET start_time='%s', end_time='%s', slot_type=%d "
-           "WHERE slot_id=%d",
-           start_time, end_time, slot_type, slot_id);
+  if (db_begin(db_conn) < 0) {
+    slot_index_release(token_data->user_id, start_key);
+    set_internal_error(res, "UPDATE_SLOT");
+    free_token_data(token_data);
+    free_field_list(&fields);
+    return res;
+  }
 
-  int affected = db_execute(db_conn, query);
+  // Ownership and version are checked by the UPDATE itself
+  long long affected = db_stmt_execute(
+      db_conn, STMT_SLOT_UPDATE, "ssiiiii", start_time, end_time, slot_type,
+      slot_id, token_data->user_id, version, version);
 
-  if (affected < 0) {
-    res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "UPDATE_SLOT_INTERNAL_ERROR");
+  if (affected != 1) {
+    db_rollback(db_conn);
+    slot_index_release(token_data->user_id, start_key);
+    if (affected < 0)
+      set_internal_error(res, "UPDATE_SLOT");
+    else
+      set_unmatched_slot(res, db_conn, slot_id, token_data->user_id, 0,
+                         "UPDATE_SLOT");
     free_token_data(token_data);
-    free_split(fields, field_count);
+    free_field_list(&fields);
     return res;
   }
 
+  int new_version = (int)db_stmt_insert_id(db_conn);
+
+  // Booked students see the new time in their meeting lists. The teacher's
+  // counter goes first: its row lock orders the change log.
+  bump_change_versions(db_conn, &token_data->user_id, 1);
+  bump_slot_participant_versions(db_conn, slot_id);
+  log_slot_change(db_conn, token_data->user_id, slot_id);
+
+  if (db_commit(db_conn) < 0) {
+    slot_index_release(token_data->user_id, start_key);
+    set_internal_error(res, "UPDATE_SLOT");
+    free_token_data(token_data);
+    free_field_list(&fields);
+    return res;
+  }
+
+  slot_index_commit(token_data->user_id, start_key, slot_id, new_version);
+  free_slots_update(db_conn, slot_id, start_key, end_key, slot_type,
+                    new_version);
+
   res->status_code = STATUS_OK;
-  strcpy(res->payload, "UPDATE_SLOT_SUCCESS");
+  snprintf(res->payload, sizeof(res->payload), "UPDATE_SLOT_SUCCESS||%d",
+           new_version);
 
-  log_message("INFO", "Slot updated: id=%d", slot_id);
+  log_message("INFO", "Slot updated: id=%d version=%d", slot_id, new_version);
 
   free_token_data(token_data);
-  free_split(fields, field_count);
+  free_field_list(&fields);
 
   return res;
 }
 
 // ============= DELETE_SLOT =============
-Response *handle_delete_slot(Request *req, MYSQL *db_conn) {
+Response *handle_delete_slot(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   TokenData *token_data = validate_token(req->token);
@@ -215,45 +609,50 @@ Response *handle_delete_slot(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  int slot_id = atoi(trim(req->data));
+  // Parse data: slot_id[&version]
+  StrView field_buf[FIELD_LIST_INLINE];
+  FieldList fields = FIELD_LIST_INIT(field_buf);
+  int field_count = parse_subfields(req->data, &fields);
 
-  char query[512];
-  snprintf(query, sizeof(query),
-           "SELECT is_booked FROM slots WHERE slot_id=%d AND teacher_id=%d",
-           slot_id, token_data->user_id);
+  int slot_id = field_count > 0 ? atoi(trim(fields.items[0].ptr)) : 0;
+  int version = field_count > 1 ? atoi(trim(fields.items[1].ptr)) : 0;
+  free_field_list(&fields);
 
-  MYSQL_RES *result = db_query(db_conn, query);
-  if (!result || mysql_num_rows(result) == 0) {
-    res->status_code = STATUS_NOT_FOUND;
-    strcpy(res->payload, "DELETE_SLOT_NOT_FOUND");
-    if (result)
-      mysql_free_result(result);
+  if (db_begin(db_conn) < 0) {
+    set_internal_error(res, "DELETE_SLOT");
     free_token_data(token_data);
     return res;
   }
 
-  MYSQL_ROW row = mysql_fetch_row(result);
-  int is_booked = atoi(row[0]);
-  mysql_free_result(result);
+  // Only a free slot of this teacher at the given version goes
+  long long affected =
+      db_stmt_execute(db_conn, STMT_SLOT_DELETE, "iiii", slot_id,
+                      token_data->user_id, version, version);
 
-  if (is_booked) {
-    res->status_code = STATUS_USERNAME_EXISTS;
-    strcpy(res->payload, "DELETE_SLOT_IN_USE");
+  if (affected != 1) {
+    db_rollback(db_conn);
+    if (affected < 0)
+      set_internal_error(res, "DELETE_SLOT");
+    else
+      set_unmatched_slot(res, db_conn, slot_id, token_data->user_id, 1,
+                         "DELETE_SLOT");
     free_token_data(token_data);
     return res;
   }
 
-  snprintf(query, sizeof(query), "DELETE FROM slots WHERE slot_id=%d", slot_id);
+  // Counter first: its row lock orders the change log (change_version.h)
+  bump_change_versions(db_conn, &token_data->user_id, 1);
+  log_slot_change(db_conn, token_data->user_id, slot_id);
 
-  int affected = db_execute(db_conn, query);
-
-  if (affected <= 0) {
-    res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "DELETE_SLOT_INTERNAL_ERROR");
+  if (db_commit(db_conn) < 0) {
+    set_internal_error(res, "DELETE_SLOT");
     free_token_data(token_data);
     return res;
   }
 
+  slot_index_remove(slot_id);
+  free_slots_remove(slot_id);
+
   res->status_code = STATUS_OK;
   strcpy(res->payload, "DELETE_SLOT_SUCCESS");
 
@@ -265,7 +664,9 @@ Response *handle_delete_slot(Request *req, MYSQL *db_conn) {
 }
 
 // ============= LIST_FREE_SLOTS =============
-Response *handle_list_free_slots(Request *req, MYSQL *db_conn) {
+// Served from the free slot index; db_conn is NULL
+Response *handle_list_free_slots(Request *req, DbConn *db_conn) {
+  (void)db_conn;
   Response *res = calloc(1, sizeof(Response));
 
   TokenData *token_data = validate_token(req->token);
@@ -275,70 +676,47 @@ Response *handle_list_free_slots(Request *req, MYSQL *db_conn) {
     return res;
   }
 
+  char client_tag[VERSION_TAG_SIZE], tag[VERSION_TAG_SIZE];
+  int has_tag = take_version_tag(req->data, client_tag, sizeof(client_tag));
+
   int teacher_id = atoi(trim(req->data));
 
-  char query[512];
-  if (teacher_id == 0) {
-    snprintf(
-        query, sizeof(query),
-        "SELECT s.slot_id, s.teacher_id, u.username, s.start_time, s.end_time, "
-        "CASE s.slot_type WHEN 0 THEN 'Individual' WHEN 1 THEN 'Group' ELSE "
-        "'Both' END "
-        "FROM slots s JOIN users u ON s.teacher_id = u.user_id "
-        "WHERE s.is_booked=0 ORDER BY s.start_time");
-  } else {
-    snprintf(
-        query, sizeof(query),
-        "SELECT s.slot_id, s.teacher_id, u.username, s.start_time, s.end_time, "
-        "CASE s.slot_type WHEN 0 THEN 'Individual' WHEN 1 THEN 'Group' ELSE "
-        "'Both' END "
-        "FROM slots s JOIN users u ON s.teacher_id = u.user_id "
-        "WHERE s.teacher_id=%d AND s.is_booked=0 ORDER BY s.start_time",
-        teacher_id);
+  // Unchanged since the client's copy: skip building the list
+  free_slots_tag(teacher_id, tag, sizeof(tag));
+  if (has_tag && strcmp(client_tag, tag) == 0) {
+    res->status_code = STATUS_NOT_MODIFIED;
+    snprintf(res->payload, sizeof(res->payload),
+             "LIST_FREE_SLOTS_NOT_MODIFIED||" VERSION_FIELD "%s", tag);
+    free_token_data(token_data);
+    return res;
   }
 
-  MYSQL_RES *result = db_query(db_conn, query);
+  char header[48 + VERSION_TAG_SIZE];
+  snprintf(header, sizeof(header),
+           "LIST_FREE_SLOTS_SUCCESS||" VERSION_FIELD "%s", tag);
 
-  if (!result) {
+  // The tag and the rows may be a change apart; the next request catches up
+  ListPayload list;
+  list_payload_init(&list, res, header);
+  free_slots_list(teacher_id, &list);
+  if (list_payload_finish(&list) < 0) {
     res->status_code = STATUS_INTERNAL_ERROR;
     strcpy(res->payload, "LIST_FREE_SLOTS_INTERNAL_ERROR");
     free_token_data(token_data);
     return res;
   }
 
-  char payload[4096] = "LIST_FREE_SLOTS_SUCCESS||";
-  int first = 1;
-
-  MYSQL_ROW row;
-  while ((row = mysql_fetch_row(result))) {
-    if (!first)
-      strcat(payload, "||");
-
-    char slot_str[256];
-    snprintf(slot_str, sizeof(slot_str), "%s&%s&%s&%s&%s&%s", row[0], row[1],
-             row[2], row[3], row[4], row[5]);
-    strcat(payload, slot_str);
-
-    first = 0;
-  }
-
-  if (first) {
-    strcpy(payload, "LIST_FREE_SLOTS_SUCCESS||EMPTY");
-  }
-
   res->status_code = STATUS_OK;
-  strcpy(res->payload, payload);
 
   log_message("INFO", "Listed free slots for teacher_id=%d", teacher_id);
 
-  mysql_free_result(result);
   free_token_data(token_data);
 
   return res;
 }
 
 // ============= LIST_MY_SLOTS (Teacher's own slots) =============
-Response *handle_list_my_slots(Request *req, MYSQL *db_conn) {
+Response *handle_list_my_slots(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   TokenData *token_data = validate_token(req->token);
@@ -356,188 +734,237 @@ Response *handle_list_my_slots(Request *req, MYSQL *db_conn) {
     return res;
   }
 
-  char query[512];
-  snprintf(
-      query, sizeof(query),
-      "SELECT slot_id, DATE(start_time), TIME(start_time), TIME(end_time), "
-      "CASE slot_type WHEN 0 THEN 'Individual' WHEN 1 THEN 'Group' ELSE 'Both' "
-      "END, "
-      "is_booked FROM slots WHERE teacher_id=%d ORDER BY start_time",
-      token_data->user_id);
+  char client_tag[VERSION_TAG_SIZE], tag[VERSION_TAG_SIZE] = "";
+  int has_tag = take_version_tag(req->data, client_tag, sizeof(client_tag));
 
-  MYSQL_RES *result = db_query(db_conn, query);
-
-  if (!result) {
-    res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "LIST_MY_SLOTS_INTERNAL_ERROR");
+  current_version_tag(db_conn, token_data->user_id, NULL, tag, sizeof(tag));
+  if (has_tag && tag[0] && strcmp(client_tag, tag) == 0) {
+    res->status_code = STATUS_NOT_MODIFIED;
+    snprintf(res->payload, sizeof(res->payload),
+             "LIST_MY_SLOTS_NOT_MODIFIED||" VERSION_FIELD "%s", tag);
     free_token_data(token_data);
     return res;
   }
 
-  char payload[4096] = "LIST_MY_SLOTS_SUCCESS||";
-  int first = 1;
-
-  MYSQL_ROW row;
-  while ((row = mysql_fetch_row(result))) {
-    if (!first)
-      strcat(payload, "||");
+  char header[48 + VERSION_TAG_SIZE] = "LIST_MY_SLOTS_SUCCESS";
+  if (tag[0])
+    snprintf(header, sizeof(header),
+             "LIST_MY_SLOTS_SUCCESS||" VERSION_FIELD "%s", tag);
 
-    // slot_id&date&start_time&end_time&type&is_booked
-    char slot_str[256];
-    snprintf(slot_str, sizeof(slot_str), "%s&%s&%s&%s&%s&%s", row[0], row[1],
-             row[2], row[3], row[4], row[5]);
-    strcat(payload, slot_str);
-
-    first = 0;
-  }
+  // slot_id&date&start_time&end_time&type&is_booked&version per row
+  ListPayload list;
+  list_payload_init(&list, res, header);
 
-  if (first) {
-    strcpy(payload, "LIST_MY_SLOTS_SUCCESS||EMPTY");
+  if (db_stmt_stream(db_conn, STMT_MY_SLOTS, list_payload_add, &list, "i",
+                     token_data->user_id) < 0 ||
+      list_payload_finish(&list) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "LIST_MY_SLOTS_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
   }
 
   res->status_code = STATUS_OK;
-  strcpy(res->payload, payload);
 
   log_message("INFO", "Listed slots for teacher_id=%d", token_data->user_id);
 
-  mysql_free_result(result);
   free_token_data(token_data);
 
   return res;
 }
 
-// ============= LIST_STUDENTS =============
-Response *handle_list_students(Request *req, MYSQL *db_conn) {
+// ============= SYNC_MY_SLOTS (Teacher's slot changes) =============
+// since=<version>: only slots changed after that version, in change order.
+// Rows are U&slot_id&date&start_time&end_time&type&is_booked&version for
+// inserts and updates, D&slot_id for deletes. since=0 (or a version the
+// server doesn't know) returns the whole list as FULL. MORE means the batch
+// was cut short: sync again from the returned version.
+Response *handle_sync_my_slots(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   TokenData *token_data = validate_token(req->token);
   if (!token_data) {
     res->status_code = STATUS_TOKEN_INVALID;
-    strcpy(res->payload, "LIST_STUDENTS_INVALID_TOKEN");
+    strcpy(res->payload, "SYNC_MY_SLOTS_INVALID_TOKEN");
     return res;
   }
 
   // Must be a teacher
   if (strcmp(token_data->role, "teacher") != 0) {
     res->status_code = STATUS_FORBIDDEN;
-    strcpy(res->payload, "LIST_STUDENTS_FORBIDDEN");
+    strcpy(res->payload, "SYNC_MY_SLOTS_FORBIDDEN");
     free_token_data(token_data);
     return res;
   }
 
-  // Only get students who have meetings with this teacher
-  char query[512];
-  snprintf(query, sizeof(query),
-           "SELECT DISTINCT u.user_id, u.username "
-           "FROM users u "
-           "JOIN meetings m ON u.user_id = m.student_id "
-           "JOIN slots s ON m.slot_id = s.slot_id "
-           "WHERE s.teacher_id = %d "
-           "UNION "
-           "SELECT DISTINCT u.user_id, u.username "
-           "FROM users u "
-           "JOIN group_members gm ON u.user_id = gm.student_id "
-           "JOIN meetings m ON gm.meeting_id = m.meeting_id "
-           "JOIN slots s ON m.slot_id = s.slot_id "
-           "WHERE s.teacher_id = %d "
-           "ORDER BY username",
-           token_data->user_id, token_data->user_id);
+  // Parse data: since=<version>
+  char *data = trim(req->data);
+  if (strncmp(data, "since=", 6) == 0)
+    data += 6;
+  long long since = atoll(data);
 
-  MYSQL_RES *result = db_query(db_conn, query);
+  if (since < 0) {
+    res->status_code = STATUS_BAD_REQUEST;
+    strcpy(res->payload, "SYNC_MY_SLOTS_INVALID_FORMAT");
+    free_token_data(token_data);
+    return res;
+  }
 
-  if (!result) {
+  DbStmt *result = db_stmt_query(db_conn, STMT_SLOT_CHANGES_LATEST, "ii",
+                                 token_data->user_id, token_data->user_id);
+  DbRow row = result ? db_stmt_fetch(result) : NULL;
+
+  if (!row) {
     res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "LIST_STUDENTS_INTERNAL_ERROR");
+    strcpy(res->payload, "SYNC_MY_SLOTS_INTERNAL_ERROR");
+    if (result)
+      db_stmt_done(result);
     free_token_data(token_data);
     return res;
   }
 
-  char payload[4096] = "LIST_STUDENTS_SUCCESS||";
-  int first = 1;
+  long long latest = atoll(row[0]);
+  long long floor_id = row[1] ? atoll(row[1]) : 0;
+  db_stmt_done(result);
 
-  MYSQL_ROW row;
-  while ((row = mysql_fetch_row(result))) {
-    if (!first)
-      strcat(payload, "||");
+  // A version from before a reset of the change log, or below deletions
+  // pruned since: start over
+  int full = (since == 0 || since > latest || since < floor_id);
+  if (full)
+    since = 0;
 
-    // user_id&username
-    char student_str[128];
-    snprintf(student_str, sizeof(student_str), "%s&%s", row[0], row[1]);
-    strcat(payload, student_str);
+  result = db_stmt_query(db_conn, STMT_SLOT_CHANGES_SINCE, "ili",
+                         token_data->user_id, since, SYNC_BATCH_SIZE);
 
-    first = 0;
+  if (!result) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "SYNC_MY_SLOTS_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
   }
 
-  if (first) {
-    strcpy(payload, "LIST_STUDENTS_SUCCESS||EMPTY");
+  // Leave room in the payload for the header
+  char rows[sizeof(res->payload) - 128] = "";
+  size_t rows_len = 0;
+  long long version = since;
+  int row_count = 0;
+
+  while ((row = db_stmt_fetch(result))) {
+    char slot_str[256];
+    int deleted = atoi(row[2]);
+
+    if (deleted) {
+      snprintf(slot_str, sizeof(slot_str), "D&%s", row[1]);
+    } else {
+      snprintf(slot_str, sizeof(slot_str), "U&%s&%s&%s&%s&%s&%s&%s", row[1],
+               row[3], row[4], row[5], row[6], row[7], row[8]);
+    }
+
+    // Full batch: the rest goes out in the next one
+    if (rows_len + strlen(slot_str) + 2 >= sizeof(rows))
+      break;
+
+    version = atoll(row[0]);
+    row_count++;
+
+    // A fresh list has nothing to delete
+    if (deleted && full)
+      continue;
+
+    rows_len += snprintf(rows + rows_len, sizeof(rows) - rows_len, "||%s",
+                         slot_str);
   }
 
+  int more = (row_count == SYNC_BATCH_SIZE || row != NULL);
+  if (!more)
+    version = latest > version ? latest : version;
+
   res->status_code = STATUS_OK;
-  strcpy(res->payload, payload);
+  snprintf(res->payload, sizeof(res->payload),
+           "SYNC_MY_SLOTS_SUCCESS||" VERSION_FIELD "%lld||%s%s%s", version,
+           full ? "FULL" : "DELTA", more ? "||MORE" : "", rows);
 
-  log_message("INFO", "Listed students with meetings for teacher_id=%d",
-              token_data->user_id);
+  log_message("INFO", "Synced %d slot changes for teacher_id=%d since=%lld",
+              row_count, token_data->user_id, since);
 
-  mysql_free_result(result);
+  db_stmt_done(result);
   free_token_data(token_data);
 
   return res;
 }
 
-// ============= LIST_ALL_STUDENTS (for group booking) =============
-Response *handle_list_all_students(Request *req, MYSQL *db_conn) {
+// ============= LIST_STUDENTS =============
+Response *handle_list_students(Request *req, DbConn *db_conn) {
   Response *res = calloc(1, sizeof(Response));
 
   TokenData *token_data = validate_token(req->token);
   if (!token_data) {
     res->status_code = STATUS_TOKEN_INVALID;
-    strcpy(res->payload, "LIST_ALL_STUDENTS_INVALID_TOKEN");
+    strcpy(res->payload, "LIST_STUDENTS_INVALID_TOKEN");
     return res;
   }
 
-  // Get all students except the current user
-  char query[256];
-  snprintf(query, sizeof(query),
-           "SELECT user_id, username FROM users "
-           "WHERE role='student' AND user_id != %d "
-           "ORDER BY username",
-           token_data->user_id);
+  // Must be a teacher
+  if (strcmp(token_data->role, "teacher") != 0) {
+    res->status_code = STATUS_FORBIDDEN;
+    strcpy(res->payload, "LIST_STUDENTS_FORBIDDEN");
+    free_token_data(token_data);
+    return res;
+  }
 
-  MYSQL_RES *result = db_query(db_conn, query);
+  // Students on this teacher's roster (teacher_roster, kept by booking and
+  // cancelling): user_id&username
+  ListPayload list;
+  list_payload_init(&list, res, "LIST_STUDENTS_SUCCESS");
 
-  if (!result) {
+  if (db_stmt_stream(db_conn, STMT_STUDENTS_OF_TEACHER, list_payload_add,
+                     &list, "i", token_data->user_id) < 0 ||
+      list_payload_finish(&list) < 0) {
     res->status_code = STATUS_INTERNAL_ERROR;
-    strcpy(res->payload, "LIST_ALL_STUDENTS_INTERNAL_ERROR");
+    strcpy(res->payload, "LIST_STUDENTS_INTERNAL_ERROR");
     free_token_data(token_data);
     return res;
   }
 
-  char payload[4096] = "LIST_ALL_STUDENTS_SUCCESS||";
-  int first = 1;
+  res->status_code = STATUS_OK;
 
-  MYSQL_ROW row;
-  while ((row = mysql_fetch_row(result))) {
-    if (!first)
-      strcat(payload, "||");
+  log_message("INFO", "Listed students with meetings for teacher_id=%d",
+              token_data->user_id);
 
-    char student_str[128];
-    snprintf(student_str, sizeof(student_str), "%s&%s", row[0], row[1]);
-    strcat(payload, student_str);
+  free_token_data(token_data);
 
-    first = 0;
+  return res;
+}
+
+// ============= LIST_ALL_STUDENTS (for group booking) =============
+Response *handle_list_all_students(Request *req, DbConn *db_conn) {
+  Response *res = calloc(1, sizeof(Response));
+
+  TokenData *token_data = validate_token(req->token);
+  if (!token_data) {
+    res->status_code = STATUS_TOKEN_INVALID;
+    strcpy(res->payload, "LIST_ALL_STUDENTS_INVALID_TOKEN");
+    return res;
   }
 
-  if (first) {
-    strcpy(payload, "LIST_ALL_STUDENTS_SUCCESS||EMPTY");
+  // Get all students except the current user: user_id&username
+  ListPayload list;
+  list_payload_init(&list, res, "LIST_ALL_STUDENTS_SUCCESS");
+
+  if (db_stmt_stream(db_conn, STMT_ALL_STUDENTS, list_payload_add, &list,
+                     "i", token_data->user_id) < 0 ||
+      list_payload_finish(&list) < 0) {
+    res->status_code = STATUS_INTERNAL_ERROR;
+    strcpy(res->payload, "LIST_ALL_STUDENTS_INTERNAL_ERROR");
+    free_token_data(token_data);
+    return res;
   }
 
   res->status_code = STATUS_OK;
-  strcpy(res->payload, payload);
 
   log_message("INFO", "Listed all students for user_id=%d",
               token_data->user_id);
 
-  mysql_free_result(result);
   free_token_data(token_data);
 
   return res;
@@ -0,0 +1,192 @@
+#include "minutes.h"
+#include "db_stmt.h"
+#include "utils.h"
+#include <dirent.h>
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define MINUTES_HASH_SIZE (SHA256_DIGEST_LENGTH * 2 + 1)
+#define MINUTES_TIME_SIZE 20 // "YYYY-MM-DD HH:MM:SS"
+
+void minutes_path(int meeting_id, char *out, size_t size) {
+  snprintf(out, size, MINUTES_DIR "/meeting_%d.txt", meeting_id);
+}
+
+static void hash_content(const char *content, size_t len,
+                         char out[MINUTES_HASH_SIZE]) {
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256((const unsigned char *)content, len, digest);
+
+  for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+    snprintf(out + i * 2, 3, "%02x", digest[i]);
+}
+
+// As updated_at holds it
+static void format_time(time_t t, char out[MINUTES_TIME_SIZE]) {
+  struct tm tm;
+  localtime_r(&t, &tm);
+  strftime(out, MINUTES_TIME_SIZE, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+static int record(DbConn *conn, int meeting_id, const char *content,
+                  size_t len, time_t updated) {
+  char hash[MINUTES_HASH_SIZE];
+  hash_content(content, len, hash);
+
+  char updated_at[MINUTES_TIME_SIZE];
+  format_time(updated, updated_at);
+
+  return db_stmt_execute(conn, STMT_MINUTES_SAVE, "iiss", meeting_id,
+                         (int)len, hash, updated_at) < 0
+             ? -1
+             : 0;
+}
+
+// ============= WRITE =============
+int minutes_save(DbConn *conn, int meeting_id, const char *content) {
+  char path[MINUTES_PATH_SIZE];
+  minutes_path(meeting_id, path, sizeof(path));
+
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return -1;
+
+  size_t len = strlen(content);
+  int written = fwrite(content, 1, len, file) == len;
+  if (fclose(file) != 0 || !written)
+    return -1;
+
+  // Record the file's own mtime: if this fails, the next backfill sees the
+  // row doesn't match the file and records it again
+  struct stat st;
+  time_t updated = stat(path, &st) == 0 ? st.st_mtime : time(NULL);
+
+  if (record(conn, meeting_id, content, len, updated) < 0)
+    return -2;
+  return 0;
+}
+
+// ============= BACKFILL =============
+// A meeting_minutes row, as much as it takes to tell whether it is current
+typedef struct {
+  int meeting_id;
+  long long size;
+  char updated_at[MINUTES_TIME_SIZE];
+} KnownFile;
+
+typedef struct {
+  KnownFile *files;
+  size_t count;
+  size_t capacity;
+} KnownSet;
+
+static int add_known(DbRow row, unsigned int columns, void *arg) {
+  (void)columns;
+  KnownSet *set = arg;
+
+  if (set->count == set->capacity) {
+    size_t capacity = set->capacity ? set->capacity * 2 : 256;
+    KnownFile *grown = realloc(set->files, capacity * sizeof(KnownFile));
+    if (!grown)
+      return 1;
+    set->files = grown;
+    set->capacity = capacity;
+  }
+
+  KnownFile *known = &set->files[set->count++];
+  known->meeting_id = atoi(row[0]);
+  known->size = row[1] ? atoll(row[1]) : -1;
+  snprintf(known->updated_at, sizeof(known->updated_at), "%s",
+           row[2] ? row[2] : "");
+  return 0;
+}
+
+// a is a meeting_id, or a KnownFile, which starts with one
+static int compare_known(const void *a, const void *b) {
+  int x = *(const int *)a, y = ((const KnownFile *)b)->meeting_id;
+  return (x > y) - (x < y);
+}
+
+// Whether the row matches the file: same size and write time
+static int is_current(const KnownFile *known, const struct stat *st) {
+  char mtime[MINUTES_TIME_SIZE];
+  format_time(st->st_mtime, mtime);
+  return known->size == (long long)st->st_size &&
+         strcmp(known->updated_at, mtime) == 0;
+}
+
+// Record one file; returns 1 if recorded, 0 if skipped, -1 on a DB error
+static int backfill_file(DbConn *conn, int meeting_id, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return 0;
+
+  struct stat st;
+  char *content = NULL;
+  size_t len = 0;
+  if (fstat(fileno(file), &st) == 0 && (content = malloc(st.st_size + 1)))
+    len = fread(content, 1, st.st_size, file);
+  fclose(file);
+
+  if (!content) {
+    log_message("WARN", "Minutes: cannot read %s", path);
+    return 0;
+  }
+
+  int rc = record(conn, meeting_id, content, len, st.st_mtime) < 0 ? -1 : 1;
+  free(content);
+  return rc;
+}
+
+int minutes_backfill(DbConn *conn) {
+  KnownSet known = {0};
+  if (db_stmt_stream(conn, STMT_MINUTES_KNOWN, add_known, &known, "") < 0) {
+    free(known.files);
+    return -1;
+  }
+  qsort(known.files, known.count, sizeof(KnownFile), compare_known);
+
+  DIR *dir = opendir(MINUTES_DIR);
+  if (!dir) {
+    free(known.files);
+    return 0; // no minutes written yet
+  }
+
+  int recorded = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) && recorded >= 0) {
+    int meeting_id, len = 0;
+    if (sscanf(entry->d_name, "meeting_%d.txt%n", &meeting_id, &len) != 1 ||
+        len == 0 || entry->d_name[len] != '\0')
+      continue;
+
+    char path[MINUTES_PATH_SIZE];
+    minutes_path(meeting_id, path, sizeof(path));
+
+    struct stat st;
+    const KnownFile *row =
+        known.count > 0 ? bsearch(&meeting_id, known.files, known.count,
+                                  sizeof(KnownFile), compare_known)
+                        : NULL;
+    if (row && stat(path, &st) == 0 && is_current(row, &st))
+      continue;
+
+    int rc = backfill_file(conn, meeting_id, path);
+    if (rc < 0)
+      recorded = -1;
+    else
+      recorded += rc;
+  }
+
+  closedir(dir);
+  free(known.files);
+
+  if (recorded > 0)
+    log_message("INFO", "Minutes: recorded metadata of %d new or changed files",
+                recorded);
+  return recorded;
+}
@@ -1,8 +1,31 @@
 #include "protocol.h"
 #include "utils.h"
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Split "COMMAND@<id>" into command and request id; an id that isn't
+// 1..UINT_MAX in decimal flags the request instead
+static void split_request_id(Request *req) {
+  char *sep = strchr(req->command, REQUEST_ID_SEP);
+  if (!sep)
+    return;
+
+  *sep = '\0';
+  char *end = NULL;
+  errno = 0;
+  unsigned long id = strtoul(sep + 1, &end, 10);
+  if (!isdigit((unsigned char)sep[1]) || *end != '\0' || errno == ERANGE ||
+      id == 0 || id > UINT_MAX) {
+    req->bad_request_id = 1;
+    return;
+  }
+  req->request_id = (unsigned int)id;
+}
+
 // ============= PARSE REQUEST =============
 Request *parse_request(const char *raw_message) {
   if (!raw_message) {
@@ -51,45 +74,165 @@ Request *parse_request(const char *raw_message) {
     strncpy(req->command, msg, sizeof(req->command) - 1);
   }
 
+  split_request_id(req);
+
   free(msg_copy);
   return req;
 }
 
 // ============= BUILD RESPONSE =============
 char *build_response(int status_code, const char *payload) {
+  return build_tagged_response(status_code, 0, payload);
+}
+
+char *build_tagged_response(int status_code, unsigned int request_id,
+                            const char *payload) {
   char *response = malloc(4096);
   if (!response) {
     log_message("ERROR", "build_response: malloc failed!");
     return NULL;
   }
 
+  char status[32];
+  if (request_id > 0) {
+    snprintf(status, sizeof(status), "%d%c%u", status_code, REQUEST_ID_SEP,
+             request_id);
+  } else {
+    snprintf(status, sizeof(status), "%d", status_code);
+  }
+
   if (payload && strlen(payload) > 0) {
-    snprintf(response, 4096, "%d||%s\r\n", status_code, payload);
+    snprintf(response, 4096, "%s||%s\r\n", status, payload);
   } else {
-    snprintf(response, 4096, "%d\r\n", status_code);
+    snprintf(response, 4096, "%s\r\n", status);
   }
 
   return response;
 }
 
-// ============= PARSE SUBFIELDS =============
-char **parse_subfields(const char *field, int *subfield_count) {
-  *subfield_count = 0;
+// ============= VERSION TAG =============
+int take_version_tag(char *data, char *tag, size_t tag_size) {
+  tag[0] = '\0';
+  if (!data)
+    return 0;
 
-  if (!field || strlen(field) == 0) {
-    return NULL;
+  char *field = NULL;
+  if (strncmp(data, VERSION_FIELD, strlen(VERSION_FIELD)) == 0) {
+    field = data;
+  } else {
+    char *p = data;
+    while ((p = strstr(p, "||" VERSION_FIELD)) != NULL) {
+      field = p;
+      p += 2;
+    }
+    if (!field)
+      return 0;
   }
 
-  char *field_copy = strdup(field);
-  if (!field_copy) {
-    log_message("ERROR", "parse_subfields: strdup failed");
-    return NULL;
+  const char *value = strstr(field, VERSION_FIELD) + strlen(VERSION_FIELD);
+  strncpy(tag, value, tag_size - 1);
+  tag[tag_size - 1] = '\0';
+  *field = '\0';
+
+  return 1;
+}
+
+// ============= LIST PAYLOAD =============
+void list_payload_init(ListPayload *list, Response *res, const char *header) {
+  list->res = res;
+  list->buf = res->payload;
+  list->size = LIST_PAYLOAD_SIZE;
+  list->rows = 0;
+  list->full = 0;
+  list->len = (size_t)snprintf(list->buf, list->size, "%s", header);
+  if (list->len >= list->size)
+    list->len = list->size - 1;
+  list->header_len = list->len;
+}
+
+// Move the rows in the payload to a new chunk. Returns 0, -1 if there are
+// none or no memory.
+static int list_payload_spill(ListPayload *list) {
+  if (list->len == list->header_len)
+    return -1;
+
+  // The rows without their leading "||", and the terminator
+  const char *rows = list->buf + list->header_len + 2;
+  size_t rows_len = list->len - list->header_len - 2 + 1;
+
+  Response *res = list->res;
+  char *grown = realloc(res->chunks, res->chunks_len + rows_len);
+  if (!grown)
+    return -1;
+
+  memcpy(grown + res->chunks_len, rows, rows_len);
+  res->chunks = grown;
+  res->chunks_len += rows_len;
+
+  list->len = list->header_len;
+  list->buf[list->len] = '\0';
+  return 0;
+}
+
+int list_payload_add(char **columns, unsigned int count, void *arg) {
+  ListPayload *list = arg;
+
+  size_t needed = 2; // "||"
+  for (unsigned int i = 0; i < count; i++)
+    needed += (columns[i] ? strlen(columns[i]) : 0) + (i > 0);
+
+  // Keep room for the terminator
+  if (list->len + needed >= list->size &&
+      (list_payload_spill(list) < 0 || list->len + needed >= list->size)) {
+    log_message("WARN", "List payload: row dropped after %d rows",
+                list->rows);
+    list->full = 1;
+    return 1;
   }
 
-  char **result = split_string(field_copy, "&", subfield_count);
-  free(field_copy);
+  char *p = list->buf + list->len;
+  *p++ = '|';
+  *p++ = '|';
+  for (unsigned int i = 0; i < count; i++) {
+    if (i > 0)
+      *p++ = '&';
+    if (columns[i]) {
+      size_t n = strlen(columns[i]);
+      memcpy(p, columns[i], n);
+      p += n;
+    }
+  }
+  *p = '\0';
 
-  return result;
+  list->len += needed;
+  list->rows++;
+  return 0;
+}
+
+int list_payload_finish(ListPayload *list) {
+  if (list->full) {
+    free(list->res->chunks);
+    list->res->chunks = NULL;
+    list->res->chunks_len = 0;
+    return -1;
+  }
+
+  if (list->rows == 0 && list->len + 7 < list->size) {
+    memcpy(list->buf + list->len, "||EMPTY", 8);
+    list->len += 7;
+  }
+  return 0;
+}
+
+// ============= PARSE SUBFIELDS =============
+int parse_subfields(char *field, FieldList *subfields) {
+  int count = split_fields(field, "&", 0, subfields);
+  if (count < 0) {
+    log_message("ERROR", "parse_subfields: split failed");
+    return 0;
+  }
+
+  return count;
 }
 
 // ============= FREE FUNCTIONS =============
@@ -98,27 +241,25 @@ void free_request(Request *req) {
     free(req);
 }
 
+void free_response(Response *res) {
+  if (res) {
+    free(res->chunks);
+    free(res);
+  }
+}
+
 void free_response_string(char *response) {
   if (response)
     free(response);
 }
 
 // ============= PARSE DATA FIELDS =============
-char **parse_data_fields(const char *data, int *field_count) {
-  *field_count = 0;
-
-  if (!data || strlen(data) == 0) {
-    return NULL;
-  }
-
-  char *data_copy = strdup(data);
-  if (!data_copy) {
-    log_message("ERROR", "parse_data_fields: strdup failed");
-    return NULL;
+int parse_data_fields(char *data, FieldList *fields) {
+  int count = split_fields(data, "||", 0, fields);
+  if (count < 0) {
+    log_message("ERROR", "parse_data_fields: split failed");
+    return 0;
   }
 
-  char **result = split_string(data_copy, "||", field_count);
-  free(data_copy);
-
-  return result;
-}
\ No newline at end of file
+  return count;
+}
@@ -1,15 +1,24 @@
 #include "server.h"
+#include "auth.h"
+#include "change_version.h"
 #include "database.h"
+#include "db_pool.h"
+#include "free_slots.h"
 #include "handler_auth.h"
 #include "handler_meeting.h"
 #include "handler_slot.h"
+#include "minutes.h"
 #include "protocol.h"
+#include "slot_index.h"
+#include "user_directory.h"
 #include "utils.h"
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -20,6 +29,25 @@
 // Global client counter
 static int client_counter = 0;
 
+// Per-connection state shared by the reader and the in-flight workers
+typedef struct {
+  int fd;
+  pthread_mutex_t write_lock;
+
+  // Tagged requests waiting for a worker
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_not_empty;
+  pthread_cond_t queue_not_full;
+  Request *queue[MAX_INFLIGHT_REQUESTS];
+  int queue_head;
+  int queue_count;
+  int closing;
+
+  pthread_t workers[MAX_INFLIGHT_WORKERS];
+  int worker_count;
+  int idle_workers;
+} ClientConn;
+
 // ============= READ LINE =============
 int read_line(int fd, char *buffer, int max_len) {
   int total = 0;
@@ -47,9 +75,7 @@ int read_line(int fd, char *buffer, int max_len) {
 }
 
 // ============= PROCESS COMMAND =============
-Response *process_command(Request *req, MYSQL *db_conn) {
-  Response *res = calloc(1, sizeof(Response));
-
+Response *process_command(Request *req, DbConn *db_conn) {
   // AUTH COMMANDS
   if (strcmp(req->command, "REGISTER") == 0) {
     return handle_register(req, db_conn);
@@ -62,6 +88,8 @@ Response *process_command(Request *req, MYSQL *db_conn) {
   // SLOT COMMANDS
   else if (strcmp(req->command, "ADD_SLOT") == 0) {
     return handle_add_slot(req, db_conn);
+  } else if (strcmp(req->command, "ADD_SLOTS_RECURRING") == 0) {
+    return handle_add_slots_recurring(req, db_conn);
   } else if (strcmp(req->command, "UPDATE_SLOT") == 0) {
     return handle_update_slot(req, db_conn);
   } else if (strcmp(req->command, "DELETE_SLOT") == 0) {
@@ -89,6 +117,8 @@ Response *process_command(Request *req, MYSQL *db_conn) {
     return handle_view_history(req, db_conn);
   } else if (strcmp(req->command, "LIST_MY_SLOTS") == 0) {
     return handle_list_my_slots(req, db_conn);
+  } else if (strcmp(req->command, "SYNC_MY_SLOTS") == 0) {
+    return handle_sync_my_slots(req, db_conn);
   } else if (strcmp(req->command, "LIST_STUDENTS") == 0) {
     return handle_list_students(req, db_conn);
   } else if (strcmp(req->command, "LIST_ALL_STUDENTS") == 0) {
@@ -97,6 +127,7 @@ Response *process_command(Request *req, MYSQL *db_conn) {
 
   // UNKNOWN COMMAND
   else {
+    Response *res = calloc(1, sizeof(Response));
     res->status_code = STATUS_BAD_REQUEST;
     snprintf(res->payload, sizeof(res->payload), "UNKNOWN_COMMAND: %s",
              req->command);
@@ -104,7 +135,231 @@ Response *process_command(Request *req, MYSQL *db_conn) {
   }
 }
 
-void handle_client(int client_fd, MYSQL *db_conn) {
+// ============= SEND RESPONSE =============
+// Responses from the reader and the workers share one socket, so each line is
+// written under the connection's write lock.
+static void send_response(ClientConn *conn, unsigned int request_id,
+                          int status_code, const char *payload) {
+  char *response_msg = build_tagged_response(status_code, request_id, payload);
+  if (!response_msg)
+    return;
+
+  size_t response_len = strlen(response_msg);
+
+  pthread_mutex_lock(&conn->write_lock);
+
+  ssize_t total_sent = 0;
+  while (total_sent < (ssize_t)response_len) {
+    ssize_t sent = write(conn->fd, response_msg + total_sent,
+                         response_len - total_sent);
+    if (sent < 0)
+      break;
+    total_sent += sent;
+  }
+
+  if (total_sent > 0)
+    fsync(conn->fd);
+
+  pthread_mutex_unlock(&conn->write_lock);
+
+  log_message("SEND", "%s", response_msg);
+
+  free_response_string(response_msg);
+}
+
+// A complete list sends its chunks first, then its last line with the header
+static void send_result(ClientConn *conn, unsigned int request_id,
+                        const Response *res) {
+  if (res->status_code == STATUS_OK) {
+    for (size_t at = 0; at < res->chunks_len;
+         at += strlen(res->chunks + at) + 1)
+      send_response(conn, request_id, STATUS_CHUNK_OK, res->chunks + at);
+  }
+
+  send_response(conn, request_id, res->status_code, res->payload);
+}
+
+// ============= RUN REQUEST =============
+// Commands that only read the database; they may run on a read replica.
+// LOGIN stays on the primary so an account can log in right after REGISTER.
+static const char *const read_only_commands[] = {
+    "LIST_MY_SLOTS", "SYNC_MY_SLOTS", "LIST_MEETINGS",
+    "LIST_APPOINTMENTS", "GET_MINUTES", "VIEW_HISTORY",
+    "LIST_STUDENTS", "LIST_ALL_STUDENTS",
+};
+
+// Commands answered from memory alone; they get no session
+static const char *const memory_commands[] = {
+    "LIST_FREE_SLOTS",
+};
+
+static int in_list(const char *command, const char *const *list,
+                   size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(command, list[i]) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+static int is_read_only(const char *command) {
+  return in_list(command, read_only_commands,
+                 sizeof(read_only_commands) / sizeof(read_only_commands[0]));
+}
+
+static int is_memory_only(const char *command) {
+  return in_list(command, memory_commands,
+                 sizeof(memory_commands) / sizeof(memory_commands[0]));
+}
+
+// User behind the request's token, 0 if none
+static int request_user_id(Request *req) {
+  TokenData *token_data = validate_token(req->token);
+  if (!token_data)
+    return 0;
+
+  int user_id = token_data->user_id;
+  free_token_data(token_data);
+  return user_id;
+}
+
+// Lease a pooled session for the duration of one request. A leased session
+// belongs to this thread alone until it is returned. With replicas
+// configured, reads go to a replica unless the user just wrote. A read that
+// failed because its session died is run again, after a backoff, up to
+// DB_READ_RETRIES times; writes are not, since they may have gone through.
+static void run_request(ClientConn *conn, Request *req) {
+  if (is_memory_only(req->command)) {
+    Response *res = process_command(req, NULL);
+    send_result(conn, req->request_id, res);
+    free_response(res);
+    return;
+  }
+
+  int read_only = is_read_only(req->command);
+  int user_id = db_pool_has_replicas() ? request_user_id(req) : 0;
+  Response *res = NULL;
+
+  // Handlers split and trim req->data in place; a retry starts from the
+  // data as received
+  char data[sizeof(req->data)];
+  if (read_only)
+    memcpy(data, req->data, strlen(req->data) + 1);
+
+  for (int attempt = 0;; attempt++) {
+    if (attempt > 0)
+      memcpy(req->data, data, strlen(data) + 1);
+
+    DbConn *db_conn =
+        read_only ? db_pool_lease_read(user_id, NULL) : db_pool_lease(NULL);
+    if (!db_conn) {
+      free_response(res);
+      send_response(conn, req->request_id, STATUS_INTERNAL_ERROR,
+                    "DATABASE_UNAVAILABLE");
+      return;
+    }
+
+    free_response(res);
+    db_conn->caller = req->command;
+    res = process_command(req, db_conn);
+    int lost = db_pool_lost(db_conn);
+    db_pool_return(db_conn);
+
+    if (!read_only || res->status_code != STATUS_INTERNAL_ERROR || !lost ||
+        attempt >= DB_READ_RETRIES)
+      break;
+
+    log_message("WARN", "%s: database connection lost, retrying (%d/%d)",
+                req->command, attempt + 1, DB_READ_RETRIES);
+    db_pool_backoff(attempt);
+  }
+
+  if (!read_only)
+    db_pool_note_write(user_id);
+
+  send_result(conn, req->request_id, res);
+  free_response(res);
+}
+
+// ============= IN-FLIGHT WORKERS =============
+static void *inflight_worker(void *arg) {
+  ClientConn *conn = arg;
+
+  db_thread_init();
+
+  while (1) {
+    pthread_mutex_lock(&conn->queue_lock);
+    conn->idle_workers++;
+    while (conn->queue_count == 0 && !conn->closing)
+      pthread_cond_wait(&conn->queue_not_empty, &conn->queue_lock);
+    conn->idle_workers--;
+
+    if (conn->queue_count == 0) {
+      pthread_mutex_unlock(&conn->queue_lock);
+      break;
+    }
+
+    Request *req = conn->queue[conn->queue_head];
+    conn->queue_head = (conn->queue_head + 1) % MAX_INFLIGHT_REQUESTS;
+    conn->queue_count--;
+    pthread_cond_signal(&conn->queue_not_full);
+    pthread_mutex_unlock(&conn->queue_lock);
+
+    run_request(conn, req);
+    free_request(req);
+  }
+
+  db_thread_end();
+  return NULL;
+}
+
+// Queue a tagged request, starting another worker if none is idle
+static void dispatch_inflight(ClientConn *conn, Request *req) {
+  pthread_mutex_lock(&conn->queue_lock);
+
+  while (conn->queue_count == MAX_INFLIGHT_REQUESTS)
+    pthread_cond_wait(&conn->queue_not_full, &conn->queue_lock);
+
+  int tail = (conn->queue_head + conn->queue_count) % MAX_INFLIGHT_REQUESTS;
+  conn->queue[tail] = req;
+  conn->queue_count++;
+
+  if (conn->idle_workers < conn->queue_count &&
+      conn->worker_count < MAX_INFLIGHT_WORKERS) {
+    if (pthread_create(&conn->workers[conn->worker_count], NULL,
+                       inflight_worker, conn) == 0) {
+      conn->worker_count++;
+    } else {
+      log_message("ERROR", "Cannot start in-flight worker: fd=%d", conn->fd);
+    }
+  }
+
+  // No worker to take it (so it is the only one queued): run it here
+  int run_here = conn->worker_count == 0;
+  if (run_here)
+    conn->queue_count--;
+  else
+    pthread_cond_signal(&conn->queue_not_empty);
+  pthread_mutex_unlock(&conn->queue_lock);
+
+  if (run_here) {
+    run_request(conn, req);
+    free_request(req);
+  }
+}
+
+// Let the workers drain the queue, then stop them
+static void stop_inflight_workers(ClientConn *conn) {
+  pthread_mutex_lock(&conn->queue_lock);
+  conn->closing = 1;
+  pthread_cond_broadcast(&conn->queue_not_empty);
+  pthread_mutex_unlock(&conn->queue_lock);
+
+  for (int i = 0; i < conn->worker_count; i++)
+    pthread_join(conn->workers[i], NULL);
+}
+
+void handle_client(int client_fd) {
   char buffer[BUFFER_SIZE];
 
   log_message("INFO", "Handling client: fd=%d", client_fd);
@@ -112,6 +367,14 @@ void handle_client(int client_fd, MYSQL *db_conn) {
   int flag = 1;
   setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
 
+  ClientConn conn;
+  memset(&conn, 0, sizeof(conn));
+  conn.fd = client_fd;
+  pthread_mutex_init(&conn.write_lock, NULL);
+  pthread_mutex_init(&conn.queue_lock, NULL);
+  pthread_cond_init(&conn.queue_not_empty, NULL);
+  pthread_cond_init(&conn.queue_not_full, NULL);
+
   while (1) {
     memset(buffer, 0, BUFFER_SIZE);
     int bytes = read_line(client_fd, buffer, BUFFER_SIZE);
@@ -128,38 +391,34 @@ void handle_client(int client_fd, MYSQL *db_conn) {
 
     Request *req = parse_request(buffer);
     if (!req) {
-      char *err_response = build_response(STATUS_BAD_REQUEST, "INVALID_FORMAT");
-      write(client_fd, err_response, strlen(err_response));
-      fsync(client_fd);
-      log_message("SEND", "%s", err_response);
-      free_response_string(err_response);
+      send_response(&conn, 0, STATUS_BAD_REQUEST, "INVALID_FORMAT");
       continue;
     }
 
-    Response *res = process_command(req, db_conn);
-
-    char *response_msg = build_response(res->status_code, res->payload);
-    size_t response_len = strlen(response_msg);
-
-    ssize_t total_sent = 0;
-    while (total_sent < (ssize_t)response_len) {
-      ssize_t sent = write(client_fd, response_msg + total_sent,
-                           response_len - total_sent);
-      if (sent < 0)
-        break;
-      total_sent += sent;
+    // Untagged: there is no id to answer with
+    if (req->bad_request_id) {
+      send_response(&conn, 0, STATUS_BAD_REQUEST, "INVALID_REQUEST_ID");
+      free_request(req);
+      continue;
     }
 
-    if (total_sent > 0)
-      fsync(client_fd);
-
-    log_message("SEND", "%s", response_msg);
+    // Tagged requests run concurrently and may be answered out of order
+    if (req->request_id > 0) {
+      dispatch_inflight(&conn, req);
+      continue;
+    }
 
-    free_response_string(response_msg);
-    free(res);
+    run_request(&conn, req);
     free_request(req);
   }
 
+  stop_inflight_workers(&conn);
+
+  pthread_cond_destroy(&conn.queue_not_full);
+  pthread_cond_destroy(&conn.queue_not_empty);
+  pthread_mutex_destroy(&conn.queue_lock);
+  pthread_mutex_destroy(&conn.write_lock);
+
   usleep(10000);
   shutdown(client_fd, SHUT_RDWR);
   close(client_fd);
@@ -167,18 +426,55 @@ void handle_client(int client_fd, MYSQL *db_conn) {
   log_message("INFO", "Client handler finished: fd=%d", client_fd);
 }
 
+// ============= CLIENT THREAD =============
+static void *client_thread(void *arg) {
+  int client_fd = (int)(intptr_t)arg;
+
+  db_thread_init();
+  handle_client(client_fd);
+  db_thread_end();
+
+  return NULL;
+}
+
 // ============= MAIN =============
 int main(void) {
-  signal(SIGCHLD, SIG_IGN);
+  // A client that hangs up mid-write must not take the whole server down
+  signal(SIGPIPE, SIG_IGN);
 
   log_message("INFO", "Starting Meeting Server on port %d", SERVER_PORT);
 
-  MYSQL *db_conn = db_connect();
-  if (!db_conn) {
+  if (db_pool_init(DB_POOL_MIN, DB_POOL_MAX) < 0) {
     log_message("FATAL", "Cannot connect to database");
     return 1;
   }
 
+  // The user directory, slot index and free slot index are read from the
+  // database only here; afterwards each follows this server's own writes. So
+  // this server must be the only writer of the users and slots tables: one
+  // process, and no edits by hand while it runs.
+  DbConn *index_conn = db_pool_lease(NULL);
+  int index_loaded = index_conn && user_directory_load(index_conn) == 0 &&
+                     slot_index_load(index_conn) == 0 &&
+                     free_slots_load(index_conn) == 0;
+
+  // Not fatal: VIEW_HISTORY only shows those minutes as missing
+  if (index_conn && minutes_backfill(index_conn) < 0)
+    log_message("WARN", "Cannot record metadata of existing minutes");
+  if (index_conn && prune_slot_changes(index_conn, SLOT_CHANGES_KEEP_DAYS) < 0)
+    log_message("WARN", "Cannot prune the slot change log");
+
+  if (index_conn)
+    db_pool_return(index_conn);
+  if (!index_loaded) {
+    log_message("FATAL", "Cannot load the in-memory indexes");
+    return 1;
+  }
+
+  pthread_attr_t client_attr;
+  pthread_attr_init(&client_attr);
+  pthread_attr_setdetachstate(&client_attr, PTHREAD_CREATE_DETACHED);
+
   int server_fd = socket(AF_INET, SOCK_STREAM, 0);
   if (server_fd < 0) {
     log_message("FATAL", "Socket creation failed");
@@ -221,7 +517,6 @@ int main(void) {
       continue;
     }
 
-    pid_t pid = fork();
     int client_id = ++client_counter;
     char client_ip[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
@@ -229,24 +524,19 @@ int main(void) {
     log_message("INFO", "Client #%d connected from %s (fd=%d)", client_id,
                 client_ip, client_fd);
 
-    if (pid == 0) {
-      close(server_fd);
-
-      MYSQL *child_db = db_connect();
-      if (child_db) {
-        handle_client(client_fd, child_db);
-        db_close(child_db);
-      }
-
-      exit(0);
-    } else if (pid > 0) {
+    pthread_t thread;
+    if (pthread_create(&thread, &client_attr, client_thread,
+                       (void *)(intptr_t)client_fd) != 0) {
+      log_message("ERROR", "Cannot start client thread: fd=%d", client_fd);
       close(client_fd);
-    } else {
-      log_message("ERROR", "Fork failed");
     }
   }
 
-  db_close(db_conn);
+  pthread_attr_destroy(&client_attr);
+  free_slots_free();
+  slot_index_free();
+  user_directory_free();
+  db_pool_destroy();
   close(server_fd);
   return 0;
 }
\ No newline at end of file
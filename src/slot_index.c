@@ -0,0 +1,471 @@
+#include "slot_index.h"
+#include "db_stmt.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// AVL tree per teacher keyed by (start, slot_id), each node also holding the
+// latest end in its subtree so a search skips subtrees that end too early.
+// Claims in flight are nodes with slot_id 0.
+typedef struct SlotNode {
+  long long start;
+  long long end;
+  long long max_end;
+  int slot_id;
+  int height;
+  struct SlotNode *left;
+  struct SlotNode *right;
+} SlotNode;
+
+typedef struct TeacherSlots {
+  int teacher_id;
+  SlotNode *root;
+  struct TeacherSlots *next;
+} TeacherSlots;
+
+// Where a slot id sits, for moves and deletes that only know the id. A
+// deleted slot keeps its ref as a tombstone (slot ids aren't reused), so a
+// write that committed before the delete but is applied after it stays out.
+typedef struct SlotRef {
+  int slot_id;
+  int teacher_id;
+  long long start;
+  int version;
+  int deleted; // tombstone: no node in the tree
+  struct SlotRef *next;
+} SlotRef;
+
+static TeacherSlots *teachers[SLOT_INDEX_TEACHER_BUCKETS];
+static SlotRef *slot_refs[SLOT_INDEX_SLOT_BUCKETS];
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ============= TIMES =============
+static int days_in_month(int year, int month) {
+  static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  return days[month - 1] + (month == 2 && leap);
+}
+
+int slot_time_parse(const char *text, long long *out) {
+  int year, month, day, hour, minute, second = 0, len = 0;
+
+  if (sscanf(text, "%4d-%2d-%2d %2d:%2d%n", &year, &month, &day, &hour,
+             &minute, &len) != 5)
+    return -1;
+
+  if (text[len] == ':') {
+    int more = 0;
+    if (sscanf(text + len, ":%2d%n", &second, &more) != 1)
+      return -1;
+    len += more;
+  }
+
+  if (text[len] != '\0' || month < 1 || month > 12 || day < 1 ||
+      day > days_in_month(year, month) || hour < 0 || hour > 23 ||
+      minute < 0 || minute > 59 || second < 0 || second > 59)
+    return -1;
+
+  // Not seconds since anything, but ordered like the times
+  *out = ((((year * 12LL + month) * 31 + day) * 24 + hour) * 60 + minute) *
+             60 +
+         second;
+  return 0;
+}
+
+void slot_time_format(long long key, char out[SLOT_TIME_SIZE]) {
+  int second = (int)(key % 60);
+  key /= 60;
+  int minute = (int)(key % 60);
+  key /= 60;
+  int hour = (int)(key % 24);
+  key /= 24;
+
+  // Days and months count from 1
+  int day = (int)((key - 1) % 31) + 1;
+  key = (key - day) / 31;
+  int month = (int)((key - 1) % 12) + 1;
+
+  struct tm tm = {0};
+  tm.tm_year = (int)((key - month) / 12) - 1900;
+  tm.tm_mon = month - 1;
+  tm.tm_mday = day;
+  tm.tm_hour = hour;
+  tm.tm_min = minute;
+  tm.tm_sec = second;
+  strftime(out, SLOT_TIME_SIZE, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+// ============= TREE =============
+static int height(const SlotNode *n) { return n ? n->height : 0; }
+
+static void update(SlotNode *n) {
+  int left = height(n->left), right = height(n->right);
+  n->height = 1 + (left > right ? left : right);
+
+  n->max_end = n->end;
+  if (n->left && n->left->max_end > n->max_end)
+    n->max_end = n->left->max_end;
+  if (n->right && n->right->max_end > n->max_end)
+    n->max_end = n->right->max_end;
+}
+
+static SlotNode *rotate_right(SlotNode *n) {
+  SlotNode *top = n->left;
+  n->left = top->right;
+  top->right = n;
+  update(n);
+  update(top);
+  return top;
+}
+
+static SlotNode *rotate_left(SlotNode *n) {
+  SlotNode *top = n->right;
+  n->right = top->left;
+  top->left = n;
+  update(n);
+  update(top);
+  return top;
+}
+
+static SlotNode *rebalance(SlotNode *n) {
+  update(n);
+  int balance = height(n->left) - height(n->right);
+
+  if (balance > 1) {
+    if (height(n->left->left) < height(n->left->right))
+      n->left = rotate_left(n->left);
+    return rotate_right(n);
+  }
+  if (balance < -1) {
+    if (height(n->right->right) < height(n->right->left))
+      n->right = rotate_right(n->right);
+    return rotate_left(n);
+  }
+  return n;
+}
+
+static int compare(long long start, int slot_id, const SlotNode *n) {
+  if (start != n->start)
+    return start < n->start ? -1 : 1;
+  if (slot_id != n->slot_id)
+    return slot_id < n->slot_id ? -1 : 1;
+  return 0;
+}
+
+static SlotNode *insert(SlotNode *n, SlotNode *node) {
+  if (!n) {
+    node->left = node->right = NULL;
+    update(node);
+    return node;
+  }
+
+  if (compare(node->start, node->slot_id, n) < 0)
+    n->left = insert(n->left, node);
+  else
+    n->right = insert(n->right, node);
+  return rebalance(n);
+}
+
+static SlotNode *detach_min(SlotNode *n, SlotNode **min) {
+  if (!n->left) {
+    *min = n;
+    return n->right;
+  }
+  n->left = detach_min(n->left, min);
+  return rebalance(n);
+}
+
+// Unlink the node with this key into *removed (NULL if there is none)
+static SlotNode *detach(SlotNode *n, long long start, int slot_id,
+                        SlotNode **removed) {
+  if (!n)
+    return NULL;
+
+  int c = compare(start, slot_id, n);
+  if (c < 0) {
+    n->left = detach(n->left, start, slot_id, removed);
+  } else if (c > 0) {
+    n->right = detach(n->right, start, slot_id, removed);
+  } else {
+    *removed = n;
+    if (!n->right)
+      return n->left;
+
+    SlotNode *min;
+    SlotNode *right = detach_min(n->right, &min);
+    min->left = n->left;
+    min->right = right;
+    return rebalance(min);
+  }
+  return rebalance(n);
+}
+
+// Whether any interval but ignore_id's overlaps [start, end). Claims always
+// count.
+static int overlaps(const SlotNode *n, long long start, long long end,
+                    int ignore_id) {
+  if (!n || n->max_end <= start)
+    return 0;
+
+  if (overlaps(n->left, start, end, ignore_id))
+    return 1;
+
+  // This node and everything right of it start too late
+  if (n->start >= end)
+    return 0;
+
+  if (n->end > start && (n->slot_id == 0 || n->slot_id != ignore_id))
+    return 1;
+
+  return overlaps(n->right, start, end, ignore_id);
+}
+
+static void free_tree(SlotNode *n) {
+  if (!n)
+    return;
+  free_tree(n->left);
+  free_tree(n->right);
+  free(n);
+}
+
+// ============= LOOKUP =============
+// Callers hold index_lock
+static TeacherSlots *find_teacher(int teacher_id, int create) {
+  unsigned int bucket = (unsigned int)teacher_id % SLOT_INDEX_TEACHER_BUCKETS;
+
+  for (TeacherSlots *t = teachers[bucket]; t; t = t->next) {
+    if (t->teacher_id == teacher_id)
+      return t;
+  }
+
+  if (!create)
+    return NULL;
+
+  TeacherSlots *t = calloc(1, sizeof(TeacherSlots));
+  if (!t)
+    return NULL;
+  t->teacher_id = teacher_id;
+  t->next = teachers[bucket];
+  teachers[bucket] = t;
+  return t;
+}
+
+static SlotRef **find_ref(int slot_id) {
+  SlotRef **link = &slot_refs[(unsigned int)slot_id % SLOT_INDEX_SLOT_BUCKETS];
+  while (*link && (*link)->slot_id != slot_id)
+    link = &(*link)->next;
+  return link;
+}
+
+// Add a committed slot. Returns 0, or -1 out of memory.
+static int add_slot(TeacherSlots *t, int slot_id, long long start,
+                    long long end, int version) {
+  SlotNode *node = calloc(1, sizeof(SlotNode));
+  SlotRef *ref = malloc(sizeof(SlotRef));
+  if (!node || !ref) {
+    free(node);
+    free(ref);
+    return -1;
+  }
+
+  node->start = start;
+  node->end = end;
+  node->slot_id = slot_id;
+  t->root = insert(t->root, node);
+
+  ref->slot_id = slot_id;
+  ref->teacher_id = t->teacher_id;
+  ref->start = start;
+  ref->version = version;
+  ref->deleted = 0;
+  SlotRef **link = find_ref(slot_id);
+  ref->next = *link;
+  *link = ref;
+  return 0;
+}
+
+// Take slot_id's node out of its teacher's tree and forget the id
+static void drop_slot(int slot_id) {
+  SlotRef **link = find_ref(slot_id);
+  SlotRef *ref = *link;
+  if (!ref)
+    return;
+
+  TeacherSlots *t = ref->deleted ? NULL : find_teacher(ref->teacher_id, 0);
+  if (t) {
+    SlotNode *removed = NULL;
+    t->root = detach(t->root, ref->start, slot_id, &removed);
+    free(removed);
+  }
+
+  *link = ref->next;
+  free(ref);
+}
+
+// ============= LOAD =============
+typedef struct {
+  long long loaded;
+  long long skipped;
+  int failed;
+} LoadState;
+
+// Row: slot_id, teacher_id, start_time, end_time, version
+static int load_row(DbRow row, unsigned int columns, void *arg) {
+  (void)columns;
+  LoadState *state = arg;
+
+  long long start, end;
+  if (!row[2] || !row[3] || slot_time_parse(row[2], &start) < 0 ||
+      slot_time_parse(row[3], &end) < 0) {
+    state->skipped++;
+    return 0;
+  }
+
+  TeacherSlots *t = find_teacher(atoi(row[1]), 1);
+  if (!t || add_slot(t, atoi(row[0]), start, end, atoi(row[4])) < 0) {
+    state->failed = 1;
+    return 1;
+  }
+
+  state->loaded++;
+  return 0;
+}
+
+int slot_index_load(DbConn *conn) {
+  LoadState state = {0};
+
+  pthread_mutex_lock(&index_lock);
+  long long rows =
+      db_stmt_stream(conn, STMT_SLOT_INDEX_LOAD, load_row, &state, "");
+  pthread_mutex_unlock(&index_lock);
+
+  if (rows < 0 || state.failed) {
+    log_message("ERROR", "Slot index: loading failed");
+    slot_index_free();
+    return -1;
+  }
+
+  if (state.skipped > 0)
+    log_message("WARN", "Slot index: skipped %lld slots with unreadable times",
+                state.skipped);
+  log_message("INFO", "Slot index: %lld slots loaded", state.loaded);
+  return 0;
+}
+
+void slot_index_free(void) {
+  pthread_mutex_lock(&index_lock);
+
+  for (int i = 0; i < SLOT_INDEX_TEACHER_BUCKETS; i++) {
+    while (teachers[i]) {
+      TeacherSlots *t = teachers[i];
+      teachers[i] = t->next;
+      free_tree(t->root);
+      free(t);
+    }
+  }
+
+  for (int i = 0; i < SLOT_INDEX_SLOT_BUCKETS; i++) {
+    while (slot_refs[i]) {
+      SlotRef *ref = slot_refs[i];
+      slot_refs[i] = ref->next;
+      free(ref);
+    }
+  }
+
+  pthread_mutex_unlock(&index_lock);
+}
+
+// ============= WRITES =============
+SlotIndexResult slot_index_claim(int teacher_id, long long start,
+                                 long long end, int slot_id) {
+  SlotIndexResult result = SLOT_INDEX_OK;
+  pthread_mutex_lock(&index_lock);
+
+  TeacherSlots *t = find_teacher(teacher_id, 1);
+  SlotNode *claim = t ? calloc(1, sizeof(SlotNode)) : NULL;
+
+  if (!claim) {
+    result = SLOT_INDEX_ERROR;
+  } else if (overlaps(t->root, start, end, slot_id)) {
+    free(claim);
+    result = SLOT_INDEX_OVERLAP;
+  } else {
+    claim->start = start;
+    claim->end = end;
+    t->root = insert(t->root, claim);
+  }
+
+  pthread_mutex_unlock(&index_lock);
+  return result;
+}
+
+void slot_index_commit(int teacher_id, long long start, int slot_id,
+                       int version) {
+  pthread_mutex_lock(&index_lock);
+
+  TeacherSlots *t = find_teacher(teacher_id, 0);
+  SlotNode *claim = NULL;
+  if (t)
+    t->root = detach(t->root, start, 0, &claim);
+
+  // Writes commit in version order but may get here in any order
+  SlotRef *ref = *find_ref(slot_id);
+  if (claim && ref && (ref->deleted || ref->version >= version)) {
+    free(claim);
+  } else if (claim) {
+    drop_slot(slot_id);
+
+    // Reinserted: the key changes from (start, 0) to (start, slot_id)
+    if (add_slot(t, slot_id, claim->start, claim->end, version) < 0)
+      log_message("ERROR", "Slot index: out of memory, slot %d not indexed",
+                  slot_id);
+    free(claim);
+  } else {
+    log_message("ERROR", "Slot index: no claim for slot %d", slot_id);
+  }
+
+  pthread_mutex_unlock(&index_lock);
+}
+
+void slot_index_release(int teacher_id, long long start) {
+  pthread_mutex_lock(&index_lock);
+
+  TeacherSlots *t = find_teacher(teacher_id, 0);
+  SlotNode *claim = NULL;
+  if (t)
+    t->root = detach(t->root, start, 0, &claim);
+  free(claim);
+
+  pthread_mutex_unlock(&index_lock);
+}
+
+void slot_index_remove(int slot_id) {
+  pthread_mutex_lock(&index_lock);
+
+  SlotRef *ref = *find_ref(slot_id);
+  if (!ref) {
+    // Deleted before its insert got here
+    ref = calloc(1, sizeof(SlotRef));
+    if (ref) {
+      ref->slot_id = slot_id;
+      SlotRef **link = find_ref(slot_id);
+      ref->next = *link;
+      *link = ref;
+    } else {
+      log_message("ERROR", "Slot index: out of memory, slot %d not removed",
+                  slot_id);
+    }
+  } else if (!ref->deleted) {
+    TeacherSlots *t = find_teacher(ref->teacher_id, 0);
+    SlotNode *removed = NULL;
+    if (t)
+      t->root = detach(t->root, ref->start, slot_id, &removed);
+    free(removed);
+  }
+
+  if (ref)
+    ref->deleted = 1;
+  pthread_mutex_unlock(&index_lock);
+}
@@ -0,0 +1,74 @@
+#include "token_cache.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+  unsigned int seq; // odd while a writer is rewriting the entry
+  char token[TOKEN_CACHE_TOKEN_SIZE];
+  TokenData data;
+} TokenCacheEntry;
+
+static TokenCacheEntry entries[TOKEN_CACHE_ENTRIES];
+
+// Readers give up on a busy entry after this many tries
+#define READ_TRIES 4
+
+// FNV-1a
+static TokenCacheEntry *entry_for(const char *token) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char *p = (const unsigned char *)token; *p; p++) {
+    hash ^= *p;
+    hash *= 1099511628211ULL;
+  }
+  return &entries[hash & (TOKEN_CACHE_ENTRIES - 1)];
+}
+
+int token_cache_get(const char *token, TokenData *out) {
+  size_t len = strlen(token);
+  if (len == 0 || len >= TOKEN_CACHE_TOKEN_SIZE)
+    return 0;
+
+  TokenCacheEntry *entry = entry_for(token);
+
+  for (int i = 0; i < READ_TRIES; i++) {
+    unsigned int seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+
+    // Copies may be torn; the sequence check below throws them away
+    int match = memcmp(entry->token, token, len + 1) == 0;
+    TokenData data = entry->data;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq)
+      continue;
+
+    if (!match)
+      return 0;
+    *out = data;
+    return 1;
+  }
+
+  return 0;
+}
+
+void token_cache_put(const char *token, const TokenData *data) {
+  size_t len = strlen(token);
+  if (len == 0 || len >= TOKEN_CACHE_TOKEN_SIZE)
+    return;
+
+  TokenCacheEntry *entry = entry_for(token);
+
+  // Another writer holds the entry: skip, the token is cached next time
+  unsigned int seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+  if ((seq & 1) ||
+      !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, 0,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  memcpy(entry->token, token, len + 1);
+  entry->data = *data;
+
+  __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
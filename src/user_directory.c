@@ -0,0 +1,188 @@
+#include "user_directory.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *name; // interned, NULL if no such user
+  UserRole role;
+} UserEntry;
+
+// Interned names are packed into chunks that live until user_directory_free()
+#define NAME_CHUNK_SIZE 16384
+
+typedef struct NameChunk {
+  struct NameChunk *next;
+  size_t used;
+  size_t size;
+  char data[];
+} NameChunk;
+
+static UserEntry *users;
+static int capacity; // valid ids are 1..capacity - 1
+static NameChunk *chunks;
+static pthread_rwlock_t directory_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// ============= INTERNING =============
+// Callers hold directory_lock for writing
+static const char *intern(const char *name) {
+  size_t len = strlen(name) + 1;
+
+  if (!chunks || chunks->size - chunks->used < len) {
+    size_t size = len > NAME_CHUNK_SIZE ? len : NAME_CHUNK_SIZE;
+    NameChunk *chunk = malloc(sizeof(NameChunk) + size);
+    if (!chunk)
+      return NULL;
+    chunk->next = chunks;
+    chunk->used = 0;
+    chunk->size = size;
+    chunks = chunk;
+  }
+
+  char *copy = chunks->data + chunks->used;
+  memcpy(copy, name, len);
+  chunks->used += len;
+  return copy;
+}
+
+// ============= ENTRIES =============
+static UserRole parse_role(const char *role) {
+  if (role && strcmp(role, "teacher") == 0)
+    return USER_ROLE_TEACHER;
+  return USER_ROLE_STUDENT;
+}
+
+// Callers hold directory_lock for writing
+static int grow(int user_id) {
+  if (user_id < capacity)
+    return 0;
+
+  int wanted = capacity ? capacity : 1024;
+  while (wanted <= user_id)
+    wanted *= 2;
+  if (wanted > USER_DIRECTORY_MAX_ID + 1)
+    wanted = USER_DIRECTORY_MAX_ID + 1;
+
+  UserEntry *grown = realloc(users, wanted * sizeof(UserEntry));
+  if (!grown)
+    return -1;
+  memset(&grown[capacity], 0, (wanted - capacity) * sizeof(UserEntry));
+  users = grown;
+  capacity = wanted;
+  return 0;
+}
+
+static int put_user(int user_id, const char *username, UserRole role) {
+  if (user_id <= 0 || user_id > USER_DIRECTORY_MAX_ID || !username) {
+    log_message("WARN", "User directory: user_id=%d not kept", user_id);
+    return -1;
+  }
+  if (grow(user_id) < 0)
+    return -1;
+
+  UserEntry *entry = &users[user_id];
+  if (!entry->name || strcmp(entry->name, username) != 0) {
+    const char *name = intern(username);
+    if (!name)
+      return -1;
+    entry->name = name;
+  }
+  entry->role = role;
+  return 0;
+}
+
+// ============= LOAD =============
+// Row: user_id, username, role
+static int load_row(DbRow row, unsigned int columns, void *arg) {
+  (void)columns;
+  int *failed = arg;
+
+  if (put_user(atoi(row[0]), row[1], parse_role(row[2])) < 0)
+    *failed = 1;
+  return 0;
+}
+
+int user_directory_load(DbConn *conn) {
+  int failed = 0;
+
+  pthread_rwlock_wrlock(&directory_lock);
+  long long rows =
+      db_stmt_stream(conn, STMT_USER_DIRECTORY_LOAD, load_row, &failed, "");
+  pthread_rwlock_unlock(&directory_lock);
+
+  if (rows < 0) {
+    log_message("ERROR", "User directory: loading failed");
+    user_directory_free();
+    return -1;
+  }
+
+  // Users that didn't fit only lose their names in lists
+  if (failed)
+    log_message("WARN", "User directory: some users not loaded");
+  log_message("INFO", "User directory: %lld users", rows);
+  return 0;
+}
+
+void user_directory_free(void) {
+  pthread_rwlock_wrlock(&directory_lock);
+
+  free(users);
+  users = NULL;
+  capacity = 0;
+
+  while (chunks) {
+    NameChunk *chunk = chunks;
+    chunks = chunk->next;
+    free(chunk);
+  }
+
+  pthread_rwlock_unlock(&directory_lock);
+}
+
+int user_directory_add(int user_id, const char *username, const char *role) {
+  pthread_rwlock_wrlock(&directory_lock);
+  int rc = put_user(user_id, username, parse_role(role));
+  pthread_rwlock_unlock(&directory_lock);
+  return rc;
+}
+
+// ============= LOOKUPS =============
+const char *user_directory_name(int user_id) {
+  const char *name = NULL;
+
+  pthread_rwlock_rdlock(&directory_lock);
+  if (user_id > 0 && user_id < capacity)
+    name = users[user_id].name;
+  pthread_rwlock_unlock(&directory_lock);
+
+  return name;
+}
+
+UserRole user_directory_role(int user_id) {
+  UserRole role = USER_ROLE_NONE;
+
+  pthread_rwlock_rdlock(&directory_lock);
+  if (user_id > 0 && user_id < capacity && users[user_id].name)
+    role = users[user_id].role;
+  pthread_rwlock_unlock(&directory_lock);
+
+  return role;
+}
+
+int user_directory_list_add(DbRow row, unsigned int columns, void *arg) {
+  NamedRows *rows = arg;
+  unsigned int at = rows->user_column;
+
+  if (at >= columns || columns > USER_DIRECTORY_MAX_COLUMNS)
+    return list_payload_add(row, columns, rows->list);
+
+  char *named[USER_DIRECTORY_MAX_COLUMNS];
+  memcpy(named, row, columns * sizeof(char *));
+
+  // An unknown user lists with an empty name
+  const char *name = row[at] ? user_directory_name(atoi(row[at])) : NULL;
+  named[at] = (char *)(name ? name : "");
+
+  return list_payload_add(named, columns, rows->list);
+}
@@ -1,16 +1,23 @@
 #include "utils.h"
 #include <stdarg.h>
 #include <ctype.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <openssl/bio.h>
 #include <openssl/evp.h>
 #include <openssl/buffer.h>
+#include <openssl/rand.h>
 
 // ============= LOGGING =============
 void log_message(const char* level, const char* format, ...) {
     time_t now = time(NULL);
+    struct tm tm_now;
     char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm_now));
     
+    // Keep lines from concurrent request workers whole
+    flockfile(stdout);
     fprintf(stdout, "[%s] [%s] ", timestamp, level);
     
     va_list args;
@@ -20,6 +27,7 @@ void log_message(const char* level, const char* format, ...) {
     
     fprintf(stdout, "\n");
     fflush(stdout);
+    funlockfile(stdout);
 }
 
 // ============= STRING UTILITIES =============
@@ -38,58 +46,153 @@ char* trim(char* str) {
     return str;
 }
 
-char** split_string(char* str, const char* delimiter, int* count) {
-    if (!str || !delimiter) {
-        *count = 0;
-        return NULL;
+// ============= DELIMITER SCAN =============
+// Candidate positions must match both the first and the last byte of the
+// delimiter; only those are confirmed with memcmp.
+static const char* find_delimiter_scalar(const char* str, size_t len, const char* delim, size_t delim_len) {
+    const char* p = str;
+    const char* end = str + len;
+    
+    while ((size_t)(end - p) >= delim_len) {
+        p = memchr(p, delim[0], (end - p) - delim_len + 1);
+        if (!p) return NULL;
+        if (memcmp(p, delim, delim_len) == 0) return p;
+        p++;
     }
-    
-    int max_parts = 50;
-    char** parts = malloc(sizeof(char*) * max_parts);
-    if (!parts) {
-        *count = 0;
-        return NULL;
+    return NULL;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static const char* find_delimiter_sse2(const char* str, size_t len, const char* delim, size_t delim_len) {
+    const __m128i first = _mm_set1_epi8(delim[0]);
+    const __m128i last = _mm_set1_epi8(delim[delim_len - 1]);
+    size_t i = 0;
+    
+    for (; i + delim_len - 1 + 16 <= len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(str + i + delim_len - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        
+        while (mask) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (memcmp(str + pos + 1, delim + 1, delim_len - 1) == 0) return str + pos;
+            mask &= mask - 1;
+        }
     }
     
-    *count = 0;
-    
-    char* str_copy = strdup(str);
-    if (!str_copy) {
-        free(parts);
-        *count = 0;
-        return NULL;
+    return find_delimiter_scalar(str + i, len - i, delim, delim_len);
+}
+
+__attribute__((target("avx2")))
+static const char* find_delimiter_avx2(const char* str, size_t len, const char* delim, size_t delim_len) {
+    const __m256i first = _mm256_set1_epi8(delim[0]);
+    const __m256i last = _mm256_set1_epi8(delim[delim_len - 1]);
+    size_t i = 0;
+    
+    for (; i + delim_len - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(str + i + delim_len - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+        
+        while (mask) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (memcmp(str + pos + 1, delim + 1, delim_len - 1) == 0) return str + pos;
+            mask &= mask - 1;
+        }
     }
     
-    char* token = strtok(str_copy, delimiter);
+    return find_delimiter_sse2(str + i, len - i, delim, delim_len);
+}
+#endif
+
+const char* find_delimiter(const char* str, size_t len, const char* delim, size_t delim_len) {
+    if (!str || !delim || delim_len == 0 || len < delim_len) return NULL;
     
-    while (token != NULL && *count < max_parts) {
-        parts[*count] = strdup(token);
-        if (!parts[*count]) {
-            for (int i = 0; i < *count; i++) {
-                free(parts[i]);
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return find_delimiter_avx2(str, len, delim, delim_len);
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return find_delimiter_sse2(str, len, delim, delim_len);
+    }
+#endif
+    return find_delimiter_scalar(str, len, delim, delim_len);
+}
+
+// ============= FIELD SPLITTING =============
+static int field_list_push(FieldList* fields, char* ptr, size_t len) {
+    if (fields->count == fields->capacity) {
+        int capacity = fields->capacity > 0 ? fields->capacity * 2 : FIELD_LIST_INLINE;
+        StrView* items;
+        
+        if (fields->on_heap) {
+            items = realloc(fields->items, sizeof(StrView) * capacity);
+        } else {
+            items = malloc(sizeof(StrView) * capacity);
+            if (items && fields->count > 0) {
+                memcpy(items, fields->items, sizeof(StrView) * fields->count);
             }
-            free(parts);
-            free(str_copy);
-            *count = 0;
-            return NULL;
         }
-        (*count)++;
-        token = strtok(NULL, delimiter);
+        
+        if (!items) return -1;
+        
+        fields->items = items;
+        fields->capacity = capacity;
+        fields->on_heap = 1;
     }
     
-    free(str_copy);
-    return parts;
+    fields->items[fields->count].ptr = ptr;
+    fields->items[fields->count].len = len;
+    fields->count++;
+    return 0;
 }
 
-void free_split(char** parts, int count) {
-    if (!parts) return;
+int split_fields(char* str, const char* delimiter, int max_fields, FieldList* out) {
+    if (!out) return -1;
+    out->count = 0;
+    
+    if (!str || !delimiter || !*delimiter) return -1;
     
-    for (int i = 0; i < count; i++) {
-        if (parts[i]) {
-            free(parts[i]);
+    size_t len = strlen(str);
+    size_t delim_len = strlen(delimiter);
+    if (len == 0) return 0;
+    
+    char* field = str;
+    char* end = str + len;
+    
+    while (1) {
+        char* hit = NULL;
+        if (max_fields <= 0 || out->count < max_fields - 1) {
+            hit = (char*)find_delimiter(field, end - field, delimiter, delim_len);
+        }
+        
+        if (field_list_push(out, field, (hit ? hit : end) - field) < 0) {
+            log_message("ERROR", "split_fields: out of memory");
+            return -1;
         }
+        
+        if (!hit) break;
+        
+        *hit = '\0';
+        field = hit + delim_len;
     }
-    free(parts);
+    
+    return out->count;
+}
+
+void free_field_list(FieldList* fields) {
+    if (!fields) return;
+    
+    if (fields->on_heap) {
+        free(fields->items);
+        fields->items = NULL;
+        fields->capacity = 0;
+        fields->on_heap = 0;
+    }
+    fields->count = 0;
 }
 
 // ============= BASE64 =============
@@ -131,13 +234,21 @@ unsigned char* base64_decode(const char* input, int* output_length) {
 }
 
 // ============= RANDOM STRING =============
-void generate_random_string(char* dest, int length) {
+int generate_random_string(char* dest, int length) {
     const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-    srand(time(NULL));
+    unsigned char bytes[256];
+    
+    // OpenSSL's generator is thread-safe, unlike srand()/rand()
+    if (length < 0 || length > (int)sizeof(bytes) ||
+        RAND_bytes(bytes, length) != 1) {
+        log_message("ERROR", "Cannot generate random bytes");
+        return -1;
+    }
     
+    // 62 symbols: the modulo bias is below 2%, fine for a token nonce
     for (int i = 0; i < length; i++) {
-        int key = rand() % (sizeof(charset) - 1);
-        dest[i] = charset[key];
+        dest[i] = charset[bytes[i] % (sizeof(charset) - 1)];
     }
     dest[length] = '\0';
+    return 0;
 }
\ No newline at end of file
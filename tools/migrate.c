@@ -0,0 +1,458 @@
+// Applies the versioned schema migrations in migrations/ and checks that the
+// handler queries are served by indexes.
+//
+// Usage: bin/migrate [-d DIR] [up]   apply pending migrations in version order
+//        bin/migrate [-d DIR] status list applied and pending migrations
+//        bin/migrate check           EXPLAIN every catalog statement
+//
+// Migrations are files named NNN_description.sql. Each one runs once and is
+// recorded in schema_migrations. Statements that fail only because their
+// change is already there (table, column or index exists) are skipped, so
+// migrations can be re-run on databases set up by hand.
+#include "database.h"
+#include "db_stmt.h"
+#include <dirent.h>
+#include <mysql/mysqld_error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIGRATIONS_DIR "migrations"
+#define MIGRATIONS_MAX 256
+
+// Parameter values the catalog statements are EXPLAINed with
+#define SAMPLE_INT "1"
+#define SAMPLE_LONG "0"
+#define SAMPLE_STRING "'2026-01-12 09:00:00'"
+
+typedef struct {
+  int version;
+  char name[256];
+} Migration;
+
+static const char *migrations_dir = MIGRATIONS_DIR;
+
+// ============= MIGRATION FILES =============
+static int compare_migrations(const void *a, const void *b) {
+  return ((const Migration *)a)->version - ((const Migration *)b)->version;
+}
+
+// NNN_description.sql, sorted by version. Returns the count, -1 on error.
+static int load_migrations(Migration *list, int max) {
+  DIR *dir = opendir(migrations_dir);
+  if (!dir) {
+    fprintf(stderr, "Cannot open %s\n", migrations_dir);
+    return -1;
+  }
+
+  int count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    size_t len = strlen(name);
+    int version = 0;
+    int digits = 0;
+
+    if (len < 5 || strcmp(name + len - 4, ".sql") != 0)
+      continue;
+    if (sscanf(name, "%d_%n", &version, &digits) != 1 || digits == 0)
+      continue;
+    if (len >= sizeof(list[0].name) || count == max) {
+      fprintf(stderr, "Skipping %s\n", name);
+      continue;
+    }
+
+    list[count].version = version;
+    strcpy(list[count].name, name);
+    count++;
+  }
+  closedir(dir);
+
+  qsort(list, count, sizeof(Migration), compare_migrations);
+
+  for (int i = 1; i < count; i++) {
+    if (list[i].version == list[i - 1].version) {
+      fprintf(stderr, "Duplicate migration version %d: %s and %s\n",
+              list[i].version, list[i - 1].name, list[i].name);
+      return -1;
+    }
+  }
+
+  return count;
+}
+
+static char *read_file(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char *content = malloc(size + 1);
+  if (content && fread(content, 1, size, f) != (size_t)size) {
+    free(content);
+    content = NULL;
+  }
+  fclose(f);
+
+  if (content)
+    content[size] = '\0';
+  return content;
+}
+
+// Next ';'-terminated statement in *cursor, with leading blanks and "--"
+// comments skipped. Terminates it in place; NULL when none is left.
+static char *next_statement(char **cursor) {
+  char *p = *cursor;
+
+  while (1) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+      p++;
+    if (p[0] == '-' && p[1] == '-') {
+      while (*p && *p != '\n')
+        p++;
+      continue;
+    }
+    break;
+  }
+
+  if (*p == '\0') {
+    *cursor = p;
+    return NULL;
+  }
+
+  char *start = p;
+  char quote = 0;
+  for (; *p; p++) {
+    if (quote) {
+      if (*p == '\\' && p[1])
+        p++;
+      else if (*p == quote)
+        quote = 0;
+    } else if (*p == '\'' || *p == '"' || *p == '`') {
+      quote = *p;
+    } else if (p[0] == '-' && p[1] == '-') {
+      while (p[1] && p[1] != '\n')
+        p++;
+    } else if (*p == ';') {
+      *p++ = '\0';
+      break;
+    }
+  }
+
+  *cursor = p;
+  return start;
+}
+
+// ============= SCHEMA_MIGRATIONS =============
+static int ensure_migrations_table(MYSQL *conn) {
+  if (mysql_query(conn, "CREATE TABLE IF NOT EXISTS schema_migrations ("
+                        "version INT NOT NULL PRIMARY KEY, "
+                        "name VARCHAR(255) NOT NULL, "
+                        "applied_at TIMESTAMP NOT NULL "
+                        "DEFAULT CURRENT_TIMESTAMP)")) {
+    fprintf(stderr, "Creating schema_migrations failed: %s\n",
+            mysql_error(conn));
+    return -1;
+  }
+  return 0;
+}
+
+// Versions already applied, ascending. Returns the count, -1 on error.
+static int load_applied(MYSQL *conn, int *versions, int max) {
+  if (mysql_query(conn,
+                  "SELECT version FROM schema_migrations ORDER BY version")) {
+    fprintf(stderr, "Reading schema_migrations failed: %s\n",
+            mysql_error(conn));
+    return -1;
+  }
+
+  MYSQL_RES *result = mysql_store_result(conn);
+  if (!result)
+    return -1;
+
+  int count = 0;
+  MYSQL_ROW row;
+  while ((row = mysql_fetch_row(result)) != NULL && count < max)
+    versions[count++] = atoi(row[0]);
+
+  mysql_free_result(result);
+  return count;
+}
+
+static int is_applied(const int *versions, int count, int version) {
+  for (int i = 0; i < count; i++) {
+    if (versions[i] == version)
+      return 1;
+  }
+  return 0;
+}
+
+static int record_migration(MYSQL *conn, const Migration *m) {
+  char escaped[2 * sizeof(m->name) + 1];
+  mysql_real_escape_string(conn, escaped, m->name, strlen(m->name));
+
+  char query[sizeof(escaped) + 128];
+  snprintf(query, sizeof(query),
+           "INSERT INTO schema_migrations (version, name) VALUES (%d, '%s')",
+           m->version, escaped);
+
+  if (mysql_query(conn, query)) {
+    fprintf(stderr, "Recording %s failed: %s\n", m->name, mysql_error(conn));
+    return -1;
+  }
+  return 0;
+}
+
+// ============= UP =============
+// Errors meaning the statement's change is already in the schema
+static int already_applied(unsigned int err) {
+  return err == ER_TABLE_EXISTS_ERROR || err == ER_DUP_FIELDNAME ||
+         err == ER_DUP_KEYNAME || err == ER_CANT_DROP_FIELD_OR_KEY;
+}
+
+static int apply_migration(MYSQL *conn, const Migration *m) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", migrations_dir, m->name);
+
+  char *content = read_file(path);
+  if (!content) {
+    fprintf(stderr, "Cannot read %s\n", path);
+    return -1;
+  }
+
+  printf("Applying %s\n", m->name);
+
+  char *cursor = content;
+  char *sql;
+  int rc = 0;
+
+  while ((sql = next_statement(&cursor)) != NULL) {
+    if (mysql_query(conn, sql)) {
+      unsigned int err = mysql_errno(conn);
+      if (already_applied(err)) {
+        printf("  skipped (%s)\n", mysql_error(conn));
+        continue;
+      }
+
+      fprintf(stderr, "  failed: %s\n  in: %.200s\n", mysql_error(conn), sql);
+      rc = -1;
+      break;
+    }
+
+    MYSQL_RES *result = mysql_store_result(conn);
+    if (result)
+      mysql_free_result(result);
+  }
+
+  free(content);
+
+  if (rc == 0)
+    rc = record_migration(conn, m);
+  return rc;
+}
+
+static int cmd_up(MYSQL *conn, const Migration *list, int count) {
+  int applied[MIGRATIONS_MAX];
+  int applied_count = load_applied(conn, applied, MIGRATIONS_MAX);
+  if (applied_count < 0)
+    return 1;
+
+  int ran = 0;
+  for (int i = 0; i < count; i++) {
+    if (is_applied(applied, applied_count, list[i].version))
+      continue;
+
+    // DDL commits implicitly, so a failed migration stays partly applied;
+    // fix it and run again, finished statements are skipped then
+    if (apply_migration(conn, &list[i]) < 0)
+      return 1;
+    ran++;
+  }
+
+  printf("%d migration(s) applied, schema at version %d\n", ran,
+         count > 0 ? list[count - 1].version : 0);
+  return 0;
+}
+
+static int cmd_status(MYSQL *conn, const Migration *list, int count) {
+  int applied[MIGRATIONS_MAX];
+  int applied_count = load_applied(conn, applied, MIGRATIONS_MAX);
+  if (applied_count < 0)
+    return 1;
+
+  for (int i = 0; i < count; i++) {
+    printf("%-8s %s\n",
+           is_applied(applied, applied_count, list[i].version) ? "applied"
+                                                               : "pending",
+           list[i].name);
+  }
+  return 0;
+}
+
+// ============= CHECK =============
+// Catalog SQL with each '?' replaced by a sample literal of its type
+static int explain_sql(StmtId id, char *out, size_t size) {
+  const char *params;
+  const char *sql = db_stmt_sql(id, &params);
+  int typed = params ? (int)strlen(params) : 0;
+  size_t len = snprintf(out, size, "EXPLAIN ");
+  int index = 0;
+
+  for (const char *p = sql; *p && len < size - 1; p++) {
+    if (*p != '?') {
+      out[len++] = *p;
+      continue;
+    }
+
+    // Id lists are ints, after any typed parameters
+    char type = index < typed ? params[index] : 'i';
+    const char *sample = type == 's'   ? SAMPLE_STRING
+                         : type == 'l' ? SAMPLE_LONG
+                                       : SAMPLE_INT;
+    len += snprintf(out + len, size - len, "%s", sample);
+    index++;
+  }
+
+  if (len >= size - 1)
+    return -1;
+  out[len] = '\0';
+  return 0;
+}
+
+static int field_index(MYSQL_RES *result, const char *name) {
+  MYSQL_FIELD *fields = mysql_fetch_fields(result);
+  unsigned int count = mysql_num_fields(result);
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (strcmp(fields[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// 0 if every table the statement reads is accessed through an index, 1 if one
+// is scanned with no usable index, -1 on error. Scans the optimizer picks
+// although an index exists (tiny test tables) are reported but pass.
+static int check_statement(MYSQL *conn, StmtId id) {
+  static char query[8192];
+  if (explain_sql(id, query, sizeof(query)) < 0) {
+    printf("ERROR stmt %d: statement too long\n", id);
+    return -1;
+  }
+
+  if (mysql_query(conn, query)) {
+    printf("ERROR stmt %d: %s\n", id, mysql_error(conn));
+    return -1;
+  }
+
+  MYSQL_RES *result = mysql_store_result(conn);
+  if (!result) {
+    printf("ERROR stmt %d: %s\n", id, mysql_error(conn));
+    return -1;
+  }
+
+  int col_select = field_index(result, "select_type");
+  int col_table = field_index(result, "table");
+  int col_type = field_index(result, "type");
+  int col_possible = field_index(result, "possible_keys");
+  int col_key = field_index(result, "key");
+  if (col_select < 0 || col_table < 0 || col_type < 0 || col_possible < 0 ||
+      col_key < 0) {
+    printf("ERROR stmt %d: unexpected EXPLAIN format\n", id);
+    mysql_free_result(result);
+    return -1;
+  }
+
+  int rc = 0;
+  MYSQL_ROW row;
+  while ((row = mysql_fetch_row(result)) != NULL) {
+    const char *select_type = row[col_select];
+    const char *table = row[col_table];
+    const char *type = row[col_type];
+
+    // Derived tables, union results and INSERT targets read no index
+    if (!table || !type || table[0] == '<' ||
+        (select_type && strcmp(select_type, "INSERT") == 0))
+      continue;
+
+    if (strcmp(type, "ALL") != 0 && strcmp(type, "index") != 0)
+      continue;
+
+    if (!row[col_possible]) {
+      printf("FAIL  stmt %d: full scan of %s, no usable index\n", id, table);
+      rc = 1;
+    } else {
+      printf("WARN  stmt %d: %s scan of %s although %s could be used\n", id,
+             type, table, row[col_possible]);
+    }
+  }
+
+  mysql_free_result(result);
+  return rc;
+}
+
+static int cmd_check(MYSQL *conn) {
+  int failed = 0;
+  int errors = 0;
+
+  for (int id = 0; id < STMT_COUNT; id++) {
+    int rc = check_statement(conn, id);
+    if (rc > 0)
+      failed++;
+    else if (rc < 0)
+      errors++;
+  }
+
+  printf("%d statement(s) checked: %d without index, %d error(s)\n",
+         STMT_COUNT, failed, errors);
+  return failed || errors ? 1 : 0;
+}
+
+// ============= MAIN =============
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-d DIR] [up|status|check]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  const char *command = "up";
+  int i = 1;
+
+  if (i + 1 < argc && strcmp(argv[i], "-d") == 0) {
+    migrations_dir = argv[i + 1];
+    i += 2;
+  }
+  if (i < argc)
+    command = argv[i++];
+  if (i < argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  MYSQL *conn = db_connect();
+  if (!conn)
+    return 1;
+
+  int rc;
+  if (strcmp(command, "check") == 0) {
+    rc = cmd_check(conn);
+  } else if (strcmp(command, "up") == 0 || strcmp(command, "status") == 0) {
+    Migration list[MIGRATIONS_MAX];
+    int count = load_migrations(list, MIGRATIONS_MAX);
+
+    if (count < 0 || ensure_migrations_table(conn) < 0)
+      rc = 1;
+    else if (strcmp(command, "up") == 0)
+      rc = cmd_up(conn, list, count);
+    else
+      rc = cmd_status(conn, list, count);
+  } else {
+    usage(argv[0]);
+    rc = 2;
+  }
+
+  db_close(conn);
+  return rc;
+}